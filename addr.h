@@ -0,0 +1,34 @@
+#ifndef ADDR_H
+#define ADDR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Byte and block addresses are 64 bits wide everywhere, from the trace
+// reader down to memory; 32-bit traces just have the upper bits clear.
+typedef uint64_t addr_t;
+#define ADDR_SIZE 64
+
+// One request of a trace
+typedef struct {
+    char rw;        // 'r' or 'w'
+    addr_t addr;
+} trace_record;
+
+// Parses a byte count with an optional K, M or G suffix ("2M"); 0 if malformed
+static inline uint64_t parse_bytes(const char* s){
+    char* end;
+    uint64_t v = strtoull(s, &end, 10);
+    if (end == s){
+        return 0;
+    }
+    switch (*end){
+        case 'k': case 'K': v <<= 10; end++; break;
+        case 'm': case 'M': v <<= 20; end++; break;
+        case 'g': case 'G': v <<= 30; end++; break;
+        default: break;
+    }
+    return (*end == '\0') ? v : 0;
+}
+
+#endif // ADDR_H
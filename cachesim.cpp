@@ -1,6 +1,16 @@
 #include <iostream>
 #include <fstream>
 #include "cachesim.h"
+#include "hierarchy.h"
+#include "stack_distance.h"
+#include "sweep.h"
+#include "multicore.h"
+#include "hierarchy_config.h"
+#include "sampling.h"
+#include "intervals.h"
+#include "profile.h"
+#include "partition.h"
+#include "trace_reader.h"
 
 using namespace std;
 
@@ -14,16 +24,710 @@ using namespace std;
     argv[1] = "32"
     argv[2] = "8192"
     ... and so on
+
+    Wherever a trace file goes, "-" reads the trace from stdin, and a
+    synthetic trace spec such as synth:zipf:n=1G,footprint=256M,alpha=1.1
+    generates the requests on the fly (see synthetic.h).
+
+    Options (anywhere on the command line):
+    --l1-repl=POLICY, --l2-repl=POLICY
+        Replacement policy of that level: lru (default), plru, srrip, brrip,
+        drrip, random or fifo.
+    --l1-pref=KIND, --l2-pref=KIND, --pref-degree=N
+        Prefetcher of that level: none, stream (PREF_N stream buffers of
+        PREF_M blocks), nextline, stride, ghb or bop (see prefetcher.h); the
+        default is stream buffers at the last level if PREF_N > 0. Degree
+        (default 4) is the number of blocks nextline, stride and ghb fetch
+        at a time. Setting either prefetcher adds prefetcher statistics to
+        the output.
+    --l2-block=BYTES, --l1-sectors=N, --l2-sectors=N
+        L2 line size (default BLOCKSIZE; at least BLOCKSIZE), and sectors
+        per line of that level (a power of 2 up to 8; default 1). Sectored
+        lines keep a valid and a dirty bit per sector, and fetch, write
+        back and prefetch sectors instead of whole lines; a request finding
+        its line without its sector is a miss. Either option adds a section
+        with the bytes every level moved (memory traffic in bytes).
+    --llc-reuse=ship|sdbp, --llc-reuse-mode=low|bypass, --llc-reuse-compare
+        Reuse predictor of the last level (see reuse_predictor.h): a block
+        it predicts dead on a demand miss goes in at the lowest priority
+        (low, the default) or bypasses the level. A section reports its
+        predictions and the last level's misses and memory traffic. With
+        --llc-reuse-compare the same run without it goes along (twice the
+        time and memory), and the section compares the two.
+    --timing
+        Also runs the cycle-approximate timing model (timing.h) and reports
+        total cycles, average memory access time and memory bandwidth.
+    --l1-latency=N, --l2-latency=N, --l3-latency=N, --l1-mshrs=N,
+    --l2-mshrs=N, --l3-mshrs=N,
+    --dram-banks=N, --dram-row=BYTES, --dram-tcas=N, --dram-trcd=N,
+    --dram-trp=N, --dram-bus=BYTES_PER_CYCLE, --cpu-ghz=F
+        Timing model parameters (imply --timing); times are in core cycles.
+        L3 is the shared LLC of a multicore run with private L2s.
+    --page-map=first-touch|random, --page-size=BYTES, --phys-mem=BYTES,
+    --page-seed=N
+        Translates the trace's (virtual) addresses to physical ones before
+        L1, allocating page frames in first-touch order or at random from
+        --phys-mem (default 16G) of memory (see page_map.h). Pages are 4K
+        unless --page-size says otherwise (2M, 1G for huge pages); sizes
+        take a K, M or G suffix. Prefetchers then stop at page boundaries.
+    --checkpoint=FILE --checkpoint-at=N, --restore=FILE, --stop-at=N
+        Save the whole hierarchy state to FILE after the first N accesses of
+        the trace (the run goes on), resume the trace from a saved
+        checkpoint instead of from its start, or stop after access N (see
+        checkpoint.h). A checkpoint restores into the same geometry and
+        page map; replacement policies and prefetchers that differ from
+        the saved ones start cold, as does the timing model.
+    --events=FILE
+        Logs every hit, miss, eviction, writeback, prefetch issued and
+        prefetch used, at every level, to FILE in a compact binary format
+        (see event_log.h); ./sim events FILE decodes it.
+    --interval=N
+        Adds a section with miss rates, misses per 1000 accesses, memory
+        traffic and prefetch accuracy of every N accesses (see intervals.h).
+    --parallel=N
+        Splits the trace by cache set over N worker threads (0 uses every
+        hardware thread) and merges their results, which are exactly those
+        of a serial run (see partition.h). Runs with prefetchers, DRRIP,
+        BRRIP or random replacement, timing, events, intervals,
+        checkpoints or a reuse predictor couple the sets and stay serial.
+    --profile
+        Prints the time spent in setup, trace parsing, simulation and
+        reporting, accesses per second and peak memory to stderr (see
+        profile.h).
+
+    Subcommands:
+    ./sim convert traces/gcc_trace.txt gcc_trace.cstb
+        Converts a text trace to the binary trace format (see trace_binary.h).
+        Binary traces can then be passed to ./sim in place of text traces.
+        Converting a synthetic trace spec saves it to a file.
+
+    ./sim stackdist 32 1024,2048,4096,8192 1,2,4,8 traces/gcc_trace.txt
+        Reports L1 read/write misses (LRU, write-allocate) for every
+        (size, assoc) pair of the grid in one pass over the trace. L1
+        only; use sweep for L2 grids.
+
+    ./sim sweep configs.txt traces/gcc_trace.txt [--threads=N] [--format=csv|json]
+        Decodes the trace once and simulates every config of configs.txt
+        (format in sweep.h) in parallel; prints one row of a-q per config.
+        Takes the prefetcher, timing and page map options too (applied to
+        every config); timing adds the timing results to each row.
+
+    ./sim multicore 32 8192 4 1048576 16 3 10 t0.txt t1.txt [...]
+          [--private-l2=SIZE,ASSOC] [--interleave=rr|timing]
+        One core per trace, each with private L1 (and L2) caches, sharing
+        the L2 (the LLC) kept coherent with MESI (see multicore.h). Reports
+        per-core miss rates, coherence and LLC sharing statistics.
+
+    ./sim sample 32 8192 4 262144 8 3 10 traces/gcc_trace.txt [--period=N]
+          [--unit=N] [--warmup=N] [--sets=K] [--fast-forward=warm|skip]
+          [--validate]
+        Sampled simulation (see sampling.h): measures unit accesses (default
+        1000) at the end of every period, after warmup (default 2000)
+        unmeasured ones, fast-forwarding the rest with functional warming or
+        skipping it; --sets=K simulates 1 in K cache sets. Prints the
+        extrapolated a-q measurements with 95% confidence intervals, and
+        with --validate the full run's values next to them. Takes the
+        replacement, prefetcher and page map options.
+
+    ./sim events FILE [--summary]
+        Prints the events of a log written with --events, one per line
+        (access, level, event, r/w/p, block address), or with --summary
+        only the count of each event at each level.
+
+    ./sim hierarchy server.cfg traces/gcc_trace.txt [--timing ...]
+        Simulates the hierarchy described by server.cfg (format in
+        hierarchy_config.h): any number of levels, a split L1I/L1D, victim
+        caches and a NINE, inclusive or exclusive policy per level. Takes
+        the timing and page map options.
 */
 
+// Applies a prefetcher option to params; returns false if name isn't one
+bool parse_prefetch_option(const string& name, const char* value, cache_params_t& params){
+    if (name == "l1-pref" || name == "l2-pref") {
+        prefetcher_kind_t kind = parse_prefetcher(value);
+        if (kind == PREF_NUM_KINDS) {
+            printf("Error: Unknown prefetcher %s.\n", value);
+            exit(EXIT_FAILURE);
+        }
+        ((name == "l1-pref") ? params.l1_pref : params.l2_pref) = kind;
+        return true;
+    }
+    if (name == "pref-degree") {
+        params.pref_degree = (uint32_t) atoi(value);
+        return true;
+    }
+    return false;
+}
+
+// Applies a page map option to params; returns false if name isn't one
+bool parse_page_map_option(const string& name, const char* value, cache_params_t& params){
+    if (name == "page-map") {
+        params.page_map.kind = parse_page_map(value);
+        if (params.page_map.kind == PAGE_MAP_NUM_KINDS) {
+            printf("Error: Unknown page map %s.\n", value);
+            exit(EXIT_FAILURE);
+        }
+        return true;
+    }
+    if (name == "page-size" || name == "phys-mem") {
+        uint64_t bytes = parse_bytes(value);
+        if (bytes == 0) {
+            printf("Error: Expected a size in bytes for --%s but got %s.\n", name.c_str(), value);
+            exit(EXIT_FAILURE);
+        }
+        ((name == "page-size") ? params.page_map.page_size : params.page_map.phys_mem) = bytes;
+        return true;
+    }
+    if (name == "page-seed") {
+        params.page_map.seed = strtoull(value, NULL, 10);
+        return true;
+    }
+    return false;
+}
+
+// Applies a timing model option to params; returns false if name isn't one
+bool parse_timing_option(const string& name, const char* value, cache_params_t& params){
+    struct { const char* name; uint32_t* field; } options[] = {
+        { "l1-latency", &params.timing.l1_latency },
+        { "l2-latency", &params.timing.l2_latency },
+        { "l3-latency", &params.timing.l3_latency },
+        { "l1-mshrs",   &params.timing.l1_mshrs },
+        { "l2-mshrs",   &params.timing.l2_mshrs },
+        { "l3-mshrs",   &params.timing.l3_mshrs },
+        { "dram-banks", &params.timing.dram_banks },
+        { "dram-row",   &params.timing.dram_row },
+        { "dram-tcas",  &params.timing.dram_tcas },
+        { "dram-trcd",  &params.timing.dram_trcd },
+        { "dram-trp",   &params.timing.dram_trp },
+        { "dram-bus",   &params.timing.dram_bus },
+    };
+
+    if (name == "timing") {
+        params.timing_enabled = true;
+        return true;
+    }
+    if (name == "cpu-ghz") {
+        params.timing.cpu_ghz = atof(value);
+        params.timing_enabled = true;
+        return true;
+    }
+    for (uint32_t i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        if (name == options[i].name) {
+            *options[i].field = (uint32_t) atoi(value);
+            params.timing_enabled = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Applies a line size or sector option to params; returns false if name isn't one
+bool parse_line_option(const string& name, const char* value, cache_params_t& params){
+    if (name == "l2-block") {
+        params.l2_blocksize = (uint32_t) parse_bytes(value);
+        if (params.l2_blocksize == 0) {
+            printf("Error: Expected a size in bytes for --%s but got %s.\n", name.c_str(), value);
+            exit(EXIT_FAILURE);
+        }
+        return true;
+    }
+    if (name == "l1-sectors" || name == "l2-sectors") {
+        int sectors = atoi(value);
+        if (sectors <= 0) {
+            printf("Error: Expected a number of sectors for --%s but got %s.\n", name.c_str(), value);
+            exit(EXIT_FAILURE);
+        }
+        ((name == "l1-sectors") ? params.l1_sectors : params.l2_sectors) = (uint32_t) sectors;
+        return true;
+    }
+    return false;
+}
+
+// Applies a reuse predictor option to params; returns false if name isn't one
+bool parse_reuse_option(const string& name, const char* value, cache_params_t& params){
+    if (name == "llc-reuse") {
+        params.llc_reuse = parse_reuse_kind(value);
+        if (params.llc_reuse == REUSE_NUM_KINDS) {
+            printf("Error: Unknown reuse predictor %s.\n", value);
+            exit(EXIT_FAILURE);
+        }
+        return true;
+    }
+    if (name == "llc-reuse-mode") {
+        params.llc_reuse_mode = parse_reuse_mode(value);
+        if (params.llc_reuse_mode == REUSE_NUM_MODES) {
+            printf("Error: Unknown reuse predictor mode %s.\n", value);
+            exit(EXIT_FAILURE);
+        }
+        return true;
+    }
+    if (name == "llc-reuse-compare") {
+        params.llc_reuse_compare = true;
+        return true;
+    }
+    return false;
+}
+
+// Returns why params' line sizes, sectors and reuse predictor can't be
+// simulated, or NULL
+const char* line_params_error(const cache_params_t& params){
+    uint32_t l2_block = l2_block_size(params);
+    if (l2_block < params.blocksize || (l2_block & (l2_block - 1))) {
+        return "--l2-block must be a power of 2 no smaller than BLOCKSIZE.";
+    }
+    if (params.l2_size > 0 && params.l2_size % (params.l2_assoc * l2_block) != 0) {
+        return "L2_SIZE must be a whole number of sets of --l2-block lines.";
+    }
+    uint32_t sectors[2] = { sectors_of(params.l1_sectors), sectors_of(params.l2_sectors) };
+    uint32_t blocks[2]  = { params.blocksize, l2_block };
+    for (uint32_t lvl = 0; lvl < 2; lvl++) {
+        if ((sectors[lvl] & (sectors[lvl] - 1)) || sectors[lvl] > MAX_SECTORS || sectors[lvl] > blocks[lvl]) {
+            return "Sectors per line must be a power of 2 up to 8 (and the line size).";
+        }
+    }
+    if (params.llc_reuse != REUSE_NONE && sectors[(params.l2_size > 0) ? 1 : 0] > 1) {
+        return "--llc-reuse needs an unsectored last level.";
+    }
+    if (params.llc_reuse_compare && params.llc_reuse == REUSE_NONE) {
+        return "--llc-reuse-compare needs --llc-reuse.";
+    }
+    return NULL;
+}
+
+// Applies the "--name=value" options to params and removes them from argv,
+// leaving only the positional arguments. The line size, sector and reuse
+// predictor options are only taken by plain runs.
+void parse_options(int& argc, char *argv[], cache_params_t& params, bool plain_run = false){
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            argv[kept++] = argv[i];
+            continue;
+        }
+        const char* eq = strchr(argv[i], '=');
+        string name(argv[i] + 2, eq ? eq - argv[i] - 2 : strlen(argv[i] + 2));
+        const char* value = eq ? eq + 1 : "";
+
+        if (name == "l1-repl" || name == "l2-repl") {
+            repl_policy_t policy = parse_repl_policy(value);
+            if (policy == REPL_NUM_POLICIES) {
+                printf("Error: Unknown replacement policy %s.\n", value);
+                exit(EXIT_FAILURE);
+            }
+            ((name == "l1-repl") ? params.l1_repl : params.l2_repl) = policy;
+        }else if (parse_prefetch_option(name, value, params) || parse_timing_option(name, value, params) ||
+                  parse_page_map_option(name, value, params) || (plain_run && (parse_line_option(name, value, params) || parse_reuse_option(name, value, params)))) {
+            // applied
+        }else {
+            printf("Error: Unknown option %s.\n", argv[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    argc = kept;
+}
+
+// Checkpoint and observation options of a plain run
+typedef struct {
+    const char* save_file;
+    uint64_t save_at;           // accesses before the checkpoint; 0 saves none
+    const char* restore_file;
+    uint64_t stop_at;           // last access simulated; 0 runs to the end of the trace
+    const char* events_file;    // NULL logs no events
+    uint64_t interval;          // accesses per interval; 0 reports none
+    bool profile;
+    int64_t parallel;           // worker threads; -1 runs serially, 0 uses all
+} run_options_t;
+
+// Takes the run options out of argv (before parse_options())
+run_options_t parse_run_options(int& argc, char *argv[]){
+    run_options_t c;
+    c.save_file    = NULL;
+    c.save_at      = 0;
+    c.restore_file = NULL;
+    c.stop_at      = 0;
+    c.events_file  = NULL;
+    c.interval     = 0;
+    c.profile      = false;
+    c.parallel     = -1;
+
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--checkpoint=", 13) == 0) {
+            c.save_file = argv[i] + 13;
+        }else if (strncmp(argv[i], "--checkpoint-at=", 16) == 0) {
+            c.save_at = strtoull(argv[i] + 16, NULL, 10);
+        }else if (strncmp(argv[i], "--restore=", 10) == 0) {
+            c.restore_file = argv[i] + 10;
+        }else if (strncmp(argv[i], "--stop-at=", 10) == 0) {
+            c.stop_at = strtoull(argv[i] + 10, NULL, 10);
+        }else if (strncmp(argv[i], "--events=", 9) == 0) {
+            c.events_file = argv[i] + 9;
+        }else if (strncmp(argv[i], "--interval=", 11) == 0) {
+            c.interval = strtoull(argv[i] + 11, NULL, 10);
+            if (c.interval == 0) {
+                printf("Error: --interval needs N > 0 accesses.\n");
+                exit(EXIT_FAILURE);
+            }
+        }else if (strcmp(argv[i], "--profile") == 0) {
+            c.profile = true;
+        }else if (strncmp(argv[i], "--parallel=", 11) == 0) {
+            c.parallel = strtoll(argv[i] + 11, NULL, 10);
+            if (c.parallel < 0) {
+                printf("Error: --parallel needs N >= 0 threads.\n");
+                exit(EXIT_FAILURE);
+            }
+        }else {
+            argv[kept++] = argv[i];
+        }
+    }
+    argc = kept;
+    if ((c.save_file != NULL) != (c.save_at > 0)) {
+        printf("Error: --checkpoint and --checkpoint-at=N (N > 0) go together.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (c.save_at > 0 && c.stop_at > 0 && c.save_at > c.stop_at) {
+        printf("Error: The run stops before the checkpoint.\n");
+        exit(EXIT_FAILURE);
+    }
+    return c;
+}
+
+// Parses a comma separated list of sizes/assocs ("1024,2048,4096")
+vector<uint32_t> parse_list(const char* arg){
+    vector<uint32_t> list;
+    const char* p = arg;
+    while (*p) {
+        char* end;
+        list.push_back((uint32_t) strtoul(p, &end, 10));
+        if (end == p || (*end != ',' && *end != '\0')) {
+            printf("Error: Expected a comma separated list of numbers but got %s.\n", arg);
+            exit(EXIT_FAILURE);
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return list;
+}
+
+// One-pass stack distance simulation of a grid of L1 configs
+int stack_distance_sweep(uint32_t block_size, const char* sizes, const char* assocs, const char* trace_file){
+    TraceReader trace;
+    StackDistanceSim sim;
+    static trace_record batch[TRACE_BATCH_SIZE];
+
+    if (!sim.init(block_size, parse_list(sizes), parse_list(assocs))) {
+        exit(EXIT_FAILURE);
+    }
+    if (!trace.open(trace_file)) {
+       printf("Error: Unable to open file %s\n", trace_file);
+       exit(EXIT_FAILURE);
+    }
+
+    uint32_t n;
+    while ((n = trace.next_batch(batch, TRACE_BATCH_SIZE)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i].rw != 'r' && batch[i].rw != 'w'){
+                printf("Error: Unknown request type %c.\n", batch[i].rw);
+                exit(EXIT_FAILURE);
+            }
+            sim.access(batch[i].addr, batch[i].rw == 'w');
+        }
+    }
+    sim.finish();
+
+    printf("===== Stack distance sweep =====\n");
+    printf("BLOCKSIZE:  %u\n", block_size);
+    printf("trace_file: %s\n", trace_file);
+    printf("reads:      %llu\n", (unsigned long long) sim.reads);
+    printf("writes:     %llu\n", (unsigned long long) sim.writes);
+    printf("\n");
+    printf("%10s %6s %8s %12s %12s %10s\n", "L1_SIZE", "ASSOC", "SETS", "read_miss", "write_miss", "miss_rate");
+    for (uint32_t i = 0; i < sim.points.size(); i++) {
+        const stack_distance_point& p = sim.points[i];
+        uint64_t accesses = sim.reads + sim.writes;
+        double miss_rate = (accesses > 0) ? (double) (p.read_misses + p.write_misses) / (double) accesses : 0;
+        printf("%10u %6u %8u %12llu %12llu %10.4f\n", p.size, p.assoc, p.sets,
+               (unsigned long long) p.read_misses, (unsigned long long) p.write_misses, miss_rate);
+    }
+    return(0);
+}
+
+// Prints an event log, or how many events of each kind each level logged
+int dump_events(const char* path, bool summary){
+    EventLogReader log;
+    event_t e;
+    uint64_t counts[EVENT_MAX_LEVELS][EV_NUM_KINDS];
+    memset(counts, 0, sizeof(counts));
+
+    if (!log.open(path)) {
+       printf("Error: Unable to open file %s\n", path);
+       exit(EXIT_FAILURE);
+    }
+    while (log.next(&e)) {
+        if (summary) {
+            counts[e.level - 1][e.kind]++;
+        }else {
+            char rw = (e.flags & EV_FLAG_PREFETCH) ? 'p' : (e.flags & EV_FLAG_WRITE) ? 'w' : 'r';
+            if (e.kind == EV_HIT || e.kind == EV_MISS) {
+                printf("%llu L%u %s %c %llx\n", (unsigned long long) e.access, e.level, event_kind_names[e.kind], rw, (unsigned long long) e.block);
+            }else {
+                printf("%llu L%u %s %llx\n", (unsigned long long) e.access, e.level, event_kind_names[e.kind], (unsigned long long) e.block);
+            }
+        }
+    }
+    if (summary) {
+        printf("%-6s", "level");
+        for (uint32_t k = 0; k < EV_NUM_KINDS; k++) {
+            printf(" %12s", event_kind_names[k]);
+        }
+        printf("\n");
+        for (uint32_t l = 0; l < EVENT_MAX_LEVELS; l++) {
+            uint64_t total = 0;
+            for (uint32_t k = 0; k < EV_NUM_KINDS; k++) {
+                total += counts[l][k];
+            }
+            if (total == 0) {
+                continue;
+            }
+            printf("L%-5u", l + 1);
+            for (uint32_t k = 0; k < EV_NUM_KINDS; k++) {
+                printf(" %12llu", (unsigned long long) counts[l][k]);
+            }
+            printf("\n");
+        }
+    }
+    return(0);
+}
+
+// Converts a text (or binary) trace to the binary trace format
+int convert_trace(const char* in_file, const char* out_file){
+    TraceReader trace;
+    TraceBinWriter writer;
+    static trace_record batch[TRACE_BATCH_SIZE];
+
+    if (!trace.open(in_file)) {
+       printf("Error: Unable to open file %s\n", in_file);
+       exit(EXIT_FAILURE);
+    }
+    if (!writer.open(out_file)) {
+       printf("Error: Unable to create file %s\n", out_file);
+       exit(EXIT_FAILURE);
+    }
+
+    uint32_t n;
+    while ((n = trace.next_batch(batch, TRACE_BATCH_SIZE)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i].rw != 'r' && batch[i].rw != 'w'){
+                printf("Error: Unknown request type %c.\n", batch[i].rw);
+                exit(EXIT_FAILURE);
+            }
+            writer.append(batch[i].rw, batch[i].addr);
+        }
+    }
+    writer.close();
+
+    fprintf(stderr, "%s: %llu records, %llu bytes (%.2f bytes/record)\n", out_file,
+            (unsigned long long) writer.record_count, (unsigned long long) writer.bytes_written,
+            (writer.record_count > 0) ? (double) writer.bytes_written / writer.record_count : 0.0);
+    return(0);
+}
+
 
 int main (int argc, char *argv[]) {
-    FILE *fp;			// File pointer.
+    TraceReader trace;		// Maps (or streams) the trace and decodes its records in batches.
     char *trace_file;		// This variable holds the trace file name.
     cache_params_t params;	// Look at the cachesim.h header file for the definition of struct cache_params_t.
-    char rw;			// This variable holds the request's type (read or write) obtained from the trace.
-    uint32_t addr;		// This variable holds the request's address obtained from the trace.
-     			// The header file <inttypes.h> above defines signed and unsigned integers of various sizes in a machine-agnostic way.  "uint32_t" is an unsigned integer of 32 bits.
+    static trace_record batch[TRACE_BATCH_SIZE];	// Requests (type and address) decoded from the trace.
+
+    if (argc > 1 && strcmp(argv[1], "convert") == 0) {
+        if (argc != 4) {
+            cout << "usage: ./sim convert trace.txt trace.cstb" << endl;
+            exit(EXIT_FAILURE);
+        }
+        return convert_trace(argv[2], argv[3]);
+    }
+    if (argc > 1 && strcmp(argv[1], "events") == 0) {
+        bool summary = (argc == 4 && strcmp(argv[3], "--summary") == 0);
+        if (argc != 3 && !summary) {
+            cout << "usage: ./sim events log.cevt [--summary]" << endl;
+            exit(EXIT_FAILURE);
+        }
+        return dump_events(argv[2], summary);
+    }
+    params.l1_pref        = PREF_DEFAULT;
+    params.l2_pref        = PREF_DEFAULT;
+    params.pref_degree    = 4;
+    params.timing_enabled = false;
+    params.timing         = default_timing_params();
+    params.page_map       = default_page_map_params();
+    params.l2_blocksize   = 0;
+    params.l1_sectors     = 1;
+    params.l2_sectors     = 1;
+    params.llc_reuse      = REUSE_NONE;
+    params.llc_reuse_mode = REUSE_INSERT_LOW;
+    params.llc_reuse_compare = false;
+
+    if (argc > 1 && (strcmp(argv[1], "sweep") == 0 || strcmp(argv[1], "--sweep") == 0)) {
+        uint32_t threads = 0;
+        sweep_format_t format = SWEEP_CSV;
+        vector<char*> files;
+        for (int i = 2; i < argc; i++) {
+            const char* eq = strchr(argv[i], '=');
+            if (strncmp(argv[i], "--threads=", 10) == 0) {
+                threads = (uint32_t) atoi(argv[i] + 10);
+            }else if (strcmp(argv[i], "--format=csv") == 0) {
+                format = SWEEP_CSV;
+            }else if (strcmp(argv[i], "--format=json") == 0) {
+                format = SWEEP_JSON;
+            }else if (strncmp(argv[i], "--", 2) == 0) {
+                string name(argv[i] + 2, eq ? eq - argv[i] - 2 : strlen(argv[i] + 2));
+                if (!parse_prefetch_option(name, eq ? eq + 1 : "", params) && !parse_timing_option(name, eq ? eq + 1 : "", params) &&
+                    !parse_page_map_option(name, eq ? eq + 1 : "", params)) {
+                    printf("Error: Unknown option %s.\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
+            }else {
+                files.push_back(argv[i]);
+            }
+        }
+        if (files.size() != 2) {
+            cout << "usage: ./sim sweep configs.txt gcc_trace.txt [--threads=N] [--format=csv|json] [--timing]" << endl;
+            exit(EXIT_FAILURE);
+        }
+        return run_sweep(files[0], files[1], threads, format, params);
+    }
+    if (argc > 1 && strcmp(argv[1], "hierarchy") == 0) {
+        vector<char*> files;
+        for (int i = 2; i < argc; i++) {
+            const char* eq = strchr(argv[i], '=');
+            if (strncmp(argv[i], "--", 2) == 0) {
+                string name(argv[i] + 2, eq ? eq - argv[i] - 2 : strlen(argv[i] + 2));
+                if (!parse_timing_option(name, eq ? eq + 1 : "", params) && !parse_page_map_option(name, eq ? eq + 1 : "", params)) {
+                    printf("Error: Unknown option %s.\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
+            }else {
+                files.push_back(argv[i]);
+            }
+        }
+        if (files.size() != 2) {
+            cout << "usage: ./sim hierarchy server.cfg gcc_trace.txt [--timing] [--page-map=first-touch|random]" << endl;
+            exit(EXIT_FAILURE);
+        }
+        return run_config_hierarchy(files[0], files[1], params.timing_enabled, params.timing, params.page_map);
+    }
+    if (argc > 1 && strcmp(argv[1], "stackdist") == 0) {
+        if (argc != 6) {
+            cout << "usage: ./sim stackdist 32 1024,2048,4096 1,2,4,8 gcc_trace.txt" << endl;
+            exit(EXIT_FAILURE);
+        }
+        return stack_distance_sweep((uint32_t) atoi(argv[2]), argv[3], argv[4], argv[5]);
+    }
+
+    params.l1_repl = REPL_LRU;
+    params.l2_repl = REPL_LRU;
+
+    if (argc > 1 && strcmp(argv[1], "sample") == 0) {
+        sample_params_t sp = default_sample_params();
+        int kept = 1;
+        for (int i = 1; i < argc; i++) {
+            if (strncmp(argv[i], "--period=", 9) == 0) {
+                sp.period = strtoull(argv[i] + 9, NULL, 10);
+            }else if (strncmp(argv[i], "--unit=", 7) == 0) {
+                sp.unit = strtoull(argv[i] + 7, NULL, 10);
+            }else if (strncmp(argv[i], "--warmup=", 9) == 0) {
+                sp.warmup = strtoull(argv[i] + 9, NULL, 10);
+            }else if (strncmp(argv[i], "--sets=", 7) == 0) {
+                sp.sets = (uint32_t) atoi(argv[i] + 7);
+            }else if (strcmp(argv[i], "--fast-forward=warm") == 0 || strcmp(argv[i], "--fast-forward=skip") == 0) {
+                sp.fast_forward = (strcmp(argv[i], "--fast-forward=skip") == 0) ? FAST_FORWARD_SKIP : FAST_FORWARD_WARM;
+            }else if (strcmp(argv[i], "--validate") == 0) {
+                sp.validate = true;
+            }else {
+                argv[kept++] = argv[i];
+            }
+        }
+        argc = kept;
+        parse_options(argc, argv, params);
+        if (argc != 10) {
+            cout << "usage: ./sim sample 32 8192 4 262144 8 3 10 gcc_trace.txt [--period=N] [--unit=N] [--warmup=N] [--sets=K] [--fast-forward=warm|skip] [--validate]" << endl;
+            exit(EXIT_FAILURE);
+        }
+        params.blocksize = (uint32_t) atoi(argv[2]);
+        params.l1_size   = (uint32_t) atoi(argv[3]);
+        params.l1_assoc  = (uint32_t) atoi(argv[4]);
+        params.l2_size   = (uint32_t) atoi(argv[5]);
+        params.l2_assoc  = (uint32_t) atoi(argv[6]);
+        params.pref_n    = (uint32_t) atoi(argv[7]);
+        params.pref_m    = (uint32_t) atoi(argv[8]);
+        if (params.pref_n != 0 && params.pref_m == 0) {
+            printf("Error: PREF_N > 0 needs PREF_M > 0.\n");
+            exit(EXIT_FAILURE);
+        }
+        if ((params.l1_pref == PREF_STREAM || params.l2_pref == PREF_STREAM) && params.pref_n == 0) {
+            printf("Error: Stream buffers need PREF_N > 0 and PREF_M > 0.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (params.page_map.kind != PAGE_MAP_NONE && page_map_params_error(params.page_map, params.blocksize) != NULL) {
+            printf("Error: %s\n", page_map_params_error(params.page_map, params.blocksize));
+            exit(EXIT_FAILURE);
+        }
+        return run_sampled(params, sp, argv[9]);
+    }
+    if (argc > 1 && strcmp(argv[1], "multicore") == 0) {
+        uint32_t private_l2_size = 0, private_l2_assoc = 0;
+        bool by_timing = false, interleave_set = false;
+        int kept = 1;
+        for (int i = 1; i < argc; i++) {
+            if (strncmp(argv[i], "--private-l2=", 13) == 0) {
+                if (sscanf(argv[i] + 13, "%u,%u", &private_l2_size, &private_l2_assoc) != 2) {
+                    printf("Error: Expected --private-l2=SIZE,ASSOC but got %s.\n", argv[i]);
+                    exit(EXIT_FAILURE);
+                }
+            }else if (strcmp(argv[i], "--interleave=rr") == 0 || strcmp(argv[i], "--interleave=timing") == 0) {
+                by_timing      = (strcmp(argv[i], "--interleave=timing") == 0);
+                interleave_set = true;
+            }else {
+                argv[kept++] = argv[i];
+            }
+        }
+        argc = kept;
+        parse_options(argc, argv, params);
+        if (argc < 10) {
+            cout << "usage: ./sim multicore 32 8192 4 1048576 16 3 10 t0.txt t1.txt [...] [--private-l2=SIZE,ASSOC] [--interleave=rr|timing]" << endl;
+            exit(EXIT_FAILURE);
+        }
+        params.blocksize = (uint32_t) atoi(argv[2]);
+        params.l1_size   = (uint32_t) atoi(argv[3]);
+        params.l1_assoc  = (uint32_t) atoi(argv[4]);
+        params.l2_size   = (uint32_t) atoi(argv[5]);
+        params.l2_assoc  = (uint32_t) atoi(argv[6]);
+        params.pref_n    = (uint32_t) atoi(argv[7]);
+        params.pref_m    = (uint32_t) atoi(argv[8]);
+        if (params.pref_n != 0 && params.pref_m == 0) {
+            printf("Error: PREF_N > 0 needs PREF_M > 0.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (params.l2_pref == PREF_STREAM && params.pref_n == 0) {
+            printf("Error: Stream buffers need PREF_N > 0 and PREF_M > 0.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (params.timing_enabled && timing_params_error(params.timing, params.blocksize) != NULL) {
+            printf("Error: %s\n", timing_params_error(params.timing, params.blocksize));
+            exit(EXIT_FAILURE);
+        }
+        if (params.page_map.kind != PAGE_MAP_NONE && page_map_params_error(params.page_map, params.blocksize) != NULL) {
+            printf("Error: %s\n", page_map_params_error(params.page_map, params.blocksize));
+            exit(EXIT_FAILURE);
+        }
+        // With the timing model, cores go in issue order unless told otherwise
+        if (!interleave_set) {
+            by_timing = params.timing_enabled;
+        }
+        return run_multicore(params, vector<char*>(argv + 9, argv + argc), private_l2_size, private_l2_assoc, by_timing);
+    }
+    run_options_t run = parse_run_options(argc, argv);
+    RunProfile* profile = run.profile ? new RunProfile() : NULL;
+    parse_options(argc, argv, params, true);
 
     // Exit with an error if the number of command-line arguments is incorrect.
     if (argc != 9) {
@@ -52,46 +756,146 @@ int main (int argc, char *argv[]) {
     if(params.pref_n != 0){
         assert(params.pref_m != 0);
     }
-
-    g_mem_op_count = 0;
+    if((params.l1_pref == PREF_STREAM || params.l2_pref == PREF_STREAM) && params.pref_n == 0){
+        printf("Error: Stream buffers need PREF_N > 0 and PREF_M > 0.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (line_params_error(params) != NULL) {
+        printf("Error: %s\n", line_params_error(params));
+        exit(EXIT_FAILURE);
+    }
+    if (params.timing_enabled && timing_params_error(params.timing, l2_block_size(params)) != NULL) {
+        printf("Error: %s\n", timing_params_error(params.timing, l2_block_size(params)));
+        exit(EXIT_FAILURE);
+    }
+    if (params.page_map.kind != PAGE_MAP_NONE && page_map_params_error(params.page_map, l2_block_size(params)) != NULL) {
+        printf("Error: %s\n", page_map_params_error(params.page_map, l2_block_size(params)));
+        exit(EXIT_FAILURE);
+    }
 
 // ------------------------------------------------------------------------------
 
-    // Instantiating L1 and L2 cache
-    Cache* l1_cache = new Cache(1, params.l1_size, params.l1_assoc, params.blocksize, params.pref_n, params.pref_m);
-    Cache* l2_cache = new Cache(2, params.l2_size, params.l2_assoc, params.blocksize, params.pref_n, params.pref_m);
-
-    if (params.l2_size > 0){
-        l1_cache->next_lvl_cache = l2_cache;
-    }
+    // Instantiating L1 and L2 cache and main memory
+    Hierarchy hierarchy(params);
+    Cache* l1_cache = hierarchy.l1_cache;
+    Cache* l2_cache = hierarchy.l2_cache;
 
 
 // ------------------------------------------------------------------------------
 
-    // Open the trace file for reading.
-    fp = fopen(trace_file, "r");
-    if (fp == (FILE *) NULL) {
+    // Open the trace file for reading ("-" reads the trace from stdin).
+    if (!trace.open(trace_file)) {
        // Exit with an error if file open failed.
        printf("Error: Unable to open file %s\n", trace_file);
        exit(EXIT_FAILURE);
     }
-     
-
-    uint32_t i = 1;
-    // Read requests from the trace file and echo them back.
-    while (fscanf(fp, "%c %x\n", &rw, &addr) == 2) {	// Stay in the loop if fscanf() successfully parsed two tokens as specified.
-        if (rw == 'r'){
-            //printf("%d=r %x\n", i, addr);
-            l1_cache->read(addr);
-        }else if (rw == 'w'){
-            //printf("%d=w %x\n", i, addr);
-            l1_cache->write(addr);
-        }else {
-            printf("Error: Unknown request type %c.\n", rw);
+
+    // Resume from a checkpoint: the hierarchy's state, and the trace from where it was taken.
+    uint64_t accesses = 0;
+    uint32_t cold[2]  = { 0, 0 };
+    if (run.restore_file) {
+        accesses = hierarchy.restore_checkpoint(run.restore_file, trace, cold);
+        if (run.save_at > 0 && run.save_at <= accesses) {
+            printf("Error: Checkpoint %s is already past access %llu.\n", run.restore_file, (unsigned long long) run.save_at);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // With --llc-reuse-compare, the same run without the reuse predictor
+    // goes along, for the deltas; it starts from the same checkpoint (and
+    // keeps no time)
+    Hierarchy* baseline = NULL;
+    if (params.llc_reuse_compare) {
+        cache_params_t base_params = params;
+        base_params.llc_reuse      = REUSE_NONE;
+        base_params.timing_enabled = false;
+        baseline = new Hierarchy(base_params);
+        if (run.restore_file) {
+            uint32_t base_cold[2];
+            baseline->restore_checkpoint(run.restore_file, trace, base_cold);
+        }
+    }
+
+    EventLog* events = NULL;
+    if (run.events_file) {
+        events = new EventLog();
+        if (!events->open(run.events_file)) {
+            printf("Error: Unable to create file %s\n", run.events_file);
             exit(EXIT_FAILURE);
         }
-        i++;
+        events->now = accesses;
+        hierarchy.trace_events(events);
+    }
+    IntervalStats* intervals = run.interval ? new IntervalStats(run.interval, hierarchy, accesses) : NULL;
+
+    // Feed the requests to L1 a batch at a time. Batches end at the
+    // checkpoint, stop and interval accesses so the counts are exact there.
+    if (profile) profile->mark(PHASE_SETUP);
+    bool partitioned = false;
+    if (run.parallel >= 0) {
+        const char* coupling = (run.save_file || run.restore_file) ? "checkpoints hold the whole hierarchy" :
+                               run.interval ? "intervals sample the counters in trace order" : partition_coupling(hierarchy);
+        if (coupling) {
+            fprintf(stderr, "--parallel: %s; simulating serially.\n", coupling);
+        }else {
+            uint32_t threads = run.parallel ? (uint32_t) run.parallel : max(1u, thread::hardware_concurrency());
+            accesses    = simulate_partitioned(hierarchy, trace, threads, run.stop_at, profile);
+            partitioned = true;
+        }
+    }
+    uint32_t n;
+    while (!partitioned) {
+        uint64_t batch_max = TRACE_BATCH_SIZE;
+        if (run.save_at > accesses) {
+            batch_max = min(batch_max, run.save_at - accesses);
+        }
+        if (intervals) {
+            batch_max = min(batch_max, run.interval - accesses % run.interval);
+        }
+        if (run.stop_at > 0) {
+            batch_max = min(batch_max, (run.stop_at > accesses) ? run.stop_at - accesses : 0);
+        }
+        if (batch_max == 0) {
+            break;
+        }
+        n = trace.next_batch(batch, (uint32_t) batch_max);
+        if (profile) profile->mark(PHASE_PARSE);
+        if (n == 0) {
+            break;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i].rw != 'r' && batch[i].rw != 'w'){
+                printf("Error: Unknown request type %c.\n", batch[i].rw);
+                exit(EXIT_FAILURE);
+            }
+        }
+        hierarchy.access_batch(batch, n);
+        if (baseline) {
+            baseline->access_batch(batch, n);
+        }
+        accesses += n;
+        if (intervals && accesses % run.interval == 0) {
+            intervals->sample(hierarchy, accesses);
+        }
 
+        if (accesses == run.save_at) {
+            hierarchy.save_checkpoint(run.save_file, trace);
+            fprintf(stderr, "%s: checkpoint at access %llu\n", run.save_file, (unsigned long long) accesses);
+        }
+        if (profile) profile->mark(PHASE_SIMULATE);
+    }
+    if (run.save_at > accesses) {
+        printf("Error: %s ends before access %llu; no checkpoint saved.\n", trace_file, (unsigned long long) run.save_at);
+        exit(EXIT_FAILURE);
+    }
+    trace.close();
+    if (intervals && accesses % run.interval != 0) {
+        intervals->sample(hierarchy, accesses); // the last, partial interval
+    }
+    if (events) {
+        events->close();
+        fprintf(stderr, "%s: %llu events, %llu bytes\n", run.events_file, (unsigned long long) events->events,
+                (unsigned long long) events->bytes_written);
     }
 
     // Print simulator configuration.
@@ -103,7 +907,40 @@ int main (int argc, char *argv[]) {
     printf("L2_ASSOC:   %u\n", params.l2_assoc);
     printf("PREF_N:     %u\n", params.pref_n);
     printf("PREF_M:     %u\n", params.pref_m);
+    if (params.l1_repl != REPL_LRU || params.l2_repl != REPL_LRU) {
+        printf("L1_REPL:    %s\n", repl_policy_names[params.l1_repl]);
+        printf("L2_REPL:    %s\n", repl_policy_names[params.l2_repl]);
+    }
+    if (has_line_options(params)) {
+        printf("L2_BLOCK:   %u\n", l2_block_size(params));
+        printf("L1_SECTORS: %u\n", sectors_of(params.l1_sectors));
+        printf("L2_SECTORS: %u\n", sectors_of(params.l2_sectors));
+    }
+    if (params.llc_reuse != REUSE_NONE) {
+        printf("LLC_REUSE:  %s\n", reuse_kind_names[params.llc_reuse]);
+        printf("REUSE_MODE: %s\n", reuse_mode_names[params.llc_reuse_mode]);
+    }
+    if (hierarchy.page_map) {
+        print_page_map(params.page_map, hierarchy.page_map);
+    }
     printf("trace_file: %s\n", trace_file);
+    if (run.restore_file) {
+        printf("RESTORED:   %s\n", run.restore_file);
+        const char* cold_parts[4] = { "replacement", "prefetcher", "victim cache", "reuse predictor" };
+        for (uint32_t lvl = 0; lvl < 2; lvl++) {
+            for (uint32_t b = 0; b < 4; b++) {
+                if (cold[lvl] & (1u << b)) {
+                    printf("COLD:       L%u %s\n", lvl + 1, cold_parts[b]);
+                }
+            }
+        }
+        if (params.timing_enabled) {
+            printf("COLD:       timing model\n");
+        }
+    }
+    if (run.stop_at > 0) {
+        printf("STOP_AT:    %llu\n", (unsigned long long) run.stop_at);
+    }
     printf("\n");
     
     printf("===== L1 contents =====\n");
@@ -117,42 +954,67 @@ int main (int argc, char *argv[]) {
         l2_cache->print_cache();
         printf("\n");
 
-        if(params.pref_n > 0){
+        if(hierarchy.prefetcher_kind(1) == PREF_STREAM){
+            printf("===== L1 Stream Buffer(s) contents =====\n");
+            l1_cache->print_prefetcher();
+            printf("\n");
+        }
+        if(hierarchy.prefetcher_kind(2) == PREF_STREAM){
             printf("===== Stream Buffer(s) contents =====\n");
             l2_cache->print_prefetcher();
             printf("\n");
         }
 
     }else{
-        if(params.pref_n > 0){
+        if(hierarchy.prefetcher_kind(1) == PREF_STREAM){
             printf("===== Stream Buffer(s) contents =====\n");
             l1_cache->print_prefetcher();
             printf("\n");
         }
     }
 
-    printf("===== Measurements =====\n");
-    printf("a. %-30s %u\n", "L1 reads: "                      , l1_cache->read_count);
-    printf("b. %-30s %u\n", "L1 read misses: "                , l1_cache->read_miss_count);
-    printf("c. %-30s %u\n", "L1 writes: "                     , l1_cache->write_count);
-    printf("d. %-30s %u\n", "L1 write misses: "               , l1_cache->write_miss_count);
-    double l1_miss_rate = ( (double)(l1_cache->read_miss_count + l1_cache->write_miss_count) / (double) (l1_cache->read_count + l1_cache->write_count) );
-    printf("e. %-30s %.4f\n", "L1 miss rate: "                , l1_miss_rate);
-    printf("f. %-30s %u\n", "L1 writebacks: "                 , l1_cache->writebacks_to_next_lvl_count);
-    printf("g. %-30s %u\n", "L1 prefetches: "                 , l1_cache->prefetches_to_next_lvl_count);
-
-    printf("h. %-30s %u\n", "L2 reads (demand): "             , l2_cache->read_count);
-    printf("i. %-30s %u\n", "L2 read misses (demand): "       , l2_cache->read_miss_count);
-    printf("j. %-30s %u\n", "L2 reads (prefetch): "           , l2_cache->read_from_prefetch_count);
-    printf("k. %-30s %u\n", "L2 read misses (prefetch): "     , l2_cache->read_miss_from_prefetch_count);
-    printf("l. %-30s %u\n", "L2 writes: "                     , l2_cache->write_count);
-    printf("m. %-30s %u\n", "L2 write misses: "               , l2_cache->write_miss_count);
-    double l2_miss_rate = (params.l2_size > 0) ? ((double)(l2_cache->read_miss_count) / (double) (l2_cache->read_count)) : (double) 0;
-    printf("n. %-30s %.4f\n", "L2 miss rate: "                , l2_miss_rate);
-    printf("o. %-30s %u\n", "L2 writebacks: "                 , l2_cache->writebacks_to_next_lvl_count);
-    printf("p. %-30s %u\n", "L2 prefetches: "                 , l2_cache->prefetches_to_next_lvl_count);
-
-    printf("q. %-30s %u\n", "memory traffic: "              , g_mem_op_count);
+    print_measurements(hierarchy.stats());
+    if (has_line_options(params)) {
+        const char* names[2] = { "L1", "L2" };
+        Cache* levels[2]     = { l1_cache, l2_cache };
+        printf("\n");
+        print_traffic(names, levels, (params.l2_size > 0) ? 2 : 1);
+    }
+    if (params.llc_reuse != REUSE_NONE) {
+        printf("\n");
+        reuse_outcome_t base = baseline ? baseline->llc_outcome() : reuse_outcome_t();
+        print_reuse_stats((params.l2_size > 0) ? "L2" : "L1", hierarchy.last_level()->get_reuse_predictor(),
+                          hierarchy.llc_outcome(), baseline ? &base : NULL);
+    }
+    if (params.l1_pref != PREF_DEFAULT || params.l2_pref != PREF_DEFAULT) {
+        printf("\n");
+        printf("===== Prefetchers =====\n");
+        printf("   %-9s %10s %10s %10s %10s %9s %9s %10s\n", "kind", "issued", "useful", "late", "useless",
+               "coverage", "accuracy", "timeliness");
+        for (uint32_t lvl = 1; lvl <= ((params.l2_size > 0) ? 2 : 1); lvl++) {
+            if (hierarchy.prefetcher_kind(lvl) != PREF_NONE) {
+                print_prefetcher_stats((lvl == 1) ? "L1" : "L2", hierarchy.prefetcher_stats(lvl), params.timing_enabled);
+            }
+        }
+    }
+    if (params.timing_enabled) {
+        printf("\n");
+        print_timing(params.timing, hierarchy.timing_stats());
+    }
+    if (intervals) {
+        printf("\n");
+        intervals->print();
+    }
+    if (profile) {
+        fflush(stdout);
+        profile->mark(PHASE_REPORT);
+        profile->accesses = accesses;
+        profile->print(stderr);
+    }
+    delete baseline;
+    delete intervals;
+    delete events;
+    delete profile;
 
     return(0);
 }
@@ -10,8 +10,19 @@ using namespace std;
 #include <stdint.h>
 #include <cstdlib> //exit() EXIT_FAILURE
 #include <algorithm> //sort
-
-#define ADDR_SIZE 32
+#include <string.h>  //memset memcpy
+#include "addr.h"
+#include "tag_match.h"
+#include "page_map.h"
+#include "replacement.h"
+#include "prefetcher.h"
+#include "timing.h"
+#include "checkpoint.h"
+#include "event_log.h"
+#include "reuse_predictor.h"
+
+// Host cache line size; each tag store array (and each set in it) is aligned to it
+#define HOST_LINE_SIZE 64
 
 typedef struct {
    uint32_t blocksize;
@@ -21,21 +32,117 @@ typedef struct {
    uint32_t l2_assoc;
    uint32_t pref_n;
    uint32_t pref_m;
+   repl_policy_t l1_repl;
+   repl_policy_t l2_repl;
+   prefetcher_kind_t l1_pref;
+   prefetcher_kind_t l2_pref;
+   uint32_t pref_degree;        // blocks per prefetch of the non stream prefetchers
+   bool timing_enabled;         // run the timing model (timing.h) along
+   timing_params_t timing;
+   page_map_params_t page_map;  // VA -> PA translation in front of L1; PAGE_MAP_NONE (zero) is off
+   uint32_t l2_blocksize;       // L2 line size; 0 is blocksize
+   uint32_t l1_sectors;         // sectors per line, each with its own valid and dirty bits; 0 and 1 are unsectored
+   uint32_t l2_sectors;
+   reuse_kind_t llc_reuse;      // reuse predictor of the last level; REUSE_NONE (zero) is off
+   reuse_mode_t llc_reuse_mode;
+   bool llc_reuse_compare;      // also run without the predictor and report the differences
 } cache_params_t;
 
+// Sectors per line are a bit mask in a byte
+#define MAX_SECTORS 8
 
-// global variable to count memory access operations
-uint32_t g_mem_op_count;                // q
+static inline uint32_t l2_block_size(const cache_params_t& p){ return p.l2_blocksize ? p.l2_blocksize : p.blocksize; }
+static inline uint32_t sectors_of(uint32_t sectors){ return sectors ? sectors : 1; }
 
-typedef struct {
-    bool valid_bit;
-    bool dirty_bit;
-    uint32_t lru;
-    uint32_t tag;
-} cache_block;
+// Whether p uses per-level line sizes or sectors (which adds the traffic
+// report to the output)
+static inline bool has_line_options(const cache_params_t& p){
+    return l2_block_size(p) != p.blocksize || sectors_of(p.l1_sectors) > 1 || sectors_of(p.l2_sectors) > 1;
+}
+
+
+// Main memory endpoint behind the last cache level. It counts the block
+// transfers that reach it and hands them to the DRAM timing model, if any;
+// each Hierarchy (hierarchy.h) owns one.
+class MainMemory {
+    public:
+        uint64_t read_count;        // demand reads
+        uint64_t write_count;       // writebacks
+        uint64_t prefetch_count;    // blocks fetched by the prefetcher
+        TimingModel* timing;        // NULL when timing is off
+
+        MainMemory(){
+            this->read_count     = 0;
+            this->write_count    = 0;
+            this->prefetch_count = 0;
+            this->timing         = NULL;
+        }
+
+        void read(addr_t block_addr){
+            this->read_count++;
+            if (this->timing) this->timing->dram_read(block_addr);
+        }
+        void write(addr_t block_addr){
+            this->write_count++;
+            if (this->timing) this->timing->dram_write(block_addr);
+        }
+        // Blocks first_block .. first_block + blocks - 1
+        void prefetch(addr_t first_block, uint32_t blocks){
+            this->prefetch_count += blocks;
+            if (this->timing){
+                for (uint32_t i = 0; i < blocks; i++){
+                    this->timing->dram_prefetch(first_block + i);
+                }
+            }
+        }
+
+        // memory access operations (q)
+        uint64_t op_count(){ return this->read_count + this->write_count + this->prefetch_count; }
+};
+
+// Bits of a block's entry in Cache::state
+#define BLOCK_VALID 0x1
+#define BLOCK_DIRTY 0x2
+#define BLOCK_PREFETCHED 0x4    // brought in by the prefetcher, not used yet
+#define BLOCK_EXCLUSIVE 0x8     // no other core holds it (MESI E/M, multicore.h)
+
+// Who filled each block of a cache shared by several cores, to count the
+// blocks one core's fills evict from another (multicore.h)
+struct fill_owners_t {
+    vector<uint8_t>  core;              // per tag store entry
+    uint32_t         current;           // core whose request is being simulated
+    vector<uint64_t> lost_to_others;    // per core: its blocks evicted by another core's fill
+    vector<uint64_t> evicted_others;    // per core: other cores' blocks its fills evicted
+};
+
+#include "victim_cache.h"
+
+// How a level's contents relate to those of the levels above it
+typedef enum {
+    INCL_NINE = 0,      // non-inclusive non-exclusive: fills on its misses, evicts on its own
+    INCL_INCLUSIVE,     // same, but its victims are also evicted from above (back-invalidation)
+    INCL_EXCLUSIVE,     // holds only blocks evicted from above; a hit moves the block up
+    INCL_NUM_POLICIES
+} inclusion_t;
+
+static const char* const inclusion_names[INCL_NUM_POLICIES] = {
+    "nine", "inclusive", "exclusive"
+};
+
+// Returns INCL_NUM_POLICIES if name isn't a known policy
+static inline inclusion_t parse_inclusion(const char* name){
+    for (int p = 0; p < INCL_NUM_POLICIES; p++){
+        if (strcmp(name, inclusion_names[p]) == 0){
+            return (inclusion_t) p;
+        }
+    }
+    return INCL_NUM_POLICIES;
+}
+
+template <uint32_t BLOCK, uint32_t SETS, uint32_t ASSOC, bool PREF, bool LAST> struct FixedGeometry;
 
 class Cache {
-    private: 
+    protected: 
         uint32_t cache_lvl;
         uint32_t assoc; //associativity; num of ways
 
@@ -45,20 +152,68 @@ class Cache {
         uint32_t index_bits_num;
         uint32_t tag_bits_num;
 
-        vector<vector<cache_block> > blocks;
-
-        vector <uint32_t> prefetch_heads;
-        uint32_t pref_n;
-        uint32_t pref_m;
+        // Tag store, kept as structure-of-arrays in one contiguous allocation.
+        // Way w of set s is at index s * set_stride + w in every array;
+        // set_stride is assoc rounded up to a power of 2 so a set never
+        // straddles more host cache lines than it needs to. Tags are split:
+        // tags holds the low 32 bits, which the SIMD kernels compare
+        // (tag_match.h), and tags_hi the rest, checked on the ways that match.
+        uint32_t set_stride;
+        size_t    tag_store_bytes;
+        void*     tag_store;
+        uint32_t* tags;
+        uint32_t* tags_hi;
+        uint8_t*  state;    // BLOCK_VALID | BLOCK_DIRTY | ...
+        way_t*    valid_count; // valid blocks per set
+
+        // Sectored levels (sectors_num > 1): a block's tag is allocated
+        // whole, but its sectors are fetched, written back and prefetched
+        // one at a time. Bit s of an entry is sector s; BLOCK_VALID then
+        // says the tag is, and BLOCK_DIRTY that some sector is dirty. The
+        // arrays are part of the tag store, and NULL when not sectored.
+        uint32_t  sectors_num;
+        uint32_t  sector_bits_num;  // log2 of the sector size (block_bits_num when not sectored)
+        uint8_t*  sector_valid;
+        uint8_t*  sector_dirty;
+        uint8_t*  sector_prefetched; // brought in by the prefetcher, not used yet
+        uint32_t  request_bytes;    // span of a request from the level above (its sector size; 1 at L1)
+
+        ReplacementPolicy* repl;
+
+        Prefetcher* prefetcher;             // NULL if this level has none
+        vector<addr_t> prefetch_queue;      // blocks it asked for on the current access
+
+        VictimCache* victim;                // NULL if this level has none
+        ReusePredictor* reuse;              // NULL if this level has none
+        bool handed_up_dirty;               // exclusive: the block the last read moved up was dirty
 
         // Initializes the members of the this cache's cache_blocks
         void init_cache_blocks();
 
-        void update_lru(uint32_t op_idx, uint32_t op_lru);
-        void make_space_in_set(uint32_t addr);
-        void place_block_in_set(uint32_t addr, bool set_dirty_bit);
-        bool update_prefetcher(uint32_t block_addr, bool cache_hit);
-        void debug_print_cache_set(uint32_t addr, bool is_before, char c);
+        // Index/tag math and level role, looked up in the members at run
+        // time. FixedCache (fixed_cache.h) instantiates read_impl/write_impl
+        // with a FixedGeometry instead, where all of it is constant.
+        struct RuntimeGeometry;
+        friend struct RuntimeGeometry;
+        template <uint32_t BLOCK, uint32_t SETS, uint32_t ASSOC, bool PREF, bool LAST> friend struct FixedGeometry;
+
+        addr_t tag_at(size_t entry){ return (addr_t) this->tags_hi[entry] << 32 | this->tags[entry]; }
+
+        template <class G> void read_impl(addr_t addr);
+        template <class G> void write_impl(addr_t addr);
+        template <class G> uint32_t find_way(uint32_t op_idx, addr_t op_tag);
+        uint8_t sector_mask(addr_t addr);
+        void sectored_access(addr_t addr, uint8_t kind);
+        void fetch_sectors(addr_t block_addr, uint8_t mask, bool prefetch);
+        void write_back_sectors(addr_t block_addr, uint8_t mask);
+        uint32_t make_space_in_set(uint32_t op_idx);
+        void place_block_in_set(uint32_t op_idx, addr_t op_tag, uint32_t way, bool set_dirty_bit, bool low_priority = false);
+        void evict_block(addr_t block_addr, bool dirty);
+        bool back_invalidate(addr_t addr);
+        void move_up(uint32_t op_idx, uint32_t way);
+        bool prefetcher_access(addr_t block_addr, uint8_t* block_state, uint8_t prefetched_bit = BLOCK_PREFETCHED);
+        void issue_prefetches();
+        void debug_print_cache_set(addr_t addr, bool is_before, char c);
         void debug_print_prefetcher();
 
 
@@ -66,50 +221,166 @@ class Cache {
         void cache_sets_sort();
         void print_cache();
         void print_prefetcher();
+        Prefetcher* get_prefetcher(){ return this->prefetcher; }
+        VictimCache* get_victim_cache(){ return this->victim; }
+        ReusePredictor* get_reuse_predictor(){ return this->reuse; }
+        // Gives the level a reuse predictor, which it then owns; only for
+        // a level with no victim cache that isn't inclusive, exclusive or
+        // sectored (bypassed blocks would break inclusion)
+        void set_reuse_predictor(ReusePredictor* reuse){ this->reuse = reuse; }
+        uint32_t get_assoc(){ return this->assoc; }
+        uint32_t get_block_size(){ return this->block_size; }
+        uint32_t get_sector_size(){ return 1u << this->sector_bits_num; }
+        uint32_t get_sectors_num(){ return this->sectors_num; }
+
+        // Coherence (multicore.h): the state bits of the block holding
+        // addr, or NULL if it isn't here
+        uint8_t* block_state(addr_t addr);
+        // Drops the block holding addr without writing it back; returns
+        // its state bits (0 if it wasn't here)
+        uint8_t invalidate(addr_t addr);
+
+        // Checkpoints (checkpoint.h). load() needs the geometry save() ran
+        // with; a replacement policy, prefetcher, victim cache or reuse
+        // predictor unlike the saved one starts cold instead, and the
+        // returned CKPT_COLD_* bits say which.
+        void save(CheckpointWriter& w);
+        uint32_t load(CheckpointReader& r);
+
+        // Set-partitioned runs (partition.h): take over set from src, a
+        // cache of the same geometry and replacement policy, or add its
+        // counters to this one's
+        void copy_set(const Cache* src, uint32_t set);
+        void add_counters(const Cache* src);
+        uint32_t get_sets_num(){ return this->sets_num; }
 
         // TODO: move these counters in private and have public getters for them
-        uint32_t read_count;                    // a, h
-        uint32_t read_miss_count;               // b, i (not including read cache miss that hit in prefetcher)
-        uint32_t write_count;                   // c, l (same as f for L2) 
-        uint32_t write_miss_count;              // d, m (not including read cache miss that hit in prefetcher)
-        uint32_t writebacks_to_next_lvl_count;  // f, o (to memory for L2 for this sim) 
-        uint32_t prefetches_to_next_lvl_count; // g, p 
-        uint32_t read_from_prefetch_count;      // j
-        uint32_t read_miss_from_prefetch_count; // k
+        uint64_t read_count;                    // a, h
+        uint64_t read_miss_count;               // b, i (not including read cache miss that hit in prefetcher)
+        uint64_t write_count;                   // c, l (same as f for L2) 
+        uint64_t write_miss_count;              // d, m (not including read cache miss that hit in prefetcher)
+        uint64_t writebacks_to_next_lvl_count;  // f, o (to memory for L2 for this sim) 
+        uint64_t prefetches_to_next_lvl_count; // g, p 
+        uint64_t read_from_prefetch_count;      // j
+        uint64_t read_miss_from_prefetch_count; // k
+        uint64_t back_invalidations;            // copies above evicted along with an inclusive level's victims
+        // Bytes moved to and from the next level (or memory): demand
+        // fills, prefetches (into this level or its stream buffers) and
+        // writebacks
+        uint64_t fill_bytes;
+        uint64_t prefetch_bytes;
+        uint64_t writeback_bytes;
 
         Cache* next_lvl_cache;
+        MainMemory* memory;     // where the last level reads and writes back
+        TimingModel* timing;    // NULL when timing is off
+        EventLog* events;       // NULL unless events are traced (event_log.h)
+        fill_owners_t* owners;  // NULL unless shared by several cores
+        inclusion_t inclusion;              // with respect to upper_caches
+        vector<Cache*> upper_caches;        // the levels right above (for back-invalidation)
+
+        // Constructor; the cache owns prefetcher and victim. sectors > 1
+        // makes it sectored (a power of 2, at most MAX_SECTORS; no victim
+        // cache, not exclusive).
+        Cache(uint32_t cache_lvl, uint32_t lvl_size, uint32_t lvl_assoc, uint32_t block_size,
+              repl_policy_t repl_policy = REPL_LRU, Prefetcher* prefetcher = NULL,
+              inclusion_t inclusion = INCL_NINE, VictimCache* victim = NULL, uint32_t sectors = 1);
+        virtual ~Cache();
+
+        virtual void read(addr_t addr);
+        virtual void write(addr_t addr);
+        // Read from an upper level's prefetcher (j, k)
+        void prefetch_read(addr_t addr);
+        // An upper level evicted the block holding addr into this exclusive level
+        void insert_victim(addr_t addr, bool dirty);
+        // Functional warming (sampling.h): a read or write of addr that only
+        // updates tag stores and replacement state, down to memory
+        void warm(addr_t addr, bool write);
+        // The level above (which asks for its sector size at a time) is upper
+        void link_upper(Cache* upper){ this->request_bytes = max(this->request_bytes, upper->get_sector_size()); }
+};
 
-        // Constructor
-        Cache(uint32_t cache_lvl, uint32_t lvl_size, uint32_t lvl_assoc, uint32_t block_size, uint32_t pref_n, uint32_t pref_m);
-        // TODO destructor 
-        //~Cache ();
+// Parts of a level Cache::load() couldn't restore
+#define CKPT_COLD_REPL       0x1
+#define CKPT_COLD_PREFETCHER 0x2
+#define CKPT_COLD_VICTIM     0x4
+#define CKPT_COLD_REUSE      0x8
+
+// With a page map, cache's prefetcher stops at the physical page
+// boundaries (see Prefetcher::page_block_bits)
+static inline void limit_prefetcher_to_pages(Cache* cache, PageMapper* page_map){
+    Prefetcher* pf = cache->get_prefetcher();
+    if (pf != NULL && page_map != NULL){
+        pf->page_block_bits = page_map->get_page_bits() - (uint32_t) log2(cache->get_sector_size());
+    }
+}
 
-        void read(uint32_t addr);
-        void write(uint32_t addr);
+struct Cache::RuntimeGeometry {
+    static inline addr_t block_addr(const Cache* c, addr_t addr){ return addr >> c->block_bits_num; }
+    static inline uint32_t index(const Cache* c, addr_t block_addr){ return block_addr % c->sets_num; }
+    static inline addr_t tag(const Cache* c, addr_t block_addr){ return block_addr >> c->index_bits_num; }
+    static inline uint32_t assoc(const Cache* c){ return c->assoc; }
+    static inline size_t set_base(const Cache* c, uint32_t op_idx){ return (size_t) op_idx * c->set_stride; }
+    static inline bool has_prefetcher(const Cache* c){ return c->prefetcher != NULL; }
+    static inline bool is_last(const Cache* c){ return c->next_lvl_cache == NULL; }
+    static inline bool is_exclusive(const Cache* c){ return c->inclusion == INCL_EXCLUSIVE; }
+    static inline bool is_sectored(const Cache* c){ return c->sector_valid != NULL; }
 };
 
+static inline size_t round_up(size_t v, size_t align){
+    return (v + align - 1) / align * align;
+}
+
 // Helper function used only during contructor initialization 
 void Cache::init_cache_blocks(){
 
-    for (uint32_t i = 0; i < this->sets_num; i++){
-        vector<cache_block> set_of_blocks;
+    this->set_stride = 1;
+    while (this->set_stride < this->assoc){
+        this->set_stride <<= 1;
+    }
 
-        for (uint32_t j = 0; j < this->assoc; j++){
-            cache_block block;
+    if (this->assoc > MAX_ASSOC){
+        printf("Error: L%d associativity %u exceeds %u.\n", this->cache_lvl, this->assoc, MAX_ASSOC);
+        exit(EXIT_FAILURE);
+    }
 
-            block.valid_bit = 0;
-            block.lru = j;
-            //tag and dirty_bit can be garbage initially. 
+    size_t entries     = (size_t) this->sets_num * this->set_stride;
+    size_t tags_bytes  = round_up(entries * sizeof(uint32_t), HOST_LINE_SIZE);
+    size_t state_bytes = round_up(entries * sizeof(uint8_t), HOST_LINE_SIZE);
+    size_t count_bytes = round_up(this->sets_num * sizeof(way_t), HOST_LINE_SIZE);
+    size_t sector_bytes = (this->sectors_num > 1) ? 3 * state_bytes : 0;
 
-            set_of_blocks.push_back(block);
-        }
-        this->blocks.push_back(set_of_blocks);
+    this->tag_store_bytes = 2 * tags_bytes + state_bytes + count_bytes + sector_bytes;
+    if (posix_memalign(&this->tag_store, HOST_LINE_SIZE, this->tag_store_bytes) != 0){
+        printf("Error: Unable to allocate L%d tag store.\n", this->cache_lvl);
+        exit(EXIT_FAILURE);
+    }
+    this->tags        = (uint32_t*) this->tag_store;
+    this->tags_hi     = (uint32_t*) ((char*) this->tag_store + tags_bytes);
+    this->state       = (uint8_t*) ((char*) this->tag_store + 2 * tags_bytes);
+    this->valid_count = (way_t*) ((char*) this->tag_store + 2 * tags_bytes + state_bytes);
+    if (this->sectors_num > 1){
+        this->sector_valid      = (uint8_t*) this->valid_count + count_bytes;
+        this->sector_dirty      = this->sector_valid + state_bytes;
+        this->sector_prefetched = this->sector_dirty + state_bytes;
     }
+
+    //tags can be garbage initially. 
+    memset(this->tags, 0, 2 * tags_bytes);
+    memset(this->state, 0, state_bytes);
+    memset(this->valid_count, 0, count_bytes + sector_bytes);
 }
 
 // Constructor 
-Cache::Cache(uint32_t cache_lvl, uint32_t lvl_size, uint32_t lvl_assoc, uint32_t block_size, uint32_t pref_n, uint32_t pref_m){
+Cache::Cache(uint32_t cache_lvl, uint32_t lvl_size, uint32_t lvl_assoc, uint32_t block_size,
+             repl_policy_t repl_policy, Prefetcher* prefetcher, inclusion_t inclusion, VictimCache* victim,
+             uint32_t sectors){
     this->cache_lvl = cache_lvl;
+    this->next_lvl_cache = NULL;
+    this->memory         = NULL;
+    this->timing         = NULL;
+    this->events         = NULL;
+    this->owners         = NULL;
     this->read_count                    = 0;   
     this->read_miss_count               = 0;  
     this->write_count                   = 0;
@@ -118,6 +389,28 @@ Cache::Cache(uint32_t cache_lvl, uint32_t lvl_size, uint32_t lvl_assoc, uint32_t
     this->prefetches_to_next_lvl_count  = 0; 
     this->read_from_prefetch_count      = 0; 
     this->read_miss_from_prefetch_count = 0; 
+    this->back_invalidations            = 0;
+    this->fill_bytes                    = 0;
+    this->prefetch_bytes                = 0;
+    this->writeback_bytes               = 0;
+
+    this->tag_store = NULL;
+    this->tag_store_bytes = 0;
+    this->tags      = NULL;
+    this->tags_hi   = NULL;
+    this->state     = NULL;
+    this->sector_valid      = NULL;
+    this->sector_dirty      = NULL;
+    this->sector_prefetched = NULL;
+    this->sectors_num       = 1;
+    this->sector_bits_num   = 0;
+    this->request_bytes     = 1;
+    this->repl      = NULL;
+    this->prefetcher = prefetcher;
+    this->victim     = victim;
+    this->reuse      = NULL;
+    this->inclusion  = inclusion;
+    this->handed_up_dirty = false;
 
     if (lvl_size == 0){ // that lvl is disabled
         return;
@@ -133,75 +426,101 @@ Cache::Cache(uint32_t cache_lvl, uint32_t lvl_size, uint32_t lvl_assoc, uint32_t
 
     this->tag_bits_num   = ADDR_SIZE - (this->index_bits_num + this->block_bits_num);
 
-    this->next_lvl_cache = NULL;
+    if (sectors == 0 || (sectors & (sectors - 1)) || sectors > MAX_SECTORS || sectors > this->block_size){
+        printf("Error: L%d sectors per line must be a power of 2 up to %u and the block size.\n", this->cache_lvl, MAX_SECTORS);
+        exit(EXIT_FAILURE);
+    }
+    if (sectors > 1 && (victim != NULL || inclusion == INCL_EXCLUSIVE)){
+        printf("Error: L%d is sectored; it can't have a victim cache or be exclusive.\n", this->cache_lvl);
+        exit(EXIT_FAILURE);
+    }
+    this->sectors_num     = sectors;
+    this->sector_bits_num = this->block_bits_num - log2(sectors);
 
     this->init_cache_blocks();
-
-    this->pref_n = pref_n;
-    this->pref_m = pref_m;
-    if (this->pref_n > 0){ // prefetch is enabled
-        // Initially set to 0 (invalid). Using the order of the heads to denote LRU (0->N = MRU->LRU).
-        //
-        // Each head represents a set of M blocks; since they are consecutive (distance = 1) then I can
-        // use the offset M to "cover" and check for all M blocks from consecutive the head of prefetcher
-        for(uint32_t i=0; i<pref_n; i++){
-            this->prefetch_heads.push_back(0);
-        }
-    }
+    this->repl = make_replacement_policy(repl_policy, this->sets_num, this->assoc);
 }
 
-bool cache_comp(cache_block l, cache_block r){
-    return (l.lru < r.lru);
+Cache::~Cache(){
+    free(this->tag_store);
+    delete this->repl;
+    delete this->prefetcher;
+    delete this->victim;
+    delete this->reuse;
 }
+
+// Orders the ways of every set from MRU to LRU (for printing); for other
+// replacement policies, from most to least protected
 void Cache::cache_sets_sort(){
+    vector<uint32_t> order(this->assoc);
+    vector<uint32_t> tmp_tags(this->assoc);
+    vector<uint32_t> tmp_tags_hi(this->assoc);
+    vector<uint8_t>  tmp_state(this->assoc);
+    vector<uint8_t>  tmp_sectors(3 * this->assoc);
+
     for(uint32_t i = 0; i < this->sets_num; i++){
-        sort(this->blocks[i].begin(), this->blocks[i].end(), cache_comp);
+        size_t base = (size_t) i * this->set_stride;
+
+        this->repl->order(i, order.data());
+        for(uint32_t j = 0; j < this->assoc; j++){
+            tmp_tags[j]    = this->tags[base + order[j]];
+            tmp_tags_hi[j] = this->tags_hi[base + order[j]];
+            tmp_state[j]   = this->state[base + order[j]];
+        }
+        memcpy(&this->tags[base],    tmp_tags.data(),    this->assoc * sizeof(uint32_t));
+        memcpy(&this->tags_hi[base], tmp_tags_hi.data(), this->assoc * sizeof(uint32_t));
+        memcpy(&this->state[base], tmp_state.data(), this->assoc * sizeof(uint8_t));
+        if (this->sector_valid){
+            for(uint32_t j = 0; j < this->assoc; j++){
+                tmp_sectors[j]                   = this->sector_valid[base + order[j]];
+                tmp_sectors[this->assoc + j]     = this->sector_dirty[base + order[j]];
+                tmp_sectors[2 * this->assoc + j] = this->sector_prefetched[base + order[j]];
+            }
+            memcpy(&this->sector_valid[base],      &tmp_sectors[0],               this->assoc);
+            memcpy(&this->sector_dirty[base],      &tmp_sectors[this->assoc],     this->assoc);
+            memcpy(&this->sector_prefetched[base], &tmp_sectors[2 * this->assoc], this->assoc);
+        }
+        this->repl->permute(i, order.data());
     }
 }
 
-void Cache::debug_print_cache_set(uint32_t addr, bool is_before, char c){
-    uint32_t block_addr = addr >> this->block_bits_num;
-    uint32_t op_idx     = block_addr % this->sets_num;
-    uint32_t op_tag     = block_addr >> this->index_bits_num;
+void Cache::debug_print_cache_set(addr_t addr, bool is_before, char c){
+    addr_t block_addr = addr >> this->block_bits_num;
+    uint32_t op_idx   = block_addr % this->sets_num;
+    addr_t op_tag     = block_addr >> this->index_bits_num;
 
     const char * tab = (this->cache_lvl > 1) ? "\t\t" : "\t";
     if(is_before){
-        printf("%sL%d: %c %x (tag=%x index=%d)\n", tab, this->cache_lvl, c, addr, op_tag, op_idx);
+        printf("%sL%d: %c %llx (tag=%llx index=%d)\n", tab, this->cache_lvl, c, (unsigned long long) addr,
+               (unsigned long long) op_tag, op_idx);
         printf("%sL%d: before: set %7d: ", tab, this->cache_lvl, op_idx);
     }else{
         printf("%sL%d:  after: set %7d: ", tab, this->cache_lvl, op_idx);
     }
+    size_t base = (size_t) op_idx * this->set_stride;
     for(uint32_t i=0; i<this->assoc; i++){
-        if (this->blocks[op_idx][i].valid_bit){ 
-            if(this->blocks[op_idx][i].dirty_bit){
-                printf("%8x D", this->blocks[op_idx][i].tag);
+        if (this->state[base + i] & BLOCK_VALID){ 
+            if(this->state[base + i] & BLOCK_DIRTY){
+                printf("%8llx D", (unsigned long long) this->tag_at(base + i));
             }else{
-                printf("%8x", this->blocks[op_idx][i].tag);
+                printf("%8llx", (unsigned long long) this->tag_at(base + i));
             }
         }
     }
     printf("\n");
 }
 void Cache::debug_print_prefetcher(){
-    const char * tab = "\t\t\t";
-    for(uint32_t i =0; i<this->prefetch_heads.size(); i++){
-        if(prefetch_heads[i]){
-            printf("%sSB:", tab);
-            for(uint32_t j=0; j<this->pref_m; j++){
-                printf("%9x", this->prefetch_heads[i]+j);
-            }
-            printf("\n");
-        }
-    }
+    printf("\t\t\tL%d prefetcher:\n", this->cache_lvl);
+    this->prefetcher->print();
 }
 
 void Cache::print_cache(){
     for(uint32_t i = 0; i < this->sets_num; i++){
         printf("set%7d:", i);
+        size_t base = (size_t) i * this->set_stride;
         for(uint32_t j=0; j<this->assoc; j++){
-            if(this->blocks[i][j].valid_bit){
-                //printf("%9x.%d %s", this->blocks[i][j].tag, this->blocks[i][j].lru, ((this->blocks[i][j].dirty_bit) ? "D":" "));
-                printf("%9x %s", this->blocks[i][j].tag, ((this->blocks[i][j].dirty_bit) ? "D":" "));
+            if(this->state[base + j] & BLOCK_VALID){
+                printf("%9llx %s", (unsigned long long) this->tag_at(base + j), ((this->state[base + j] & BLOCK_DIRTY) ? "D":" "));
             }else{
                 printf("%9s", "");
             }
@@ -210,191 +529,818 @@ void Cache::print_cache(){
     }
 }
 
-// Should only be called if at last lvl and the pref is enabled
+// Should only be called if the pref is enabled at this lvl
 void Cache::print_prefetcher(){
-    assert(this->pref_n > 0 && this->next_lvl_cache == NULL);
+    assert(this->prefetcher != NULL);
+    this->prefetcher->print();
+}
 
-    for(uint32_t i =0; i<this->prefetch_heads.size(); i++){
-        if(this->prefetch_heads[i]){
-            for(uint32_t j=0; j<this->pref_m; j++){
-                printf("%9x", this->prefetch_heads[i]+j);
+// Shows the prefetcher a demand access. block_state is the block's entry on a
+// hit and NULL on a miss. Returns true if the prefetcher's own buffer
+// supplies the missing block (a stream buffer hit), so there's nothing to
+// read from the next level. Sectored levels pass a sector address, their
+// sector_prefetched entry and the sector's bit instead.
+bool Cache::prefetcher_access(addr_t block_addr, uint8_t* block_state, uint8_t prefetched_bit){
+    bool hit        = (block_state != NULL);
+    bool prefetched = hit && (*block_state & prefetched_bit);
+
+    if (prefetched){ // first use of a prefetched block
+        *block_state &= ~prefetched_bit;
+        this->prefetcher->useful++;
+        if (this->events) this->events->record(EV_PREFETCH_USE, this->cache_lvl, block_addr);
+        if (this->timing && this->timing->prefetch_hit(block_addr)){
+            this->prefetcher->late++;
+        }
+    }
+    bool buffered = this->prefetcher->on_access(block_addr, hit, prefetched, this->prefetch_queue);
+    this->prefetcher->clip_to_page(block_addr, this->prefetch_queue);
+    if (buffered && !hit){
+        this->prefetcher->useful++;
+        if (this->events) this->events->record(EV_PREFETCH_USE, this->cache_lvl, block_addr);
+        // a demand miss waits for the block if it's still on its way
+        if (this->timing && this->timing->prefetch_hit(block_addr)){
+            this->prefetcher->late++;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Fetches the blocks the prefetcher asked for from the next level (or
+// memory): into this cache, marked BLOCK_PREFETCHED, or into the
+// prefetcher's own buffer. Blocks already cached (or in the victim cache)
+// are skipped, and so are blocks past either end of the address space
+// (a negative stride or delta run below block 0 wraps around). The
+// prefetcher of a sectored level works on sectors: it asks for sector
+// addresses, and a sector of a block already here goes into that block.
+void Cache::issue_prefetches(){
+    bool fill = this->prefetcher->fills_cache();
+
+    for (uint32_t q = 0; q < this->prefetch_queue.size(); q++){
+        addr_t unit       = this->prefetch_queue[q];
+        addr_t block_addr = unit >> (this->block_bits_num - this->sector_bits_num);
+        uint32_t op_idx   = block_addr % this->sets_num;
+        addr_t op_tag     = block_addr >> this->index_bits_num;
+        uint8_t sector    = this->sector_valid ? 1u << (unit & (this->sectors_num - 1)) : 0;
+
+        if (unit >> (ADDR_SIZE - this->sector_bits_num)){
+            continue;
+        }
+        uint32_t way = this->assoc;
+        if (fill){
+            way = this->find_way<RuntimeGeometry>(op_idx, op_tag);
+            bool cached = (way < this->assoc) &&
+                          (!this->sector_valid || (this->sector_valid[(size_t) op_idx * this->set_stride + way] & sector));
+            if (cached || (this->victim != NULL && this->victim->contains(block_addr))){
+                continue;
             }
-            printf("\n");
         }
+        this->prefetcher->issued++;
+        this->prefetches_to_next_lvl_count++;
+        this->prefetch_bytes += 1u << this->sector_bits_num;
+        if (this->events) this->events->record(EV_PREFETCH_ISSUE, this->cache_lvl, unit);
+
+        if (this->timing) this->timing->begin_prefetch(this->cache_lvl);
+        bool present = (way < this->assoc); // a sectored block without the sector
+        if (fill && !present){
+            way = this->make_space_in_set(op_idx);
+        }
+        if (this->next_lvl_cache == NULL){
+            this->memory->prefetch(unit, 1);
+        }else{
+            this->next_lvl_cache->prefetch_read(unit << this->sector_bits_num);
+        }
+        if (fill){
+            size_t entry = (size_t) op_idx * this->set_stride + way;
+            if (!present){
+                this->place_block_in_set(op_idx, op_tag, way, 0);
+            }
+            if (this->sector_valid){
+                this->sector_valid[entry]      |= sector;
+                this->sector_prefetched[entry] |= sector;
+            }else{
+                this->state[entry] |= BLOCK_PREFETCHED;
+            }
+        }
+        if (this->timing) this->timing->end_prefetch(unit);
     }
+    this->prefetch_queue.clear();
 }
 
-// Checks if block is in any of the stream buffers. 
-// Also updates prefether LRU according prefetcher hits
-// Note: Should only be called when prefetcher at a cache lvl is enabled
-bool Cache::update_prefetcher(uint32_t block_addr, bool cache_hit){
+void Cache::prefetch_read(addr_t addr){
+    if (this->sector_valid){
+        this->sectored_access(addr, EV_FLAG_PREFETCH);
+        return;
+    }
+    this->read_from_prefetch_count++;
+    if (this->timing) this->timing->lookup(this->cache_lvl);
+
+    addr_t block_addr = addr >> this->block_bits_num;
+    uint32_t op_idx   = block_addr % this->sets_num;
+    addr_t op_tag     = block_addr >> this->index_bits_num;
+
+    uint32_t i = this->find_way<RuntimeGeometry>(op_idx, op_tag);
+    if (i < this->assoc){
+        if (this->timing) this->timing->hit(this->cache_lvl, block_addr);
+        if (this->events) this->events->record(EV_HIT, this->cache_lvl, block_addr, EV_FLAG_PREFETCH);
+        this->repl->on_hit(op_idx, i);
+        if (this->inclusion == INCL_EXCLUSIVE){
+            // the block moves up clean; its data goes down if it's dirty
+            this->move_up(op_idx, i);
+            if (this->handed_up_dirty){
+                this->evict_block(block_addr, true);
+            }
+        }
+        return;
+    }
 
-    // In this simulation, only last level cache has a prefetcher unit 
-    assert(this->next_lvl_cache == NULL);
+    this->read_miss_from_prefetch_count++;
+    if (this->events) this->events->record(EV_MISS, this->cache_lvl, block_addr, EV_FLAG_PREFETCH);
+    uint32_t way = (this->inclusion == INCL_EXCLUSIVE) ? 0 : this->make_space_in_set(op_idx);
+    this->prefetch_bytes += this->block_size;
+    if (this->next_lvl_cache == NULL){
+        this->memory->prefetch(block_addr, 1);
+    }else{
+        this->next_lvl_cache->prefetch_read(addr);
+    }
+    if (this->inclusion != INCL_EXCLUSIVE){
+        this->place_block_in_set(op_idx, op_tag, way, 0);
+    }
+}
 
-    // Check each stream heads in multiple stream buffers
-    for(uint32_t i = 0; i < this->prefetch_heads.size(); i++){  
-                                                // MRU -> LRU = prefetch_heads[0] <- prefetch_heads[pref_n-1]
 
-        // Each head "contains" a set of M blocks; since they are consecutive (distance = 1) then I can
-        // use the offset M to "cover" and check for all M blocks from consecutive the head of prefetcher
-        if(this->prefetch_heads[i] <= block_addr && block_addr < this->prefetch_heads[i] + this->pref_m){     // prefetch hit
-            // Update LRU of prefetcher unit
+// Returns the way of set op_idx holding a valid block with op_tag, or assoc on a miss.
+// Tags are compared TAG_MATCH_CHUNK ways at a time by the SIMD kernel (see tag_match.h);
+// the lowest valid matching way wins, as in a scalar sweep. Only the low 32
+// bits go through the kernel; a match then needs the upper bits to agree.
+template <class G>
+uint32_t Cache::find_way(uint32_t op_idx, addr_t op_tag){
+    size_t base     = G::set_base(this, op_idx);
+    uint32_t tag_hi = (uint32_t) (op_tag >> 32);
+
+    for (uint32_t c = 0; c < G::assoc(this); c += TAG_MATCH_CHUNK){
+        uint32_t n = min(G::assoc(this) - c, (uint32_t) TAG_MATCH_CHUNK);
+        uint64_t mask = g_tag_match(&this->tags[base + c], n, (uint32_t) op_tag);
+        while (mask){
+            uint32_t way = c + __builtin_ctzll(mask);
+            if ((this->state[base + way] & BLOCK_VALID) && this->tags_hi[base + way] == tag_hi){
+                return way;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return G::assoc(this);
+}
 
-            //scenario 4 and 2
-            this->prefetches_to_next_lvl_count += (block_addr - this->prefetch_heads[i] + 1);
-            g_mem_op_count += (block_addr - this->prefetch_heads[i] + 1);
+// Sectored levels: the sectors of its block a request for addr from the
+// level above covers (one, unless the level above has larger sectors)
+uint8_t Cache::sector_mask(addr_t addr){
+    uint32_t first = (uint32_t) ((addr & (this->block_size - 1) & ~(addr_t) (this->request_bytes - 1)) >> this->sector_bits_num);
+    uint32_t count = max(1u, this->request_bytes >> this->sector_bits_num);
+    return (uint8_t) (((1u << count) - 1) << first);
+}
 
-            this->prefetch_heads.erase(this->prefetch_heads.begin() + i);
-            this->prefetch_heads.insert(this->prefetch_heads.begin(), block_addr + 1);// Update value of head of MRU stream buffer
-                                                             
-            assert(this->prefetch_heads.size() == this->pref_n);
+// A read, write or prefetch read (kind 0, EV_FLAG_WRITE or
+// EV_FLAG_PREFETCH) on a sectored level. Finding the block without every
+// sector the request covers is a miss too: the missing sectors are
+// fetched into the block where it is, and only those. Misses that find no
+// block make space for it as usual, and fetch only the sectors asked for.
+void Cache::sectored_access(addr_t addr, uint8_t kind){
+    bool write    = (kind & EV_FLAG_WRITE) != 0;
+    bool prefetch = (kind & EV_FLAG_PREFETCH) != 0;
+    (write ? this->write_count : prefetch ? this->read_from_prefetch_count : this->read_count)++;
+    if (this->timing) this->timing->lookup(this->cache_lvl);
+
+    addr_t block_addr = addr >> this->block_bits_num;
+    uint32_t op_idx   = block_addr % this->sets_num;
+    addr_t op_tag     = block_addr >> this->index_bits_num;
+    uint8_t need      = this->sector_mask(addr);
+    // what the prefetcher sees: the first sector asked for
+    addr_t unit       = (block_addr << (this->block_bits_num - this->sector_bits_num)) + __builtin_ctz(need);
+
+    uint32_t i      = this->find_way<RuntimeGeometry>(op_idx, op_tag);
+    bool present    = (i < this->assoc);
+    size_t entry    = (size_t) op_idx * this->set_stride + i;
+    uint8_t missing = present ? (need & ~this->sector_valid[entry]) : need;
+    bool demand_pf  = (this->prefetcher != NULL) && !prefetch;
+
+    if (missing == 0){ // hit
+        if (this->timing) this->timing->hit(this->cache_lvl, block_addr);
+        if (this->events) this->events->record(EV_HIT, this->cache_lvl, block_addr, kind);
+        if (demand_pf){
+            this->prefetcher_access(unit, &this->sector_prefetched[entry], need);
+        }
+        if (write){
+            this->sector_dirty[entry] |= need;
+            this->state[entry]        |= BLOCK_DIRTY;
+        }
+        this->repl->on_hit(op_idx, i);
+        if (demand_pf){
+            this->issue_prefetches();
+        }
+        return;
+    }
 
-            return 1;
+    uint64_t& misses = write ? this->write_miss_count : prefetch ? this->read_miss_from_prefetch_count : this->read_miss_count;
+    misses++;
+    if (this->timing && !prefetch) this->timing->miss(this->cache_lvl, block_addr);
+    if (!present){
+        i     = this->make_space_in_set(op_idx);
+        entry = (size_t) op_idx * this->set_stride + i;
+    }
+    if (demand_pf && this->prefetcher_access(unit, NULL)){
+        missing &= ~(1u << (unit & (this->sectors_num - 1))); // supplied by a stream buffer
+        if (missing == 0){
+            misses--;
         }
     }
+    if (missing != 0){
+        if (this->events) this->events->record(EV_MISS, this->cache_lvl, block_addr, kind);
+        this->fetch_sectors(block_addr, missing, prefetch);
+    }
+
+    if (present){
+        this->repl->on_hit(op_idx, i);
+    }else{
+        this->place_block_in_set(op_idx, op_tag, i, 0);
+    }
+    this->sector_valid[entry] |= need;
+    if (write){
+        this->sector_dirty[entry] |= need;
+        this->state[entry]        |= BLOCK_DIRTY;
+    }
+    if (demand_pf){
+        this->issue_prefetches();
+    }
+}
 
-    // If here, the block_addr is not in any of the stream buffers
-    if (cache_hit){ // scenario 3
-        // do nothing
+// Sectored levels: reads the sectors in mask of block block_addr from the
+// next level (or memory), one request per sector
+void Cache::fetch_sectors(addr_t block_addr, uint8_t mask, bool prefetch){
+    addr_t first = block_addr << (this->block_bits_num - this->sector_bits_num);
+    for (uint32_t s = 0; s < this->sectors_num; s++){
+        if (!(mask & (1u << s))){
+            continue;
+        }
+        (prefetch ? this->prefetch_bytes : this->fill_bytes) += 1u << this->sector_bits_num;
+        if (this->next_lvl_cache == NULL){
+            if (prefetch){
+                this->memory->prefetch(first + s, 1);
+            }else{
+                this->memory->read(first + s);
+            }
+        }else if (prefetch){
+            this->next_lvl_cache->prefetch_read((first + s) << this->sector_bits_num);
+        }else{
+            this->next_lvl_cache->read((first + s) << this->sector_bits_num);
+        }
+    }
+}
 
-    }else{ // scenario 1
-        // In last cache lvl before mem; we can assume hit in mem for r/w
-        // In this sumulation, only last level has prefetcher so no need to do a read on the next lvl cache
-        // so we directly 'get' it from memory. Otherwise, we could issue a read to next lvl cache with a flag 
-        // saying that it's coming from the prefetcher. Then in that instance of read increment read_from_prefetch_count. 
-        // If that read missed, increment read_miss_from_prefetch_count. 
-        this->prefetches_to_next_lvl_count += this->pref_m;
-        g_mem_op_count += this->pref_m;
+// Sectored levels: writes the sectors in mask of block block_addr, which
+// is leaving this level, back to the next level (or memory). Each sector
+// counts as a writeback (f, o).
+void Cache::write_back_sectors(addr_t block_addr, uint8_t mask){
+    if (mask == 0){
+        return;
+    }
+    if (this->events) this->events->record(EV_WRITEBACK, this->cache_lvl, block_addr);
+    addr_t first = block_addr << (this->block_bits_num - this->sector_bits_num);
+    if (this->timing) this->timing->background++;
+    for (uint32_t s = 0; s < this->sectors_num; s++){
+        if (!(mask & (1u << s))){
+            continue;
+        }
+        this->writebacks_to_next_lvl_count++;
+        this->writeback_bytes += 1u << this->sector_bits_num;
+        if (this->next_lvl_cache == NULL){
+            this->memory->write(first + s);
+        }else{
+            this->next_lvl_cache->write((first + s) << this->sector_bits_num);
+        }
+    }
+    if (this->timing) this->timing->background--;
+}
 
-        this->prefetch_heads.pop_back(); // remove LRU
-        this->prefetch_heads.insert(this->prefetch_heads.begin(), block_addr + 1); // Update value of head of MRU stream buffer
+// Picks the way the missing block goes to (sending its victim on, if any)
+// and returns it, emptied. Invalid ways are used first; once the set is
+// full the replacement policy chooses.
+uint32_t Cache::make_space_in_set(uint32_t op_idx){
+    size_t base         = (size_t) op_idx * this->set_stride;
+    uint32_t i;
 
-        g_mem_op_count++; //cache "issueing a read" to mem because it missed in both cache and prefetcher
+    if (this->valid_count[op_idx] < this->assoc){
+        for (i = 0; this->state[base + i] & BLOCK_VALID; i++){
+        }
+    }else{
+        i = this->repl->victim(op_idx);
     }
 
-    assert(this->prefetch_heads.size() == this->pref_n);
-    return 0;
+    if (this->state[base + i] & BLOCK_VALID){
+        if (this->owners && this->owners->core[base + i] != this->owners->current){
+            this->owners->lost_to_others[this->owners->core[base + i]]++;
+            this->owners->evicted_others[this->owners->current]++;
+        }
+        if (this->state[base + i] & BLOCK_PREFETCHED){
+            this->prefetcher->useless++;
+        }
+        addr_t victim_block_addr = (this->tag_at(base + i) << this->index_bits_num) | op_idx;
+        bool dirty = (this->state[base + i] & BLOCK_DIRTY) != 0;
+        uint8_t valid_sectors = 0, dirty_sectors = 0;
+        if (this->sector_valid){
+            valid_sectors = this->sector_valid[base + i];
+            dirty_sectors = this->sector_dirty[base + i];
+            if (this->sector_prefetched[base + i]){
+                this->prefetcher->useless += __builtin_popcount(this->sector_prefetched[base + i]);
+            }
+            this->sector_valid[base + i]      = 0;
+            this->sector_dirty[base + i]      = 0;
+            this->sector_prefetched[base + i] = 0;
+        }
+        if (this->events) this->events->record(EV_EVICT, this->cache_lvl, victim_block_addr);
+        if (this->reuse) this->reuse->on_evict(op_idx, i);
+        // the way is free from here on, even for lookups the eviction causes
+        this->state[base + i] = 0;
+        this->valid_count[op_idx]--;
+
+        if (this->inclusion == INCL_INCLUSIVE && this->back_invalidate(victim_block_addr << this->block_bits_num)){
+            // the levels above had newer data (somewhere in the block's valid sectors)
+            dirty = true;
+            dirty_sectors = valid_sectors;
+        }
+        if (this->sector_valid){
+            this->write_back_sectors(victim_block_addr, dirty_sectors);
+            return i;
+        }
+        if (this->victim != NULL && !this->victim->insert(victim_block_addr, dirty, &victim_block_addr, &dirty)){
+            return i; // the victim cache had room
+        }
+        this->evict_block(victim_block_addr, dirty);
+    }else{
+        //the victim way is empty
+    }
+    return i;
 }
 
+// Sends a block leaving this level (and its victim cache) down: dirty ones
+// are written back, and an exclusive next level takes clean ones too.
+void Cache::evict_block(addr_t victim_block_addr, bool dirty){
+    if (dirty && this->events) this->events->record(EV_WRITEBACK, this->cache_lvl, victim_block_addr);
+    if (this->next_lvl_cache == NULL){
+        if (dirty){
+            // "writing to mem"
+            this->memory->write(victim_block_addr);
+            this->writebacks_to_next_lvl_count++;
+            this->writeback_bytes += this->block_size;
+        }
+        return;
+    }
+    bool exclusive = (this->next_lvl_cache->inclusion == INCL_EXCLUSIVE);
+    if (!dirty && !exclusive){
+        return;
+    }
+    addr_t victim_full_addr = victim_block_addr << this->block_bits_num; // TODO we lose the block offset information 
+                                                                         // (but not used in this simualation)
+    // writebacks are off the request's critical path
+    if (this->timing) this->timing->background++;
+    if (exclusive){
+        this->next_lvl_cache->insert_victim(victim_full_addr, dirty);
+    }else{
+        this->next_lvl_cache->write(victim_full_addr);
+    }
+    if (this->timing) this->timing->background--;
+    if (dirty){
+        this->writebacks_to_next_lvl_count++;
+        this->writeback_bytes += this->block_size;
+    }
+}
 
-// Only increment lru of blocks with lru smaller then the lru of the block getting "touched"
-void Cache::update_lru(uint32_t op_idx, uint32_t op_lru){
-    for(uint32_t i = 0; i < this->assoc; i++){
-        if (this->blocks[op_idx][i].lru < op_lru){
-            this->blocks[op_idx][i].lru++;
-        }else if (this->blocks[op_idx][i].lru == op_lru){
-            this->blocks[op_idx][i].lru = 0;
+// Evicts the block holding addr from every level above (and their victim
+// caches); returns true if any of those copies was dirty. Levels above
+// with smaller blocks lose each of theirs inside it.
+bool Cache::back_invalidate(addr_t addr){
+    bool dirty = false;
+    for (uint32_t u = 0; u < this->upper_caches.size(); u++){
+        Cache* upper = this->upper_caches[u];
+        for (addr_t a = addr; a < addr + this->block_size; a += upper->block_size){
+            uint8_t old_state  = upper->invalidate(a);
+            bool victim_dirty  = false;
+            bool in_victim     = upper->victim && upper->victim->take(a >> upper->block_bits_num, &victim_dirty);
+            if (old_state != 0 || in_victim){
+                this->back_invalidations++;
+            }
+            dirty |= (old_state & BLOCK_DIRTY) || victim_dirty;
+            dirty |= upper->back_invalidate(a);
         }
     }
+    return dirty;
 }
 
-void Cache::make_space_in_set(uint32_t addr){
-    uint32_t block_addr = addr >> this->block_bits_num;
-    uint32_t op_idx     = block_addr % this->sets_num;
+// Exclusive level: the block in way of set op_idx goes to the level above
+// (which takes it dirty if it was)
+void Cache::move_up(uint32_t op_idx, uint32_t way){
+    size_t entry = (size_t) op_idx * this->set_stride + way;
+    this->handed_up_dirty = (this->state[entry] & BLOCK_DIRTY) != 0;
+    this->state[entry]    = 0;
+    this->valid_count[op_idx]--;
+    this->repl->on_invalidate(op_idx, way);
+}
 
-    for (uint32_t i = 0; i < this->assoc; i++){ 
-        if (this->blocks[op_idx][i].lru == this->assoc-1){ // At the lru;
-                                                           // A given block's lru is the actual LRU 
-            if (this->blocks[op_idx][i].valid_bit){
-                if(this->blocks[op_idx][i].dirty_bit){//have to evict
-                    // block is dirty; need to writeback to next lvl AND update its prefetcher 
-                    // (since we don't use the actual value (that's dirty)
-                    // in this simulation, no need to update the prefetcher. 
-                    // issue write of what's inside that block to next level 
-                    if (this->next_lvl_cache == NULL){
-                        // "writing to mem"
-                        g_mem_op_count++;
-                    }else{
-                        uint32_t victim_full_addr = this->blocks[op_idx][i].tag << this->index_bits_num;
-                        victim_full_addr |= op_idx;
-                        victim_full_addr <<= this->block_bits_num; // TODO we lose the block offset information 
-                                                                    // (but not used in this simualation)
-                        this->next_lvl_cache->write(victim_full_addr);
-                    }
-                    this->writebacks_to_next_lvl_count++;
-                }
-            }else{
-                //the LRU is empty
+void Cache::insert_victim(addr_t addr, bool dirty){
+    if (dirty){
+        this->write_count++;
+    }
+    // Another level above (L1I next to L1D) may still hold it: then it
+    // doesn't belong here, and only dirty data moves on
+    for (uint32_t u = 0; u < this->upper_caches.size(); u++){
+        Cache* upper = this->upper_caches[u];
+        if (upper->block_state(addr) != NULL ||
+            (upper->victim != NULL && upper->victim->contains(addr >> upper->block_bits_num))){
+            if (dirty){
+                this->evict_block(addr >> this->block_bits_num, true);
             }
             return;
         }
     }
+    addr_t block_addr = addr >> this->block_bits_num;
+    uint32_t op_idx   = block_addr % this->sets_num;
+    addr_t op_tag     = block_addr >> this->index_bits_num;
+
+    uint32_t i = this->find_way<RuntimeGeometry>(op_idx, op_tag);
+    if (i < this->assoc){ // already here (a prefetch brought it back)
+        if (dirty){
+            this->state[(size_t) op_idx * this->set_stride + i] |= BLOCK_DIRTY;
+        }
+        this->repl->on_hit(op_idx, i);
+        return;
+    }
+    uint32_t way = this->make_space_in_set(op_idx);
+    this->place_block_in_set(op_idx, op_tag, way, dirty);
 }
 
-void Cache::place_block_in_set(uint32_t addr, bool set_dirty){
-    uint32_t block_addr = addr >> this->block_bits_num;
-    uint32_t op_idx     = block_addr % this->sets_num;
-    uint32_t op_tag     = block_addr >> this->index_bits_num;
+// Leaves the tag store and replacement state as read_impl or write_impl
+// would, minus prefetches: a miss evicts the set's victim (warming the
+// next level with its writeback, if dirty) and warms the next level with
+// the fill. Nothing is counted, prefetched, timed or logged, and a
+// prefetched block it touches just loses its mark. Only for unsectored
+// non-inclusive levels without a victim cache or reuse predictor, as in
+// Hierarchy.
+void Cache::warm(addr_t addr, bool write){
+    addr_t block_addr = addr >> this->block_bits_num;
+    uint32_t op_idx   = block_addr % this->sets_num;
+    addr_t op_tag     = block_addr >> this->index_bits_num;
+    size_t base       = (size_t) op_idx * this->set_stride;
+
+    uint32_t i = this->find_way<RuntimeGeometry>(op_idx, op_tag);
+    if (i < this->assoc){
+        this->state[base + i] &= ~BLOCK_PREFETCHED;
+        if (write){
+            this->state[base + i] |= BLOCK_DIRTY;
+        }
+        this->repl->on_hit(op_idx, i);
+        return;
+    }
 
-    for (uint32_t i = 0; i < this->assoc; i++){ 
-        if (this->blocks[op_idx][i].lru == this->assoc-1){ // At the lru;
-                                                           // A given block's lru is the actual LRU 
-            this->blocks[op_idx][i].tag          = op_tag;
-            this->blocks[op_idx][i].valid_bit    = 1;
-            this->blocks[op_idx][i].lru          = 0;
-            this->blocks[op_idx][i].dirty_bit = (set_dirty) ? 1 : 0;
+    if (this->valid_count[op_idx] < this->assoc){
+        for (i = 0; this->state[base + i] & BLOCK_VALID; i++){
+        }
+    }else{
+        i = this->repl->victim(op_idx);
+        addr_t victim_block_addr = (this->tag_at(base + i) << this->index_bits_num) | op_idx;
+        bool dirty = (this->state[base + i] & BLOCK_DIRTY) != 0;
+        this->state[base + i] = 0;
+        this->valid_count[op_idx]--;
+        if (dirty && this->next_lvl_cache != NULL){
+            this->next_lvl_cache->warm(victim_block_addr << this->block_bits_num, true);
+        }
+    }
+    if (this->next_lvl_cache != NULL){
+        this->next_lvl_cache->warm(addr, false);
+    }
+    this->place_block_in_set(op_idx, op_tag, i, write);
+}
+
+// low_priority inserts the block as the set's next victim (see
+// ReplacementPolicy::on_fill_low)
+void Cache::place_block_in_set(uint32_t op_idx, addr_t op_tag, uint32_t way, bool set_dirty, bool low_priority){
+    size_t base         = (size_t) op_idx * this->set_stride;
+
+    if (!(this->state[base + way] & BLOCK_VALID)){
+        this->valid_count[op_idx]++;
+    }
+    this->tags[base + way]    = (uint32_t) op_tag;
+    this->tags_hi[base + way] = (uint32_t) (op_tag >> 32);
+    this->state[base + way]   = BLOCK_VALID | ((set_dirty) ? BLOCK_DIRTY : 0);
+    if (this->sector_valid){ // the caller fills in the sectors
+        this->sector_valid[base + way]      = 0;
+        this->sector_dirty[base + way]      = 0;
+        this->sector_prefetched[base + way] = 0;
+    }
+    if (low_priority){
+        this->repl->on_fill_low(op_idx, way);
+    }else{
+        this->repl->on_fill(op_idx, way);
+    }
+    if (this->reuse) this->reuse->on_fill(op_tag << this->index_bits_num | op_idx, op_idx, way);
+    if (this->owners){
+        this->owners->core[base + way] = this->owners->current;
+    }
+}
+
+uint8_t* Cache::block_state(addr_t addr){
+    if (this->repl == NULL){ // disabled level
+        return NULL;
+    }
+    addr_t block_addr = RuntimeGeometry::block_addr(this, addr);
+    uint32_t op_idx   = RuntimeGeometry::index(this, block_addr);
+    uint32_t i        = this->find_way<RuntimeGeometry>(op_idx, RuntimeGeometry::tag(this, block_addr));
+    return (i < this->assoc) ? &this->state[(size_t) op_idx * this->set_stride + i] : NULL;
+}
+
+uint8_t Cache::invalidate(addr_t addr){
+    uint8_t* block = this->block_state(addr);
+    if (block == NULL){
+        return 0;
+    }
+    uint8_t old_state = *block;
+    size_t entry      = block - this->state;
+    uint32_t op_idx   = entry / this->set_stride;
+    if (old_state & BLOCK_PREFETCHED){
+        this->prefetcher->useless++;
+    }
+    if (this->sector_valid){
+        if (this->sector_prefetched[entry]){
+            this->prefetcher->useless += __builtin_popcount(this->sector_prefetched[entry]);
+        }
+        this->sector_valid[entry]      = 0;
+        this->sector_dirty[entry]      = 0;
+        this->sector_prefetched[entry] = 0;
+    }
+    if (this->reuse) this->reuse->on_evict(op_idx, entry % this->set_stride);
+    *block = 0;
+    this->valid_count[op_idx]--;
+    this->repl->on_invalidate(op_idx, entry % this->set_stride);
+    return old_state;
+}
+
+// Counters and the tag store (all its arrays, as one block), then the
+// replacement policy, prefetcher, victim cache and reuse predictor in
+// sections of their own
+void Cache::save(CheckpointWriter& w){
+    bool enabled = (this->repl != NULL);
+    size_t body  = w.begin_section(CKPT_CACHE);
+    uint64_t counts[8] = { this->read_count, this->read_miss_count, this->write_count, this->write_miss_count,
+                           this->writebacks_to_next_lvl_count, this->prefetches_to_next_lvl_count,
+                           this->read_from_prefetch_count, this->read_miss_from_prefetch_count };
+    w.put<uint32_t>(enabled ? this->sets_num : 0);
+    w.put<uint32_t>(enabled ? this->assoc : 0);
+    w.put<uint32_t>(enabled ? this->block_size : 0);
+    w.put<uint32_t>(enabled ? this->sectors_num : 0);
+    w.put(counts, sizeof(counts));
+    w.put(this->back_invalidations);
+    w.put(this->fill_bytes);
+    w.put(this->prefetch_bytes);
+    w.put(this->writeback_bytes);
+    if (enabled){
+        w.put_array(this->tag_store, this->tag_store_bytes);
+    }
+    w.end_section(body);
+
+    body = w.begin_section(CKPT_REPL);
+    w.put<uint32_t>(enabled ? this->repl->kind() : REPL_NUM_POLICIES);
+    if (enabled){
+        this->repl->save(w);
+    }
+    w.end_section(body);
+
+    body = w.begin_section(CKPT_PREFETCHER);
+    w.put<uint32_t>(this->prefetcher ? this->prefetcher->kind() : PREF_NONE);
+    if (this->prefetcher){
+        this->prefetcher->save(w);
+    }
+    w.end_section(body);
+
+    body = w.begin_section(CKPT_VICTIM);
+    w.put<uint32_t>(this->victim ? this->victim->entries() : 0);
+    if (this->victim){
+        this->victim->save(w);
+    }
+    w.end_section(body);
+
+    body = w.begin_section(CKPT_REUSE);
+    w.put<uint32_t>(this->reuse ? this->reuse->kind() : REUSE_NONE);
+    if (this->reuse){
+        this->reuse->save(w);
+    }
+    w.end_section(body);
+}
+
+void Cache::copy_set(const Cache* src, uint32_t set){
+    size_t base = (size_t) set * this->set_stride;
+    memcpy(&this->tags[base],    &src->tags[base],    this->set_stride * sizeof(uint32_t));
+    memcpy(&this->tags_hi[base], &src->tags_hi[base], this->set_stride * sizeof(uint32_t));
+    memcpy(&this->state[base],   &src->state[base],   this->set_stride * sizeof(uint8_t));
+    if (this->sector_valid){
+        memcpy(&this->sector_valid[base],      &src->sector_valid[base],      this->set_stride);
+        memcpy(&this->sector_dirty[base],      &src->sector_dirty[base],      this->set_stride);
+        memcpy(&this->sector_prefetched[base], &src->sector_prefetched[base], this->set_stride);
+    }
+    this->valid_count[set] = src->valid_count[set];
+    this->repl->copy_set(src->repl, set);
+}
+
+void Cache::add_counters(const Cache* src){
+    this->read_count                    += src->read_count;
+    this->read_miss_count               += src->read_miss_count;
+    this->write_count                   += src->write_count;
+    this->write_miss_count              += src->write_miss_count;
+    this->writebacks_to_next_lvl_count  += src->writebacks_to_next_lvl_count;
+    this->prefetches_to_next_lvl_count  += src->prefetches_to_next_lvl_count;
+    this->read_from_prefetch_count      += src->read_from_prefetch_count;
+    this->read_miss_from_prefetch_count += src->read_miss_from_prefetch_count;
+    this->back_invalidations            += src->back_invalidations;
+    this->fill_bytes                    += src->fill_bytes;
+    this->prefetch_bytes                += src->prefetch_bytes;
+    this->writeback_bytes               += src->writeback_bytes;
+}
+
+uint32_t Cache::load(CheckpointReader& r){
+    bool enabled = (this->repl != NULL);
+    uint32_t cold = 0;
+    size_t end;
+
+    r.expect_section(CKPT_CACHE, &end);
+    uint32_t sets_num   = r.get<uint32_t>();
+    uint32_t assoc      = r.get<uint32_t>();
+    uint32_t block_size = r.get<uint32_t>();
+    uint32_t sectors    = r.get<uint32_t>();
+    if (enabled ? (sets_num != this->sets_num || assoc != this->assoc || block_size != this->block_size || sectors != this->sectors_num) :
+                  (sets_num != 0)){
+        printf("Error: Checkpoint %s has another L%u geometry.\n", r.path, this->cache_lvl);
+        exit(EXIT_FAILURE);
+    }
+    uint64_t counts[8];
+    r.get(counts, sizeof(counts));
+    this->read_count                    = counts[0];
+    this->read_miss_count               = counts[1];
+    this->write_count                   = counts[2];
+    this->write_miss_count              = counts[3];
+    this->writebacks_to_next_lvl_count  = counts[4];
+    this->prefetches_to_next_lvl_count  = counts[5];
+    this->read_from_prefetch_count      = counts[6];
+    this->read_miss_from_prefetch_count = counts[7];
+    this->back_invalidations            = r.get<uint64_t>();
+    this->fill_bytes                    = r.get<uint64_t>();
+    this->prefetch_bytes                = r.get<uint64_t>();
+    this->writeback_bytes               = r.get<uint64_t>();
+    if (enabled){
+        r.get_array(this->tag_store, this->tag_store_bytes);
+    }
+    r.end_section(end);
+
+    r.expect_section(CKPT_REPL, &end);
+    if (enabled){
+        if (r.get<uint32_t>() == (uint32_t) this->repl->kind()){
+            this->repl->load(r);
+        }else{
+            cold |= CKPT_COLD_REPL;
+        }
+    }
+    r.end_section(end);
+
+    r.expect_section(CKPT_PREFETCHER, &end);
+    uint32_t kind = r.get<uint32_t>();
+    if (this->prefetcher && (kind != (uint32_t) this->prefetcher->kind() || !this->prefetcher->load(r))){
+        cold |= CKPT_COLD_PREFETCHER;
+    }
+    r.end_section(end);
+
+    r.expect_section(CKPT_VICTIM, &end);
+    uint32_t entries = r.get<uint32_t>();
+    if (this->victim){
+        if (entries == this->victim->entries()){
+            this->victim->load(r);
         }else{
-            this->blocks[op_idx][i].lru++;
+            cold |= CKPT_COLD_VICTIM;
         }
     }
+    r.end_section(end);
+
+    r.expect_section(CKPT_REUSE, &end);
+    if (this->reuse){
+        if (r.get<uint32_t>() == (uint32_t) this->reuse->kind()){
+            this->reuse->load(r);
+        }else{
+            cold |= CKPT_COLD_REUSE;
+        }
+    }
+    r.end_section(end);
+
+    // Blocks the saved prefetcher brought in are nothing to a new one
+    if (enabled && (this->prefetcher == NULL || (cold & CKPT_COLD_PREFETCHER))){
+        for (size_t i = 0; i < (size_t) this->sets_num * this->set_stride; i++){
+            this->state[i] &= ~BLOCK_PREFETCHED;
+            if (this->sector_valid){
+                this->sector_prefetched[i] = 0;
+            }
+        }
+    }
+    return cold;
 }
 
 // CPU or upper cache lvl initiated read on 'this' Cache
-void Cache::read(uint32_t addr){
+void Cache::read(addr_t addr){
+    this->read_impl<RuntimeGeometry>(addr);
+}
+
+// CPU or upper cache lvl initiated read on 'this' cache. 
+void Cache::write(addr_t addr){
+    this->write_impl<RuntimeGeometry>(addr);
+}
+
+template <class G>
+void Cache::read_impl(addr_t addr){
+    if (G::is_sectored(this)){
+        this->sectored_access(addr, 0);
+        return;
+    }
     this->read_count++; 
+    if (this->timing) this->timing->lookup(this->cache_lvl);
 
-    uint32_t addr1 = addr;
-    uint32_t block_addr = addr1 >> this->block_bits_num;
-    uint32_t op_idx     = block_addr % this->sets_num;
-    uint32_t op_tag     = block_addr >> this->index_bits_num;
+    addr_t addr1      = addr;
+    addr_t block_addr = G::block_addr(this, addr1);
+    uint32_t op_idx   = G::index(this, block_addr);
+    addr_t op_tag     = G::tag(this, block_addr);
 
     //-----------------printing content ----------------
     //this->debug_print_cache_set(addr, 1, 'r');
     // -------------------------------------------------------
 
-    for (uint32_t i = 0; i < this->assoc; i++){
-        if (this->blocks[op_idx][i].valid_bit){
-            if (this->blocks[op_idx][i].tag == op_tag){  //read hit
+    uint32_t i = this->find_way<G>(op_idx, op_tag);
+    if (i < G::assoc(this)){  //read hit
+        if (this->timing) this->timing->hit(this->cache_lvl, block_addr);
+        if (this->events) this->events->record(EV_HIT, this->cache_lvl, block_addr);
 
-                if(this->next_lvl_cache == NULL && this->pref_n > 0){
-                    this->update_prefetcher(block_addr, 1); // scenario 3 and 4
-                }
-                // update lru
-                this->update_lru(op_idx, this->blocks[op_idx][i].lru);
-
-                //-----------------printing content ----------------
-                //this->debug_print_cache_set(addr, 0, 'r');
-                //this->debug_print_prefetcher();
-                // -------------------------------------------------------
-                return;
-            }
+        if(G::has_prefetcher(this)){
+            this->prefetcher_access(block_addr, &this->state[G::set_base(this, op_idx) + i]); // scenario 3 and 4
         }
+        // update replacement state (lru)
+        this->repl->on_hit(op_idx, i);
+        if (this->reuse) this->reuse->on_hit(block_addr, op_idx, i);
+        if (G::is_exclusive(this)){
+            this->move_up(op_idx, i);
+        }
+        if(G::has_prefetcher(this)){
+            this->issue_prefetches();
+        }
+
+        //-----------------printing content ----------------
+        //this->debug_print_cache_set(addr, 0, 'r');
+        //this->debug_print_prefetcher();
+        // -------------------------------------------------------
+        return;
     }
 
     // If we're here, this lvl miss, need to issue a read on next lvl
     this->read_miss_count++;
-    this->make_space_in_set(addr);
-
-    if(this->pref_n > 0){
-        if(this->next_lvl_cache == NULL){
-            if(this->update_prefetcher(block_addr, 0)){
-                this->read_miss_count--;
-            }
-        }else{
-            this->next_lvl_cache->read(addr);
-        }
-
-    }else{ // prefetch is disabled; issue read to next level 
-        if(this->next_lvl_cache == NULL){
+    if (this->timing) this->timing->miss(this->cache_lvl, block_addr);
+    // a victim cache hit swaps the block back in (before the set's victim
+    // can push it out); an exclusive level passes the block up without
+    // keeping it, and so does one bypassing a block predicted dead
+    bool dirty = false;
+    bool from_victim = (this->victim != NULL) && this->victim->take(block_addr, &dirty);
+    reuse_decision_t decision = this->reuse ? this->reuse->on_miss(block_addr, op_idx) : REUSE_FILL;
+    bool bypass      = (decision == REUSE_SKIP);
+    uint32_t way = (G::is_exclusive(this) || bypass) ? 0 : this->make_space_in_set(op_idx);
+
+    if (from_victim){
+        this->read_miss_count--;
+        this->victim->hits++;
+        if (this->events) this->events->record(EV_HIT, this->cache_lvl, block_addr);
+
+    }else if(G::has_prefetcher(this) && this->prefetcher_access(block_addr, NULL)){
+        this->read_miss_count--; // supplied by a stream buffer
+
+    }else{ // issue read to next level 
+        if (this->events) this->events->record(EV_MISS, this->cache_lvl, block_addr);
+        this->fill_bytes += this->block_size;
+        if(G::is_last(this)){
             // "reading from mem"
-            g_mem_op_count++;
+            this->memory->read(block_addr);
         }else{
             this->next_lvl_cache->read(addr);
+            dirty = this->next_lvl_cache->handed_up_dirty;
         }
     }
 
-    this->place_block_in_set(addr, 0);
+    if (G::is_exclusive(this)){
+        this->handed_up_dirty = dirty;
+    }else if (!bypass){
+        this->place_block_in_set(op_idx, op_tag, way, dirty, decision == REUSE_FILL_LOW);
+    }
+    if(G::has_prefetcher(this)){
+        this->issue_prefetches();
+    }
 
     //-----------------printing content ----------------
     //this->debug_print_cache_set(addr, 0, 'r');
@@ -402,66 +1348,90 @@ void Cache::read(uint32_t addr){
     // -------------------------------------------------------
 }
 
-// CPU or upper cache lvl initiated read on 'this' cache. 
-void Cache::write(uint32_t addr){
+template <class G>
+void Cache::write_impl(addr_t addr){
+    if (G::is_sectored(this)){
+        this->sectored_access(addr, EV_FLAG_WRITE);
+        return;
+    }
     this->write_count++; 
+    if (this->timing) this->timing->lookup(this->cache_lvl);
 
-    uint32_t addr1 = addr;
-    uint32_t block_addr = addr1 >> this->block_bits_num;
-    uint32_t op_idx     = block_addr % this->sets_num;
-    uint32_t op_tag     = block_addr >> this->index_bits_num;
+    addr_t addr1      = addr;
+    addr_t block_addr = G::block_addr(this, addr1);
+    uint32_t op_idx   = G::index(this, block_addr);
+    addr_t op_tag     = G::tag(this, block_addr);
 
     //-----------------printing content ----------------
     //this->debug_print_cache_set(addr, 1, 'w');
     // -------------------------------------------------------
 
-    for (uint32_t i = 0; i < this->assoc; i++){
-        if (this->blocks[op_idx][i].valid_bit){
-            if(this->blocks[op_idx][i].tag == op_tag){ // write hit
+    size_t base = G::set_base(this, op_idx);
+    uint32_t i  = this->find_way<G>(op_idx, op_tag);
+    if (i < G::assoc(this)){ // write hit
+        if (this->timing) this->timing->hit(this->cache_lvl, block_addr);
+        if (this->events) this->events->record(EV_HIT, this->cache_lvl, block_addr, EV_FLAG_WRITE);
 
-                if(this->next_lvl_cache == NULL && this->pref_n > 0){
-                    this->update_prefetcher(block_addr, 1); // scenario 3 and 4
-                }
-                if (!this->blocks[op_idx][i].dirty_bit){ // clean block; simply write on it
-                    this->blocks[op_idx][i].dirty_bit = 1;
-
-                }else{ // dirty block
-                    // block is already dirty; keep writing on it
-                }
-                this->update_lru(op_idx, this->blocks[op_idx][i].lru);
+        if(G::has_prefetcher(this)){
+            this->prefetcher_access(block_addr, &this->state[base + i]); // scenario 3 and 4
+        }
+        if (!(this->state[base + i] & BLOCK_DIRTY)){ // clean block; simply write on it
+            this->state[base + i] |= BLOCK_DIRTY;
 
-                //-----------------printing content ----------------
-                //this->debug_print_cache_set(addr, 0, 'w');
-                //this->debug_print_prefetcher();
-                // -------------------------------------------------------
-                return;
-            }
+        }else{ // dirty block
+            // block is already dirty; keep writing on it
+        }
+        this->repl->on_hit(op_idx, i);
+        if (this->reuse) this->reuse->on_hit(block_addr, op_idx, i);
+        if(G::has_prefetcher(this)){
+            this->issue_prefetches();
         }
+
+        //-----------------printing content ----------------
+        //this->debug_print_cache_set(addr, 0, 'w');
+        //this->debug_print_prefetcher();
+        // -------------------------------------------------------
+        return;
     }
 
     // If we're here, this lvl miss, need to issue a read on next lvl
     this->write_miss_count++;
+    if (this->timing) this->timing->miss(this->cache_lvl, block_addr);
 
     //this->allocate_block(addr, 1);
-    this->make_space_in_set(addr);
-
-    if(this->pref_n > 0){
-        if(this->next_lvl_cache == NULL){
-            if(this->update_prefetcher(block_addr, 0)){
-                this->write_miss_count--;
-            }
-        }else{
-            this->next_lvl_cache->read(addr);
-        }
-    }else{ // prefetch is disabled; issue read to next level 
-        if(this->next_lvl_cache == NULL){
+    bool dirty = false;
+    bool from_victim = (this->victim != NULL) && this->victim->take(block_addr, &dirty);
+    reuse_decision_t decision = this->reuse ? this->reuse->on_miss(block_addr, op_idx) : REUSE_FILL;
+    bool bypass      = (decision == REUSE_SKIP);
+    uint32_t way = bypass ? 0 : this->make_space_in_set(op_idx);
+
+    if (from_victim){
+        this->write_miss_count--;
+        this->victim->hits++;
+        if (this->events) this->events->record(EV_HIT, this->cache_lvl, block_addr, EV_FLAG_WRITE);
+    }else if(G::has_prefetcher(this) && this->prefetcher_access(block_addr, NULL)){
+        this->write_miss_count--; // supplied by a stream buffer
+    }else if (bypass){
+        if (this->events) this->events->record(EV_MISS, this->cache_lvl, block_addr, EV_FLAG_WRITE);
+    }else{ // issue read to next level 
+        if (this->events) this->events->record(EV_MISS, this->cache_lvl, block_addr, EV_FLAG_WRITE);
+        this->fill_bytes += this->block_size;
+        if(G::is_last(this)){
             // "reading from mem"
-            g_mem_op_count++;
+            this->memory->read(block_addr);
         }else{
             this->next_lvl_cache->read(addr);
         }
     }
-    this->place_block_in_set(addr, 1);
+    if (bypass){
+        // written around this level: the data goes on down, unfetched
+        this->evict_block(block_addr, true);
+    }else{
+        this->place_block_in_set(op_idx, op_tag, way, 1, decision == REUSE_FILL_LOW);
+    }
+    if(G::has_prefetcher(this)){
+        this->issue_prefetches();
+    }
 
     //-----------------printing content ----------------
     //this->debug_print_cache_set(addr, 0, 'w');
@@ -469,4 +1439,65 @@ void Cache::write(uint32_t addr){
     // -------------------------------------------------------
 }
 
+// The a-q measurements reported at the end of a run
+typedef struct {
+    uint64_t l1_reads;                  // a
+    uint64_t l1_read_misses;            // b
+    uint64_t l1_writes;                 // c
+    uint64_t l1_write_misses;           // d
+    double   l1_miss_rate;              // e
+    uint64_t l1_writebacks;             // f
+    uint64_t l1_prefetches;             // g
+    uint64_t l2_reads;                  // h
+    uint64_t l2_read_misses;            // i
+    uint64_t l2_prefetch_reads;         // j
+    uint64_t l2_prefetch_read_misses;   // k
+    uint64_t l2_writes;                 // l
+    uint64_t l2_write_misses;           // m
+    double   l2_miss_rate;              // n
+    uint64_t l2_writebacks;             // o
+    uint64_t l2_prefetches;             // p
+    uint64_t mem_traffic;               // q
+} measurements_t;
+
+void print_measurements(const measurements_t& m){
+    printf("===== Measurements =====\n");
+    printf("a. %-30s %llu\n", "L1 reads: "                      , (unsigned long long) m.l1_reads);
+    printf("b. %-30s %llu\n", "L1 read misses: "                , (unsigned long long) m.l1_read_misses);
+    printf("c. %-30s %llu\n", "L1 writes: "                     , (unsigned long long) m.l1_writes);
+    printf("d. %-30s %llu\n", "L1 write misses: "               , (unsigned long long) m.l1_write_misses);
+    printf("e. %-30s %.4f\n", "L1 miss rate: "                , m.l1_miss_rate);
+    printf("f. %-30s %llu\n", "L1 writebacks: "                 , (unsigned long long) m.l1_writebacks);
+    printf("g. %-30s %llu\n", "L1 prefetches: "                 , (unsigned long long) m.l1_prefetches);
+
+    printf("h. %-30s %llu\n", "L2 reads (demand): "             , (unsigned long long) m.l2_reads);
+    printf("i. %-30s %llu\n", "L2 read misses (demand): "       , (unsigned long long) m.l2_read_misses);
+    printf("j. %-30s %llu\n", "L2 reads (prefetch): "           , (unsigned long long) m.l2_prefetch_reads);
+    printf("k. %-30s %llu\n", "L2 read misses (prefetch): "     , (unsigned long long) m.l2_prefetch_read_misses);
+    printf("l. %-30s %llu\n", "L2 writes: "                     , (unsigned long long) m.l2_writes);
+    printf("m. %-30s %llu\n", "L2 write misses: "               , (unsigned long long) m.l2_write_misses);
+    printf("n. %-30s %.4f\n", "L2 miss rate: "                , m.l2_miss_rate);
+    printf("o. %-30s %llu\n", "L2 writebacks: "                 , (unsigned long long) m.l2_writebacks);
+    printf("p. %-30s %llu\n", "L2 prefetches: "                 , (unsigned long long) m.l2_prefetches);
+
+    printf("q. %-30s %llu\n", "memory traffic: "              , (unsigned long long) m.mem_traffic);
+}
+
+// Bytes each of the n levels (top down, the last one in front of memory)
+// moved to and from the level below it; q in bytes, in effect, with
+// per-level line sizes and sectors
+void print_traffic(const char* const* names, Cache* const* levels, size_t n){
+    printf("===== Traffic (bytes) =====\n");
+    printf("%-5s %6s %6s %12s %12s %12s %12s\n", "level", "line", "sector", "fills", "prefetches", "writebacks", "total");
+    uint64_t total = 0;
+    for (size_t i = 0; i < n; i++){
+        Cache* c = levels[i];
+        total    = c->fill_bytes + c->prefetch_bytes + c->writeback_bytes;
+        printf("%-5s %6u %6u %12llu %12llu %12llu %12llu\n", names[i], c->get_block_size(), c->get_sector_size(),
+               (unsigned long long) c->fill_bytes, (unsigned long long) c->prefetch_bytes,
+               (unsigned long long) c->writeback_bytes, (unsigned long long) total);
+    }
+    printf("%-33s %llu\n", "memory traffic (bytes): ", (unsigned long long) total);
+}
+
 #endif // CACHESIM_H
@@ -0,0 +1,212 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace std;
+
+/*  Checkpoint files: the whole state of a hierarchy (hierarchy.h) after
+    some prefix of a trace, so that runs can resume from there instead of
+    replaying the prefix. Layout, native byte order:
+
+        char     magic[4]       "CSCK"
+        uint32_t version        CHECKPOINT_VERSION
+        sections, each
+            uint32_t tag        checkpoint_section_t
+            uint64_t length     bytes of its body, so readers can skip it
+            body
+
+    Bodies are plain fields and arrays. An array is its byte count followed
+    by the bytes themselves, starting at a multiple of CHECKPOINT_ALIGN in
+    the file: the reader maps the file and copies the arrays (tag stores,
+    replacement state) straight out of the mapping.
+*/
+
+#define CHECKPOINT_MAGIC   "CSCK"
+#define CHECKPOINT_VERSION 5
+#define CHECKPOINT_ALIGN   64
+
+typedef enum {
+    CKPT_TRACE = 1,     // trace position and the geometry it was taken with
+    CKPT_MEMORY,        // MainMemory counters
+    CKPT_CACHE,         // one level: counters and tag store, then its sections below
+    CKPT_REPL,          // a replacement policy; starts with its repl_policy_t
+    CKPT_PREFETCHER,    // a prefetcher; starts with its prefetcher_kind_t
+    CKPT_VICTIM,        // a victim cache
+    CKPT_PAGE_MAP,      // the page table
+    CKPT_REUSE          // a reuse predictor; starts with its reuse_kind_t
+} checkpoint_section_t;
+
+class CheckpointWriter {
+    public:
+        vector<uint8_t> buf;
+
+        CheckpointWriter(){
+            this->put(CHECKPOINT_MAGIC, 4);
+            this->put<uint32_t>(CHECKPOINT_VERSION);
+        }
+
+        void put(const void* p, size_t n){
+            this->buf.insert(this->buf.end(), (const uint8_t*) p, (const uint8_t*) p + n);
+        }
+        template <class T> void put(const T& v){ this->put(&v, sizeof(v)); }
+
+        void put_array(const void* p, size_t bytes){
+            this->put<uint64_t>(bytes);
+            this->buf.resize((this->buf.size() + CHECKPOINT_ALIGN - 1) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN, 0);
+            this->put(p, bytes);
+        }
+        template <class T> void put_vector(const vector<T>& v){ this->put_array(v.data(), v.size() * sizeof(T)); }
+
+        // Returns what end_section() needs to fill in the length
+        size_t begin_section(checkpoint_section_t tag){
+            this->put<uint32_t>(tag);
+            this->put<uint64_t>(0);
+            return this->buf.size();
+        }
+        void end_section(size_t body){
+            uint64_t length = this->buf.size() - body;
+            memcpy(&this->buf[body - sizeof(uint64_t)], &length, sizeof(length));
+        }
+
+        // Returns false if path couldn't be written
+        bool write_file(const char* path){
+            FILE* f = fopen(path, "wb");
+            if (f == NULL){
+                return false;
+            }
+            bool ok = fwrite(this->buf.data(), 1, this->buf.size(), f) == this->buf.size();
+            return (fclose(f) == 0) && ok;
+        }
+};
+
+class CheckpointReader {
+    private:
+        const uint8_t* data;    // the mapped file
+        size_t len;
+        size_t pos;
+
+        void need(size_t n){
+            if (n > this->len - this->pos){
+                printf("Error: Checkpoint %s is truncated.\n", this->path);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+    public:
+        const char* path;
+
+        CheckpointReader(){
+            this->data = NULL;
+            this->len  = 0;
+            this->pos  = 0;
+            this->path = NULL;
+        }
+        ~CheckpointReader(){
+            if (this->data != NULL){
+                munmap((void*) this->data, this->len);
+            }
+        }
+
+        // Maps path and checks its header; returns false if it couldn't be opened
+        bool open(const char* path){
+            this->path = path;
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0){
+                return false;
+            }
+            struct stat st;
+            void* m = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && st.st_size > 0){
+                m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ::close(fd);
+            if (m == MAP_FAILED){
+                return false;
+            }
+            this->data = (const uint8_t*) m;
+            this->len  = st.st_size;
+
+            char magic[4];
+            this->get(magic, 4);
+            if (memcmp(magic, CHECKPOINT_MAGIC, 4) != 0){
+                printf("Error: %s is not a checkpoint.\n", path);
+                exit(EXIT_FAILURE);
+            }
+            uint32_t version = this->get<uint32_t>();
+            if (version != CHECKPOINT_VERSION){
+                printf("Error: %s is checkpoint version %u; this simulator reads version %u.\n", path, version, CHECKPOINT_VERSION);
+                exit(EXIT_FAILURE);
+            }
+            return true;
+        }
+
+        void get(void* p, size_t n){
+            this->need(n);
+            memcpy(p, this->data + this->pos, n);
+            this->pos += n;
+        }
+        template <class T> T get(){
+            T v;
+            this->get(&v, sizeof(v));
+            return v;
+        }
+
+        // Points *p at the next array, inside the mapping; returns its size in bytes
+        size_t get_array(const void** p){
+            uint64_t bytes = this->get<uint64_t>();
+            this->need((CHECKPOINT_ALIGN - this->pos % CHECKPOINT_ALIGN) % CHECKPOINT_ALIGN);
+            this->pos = (this->pos + CHECKPOINT_ALIGN - 1) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN;
+            this->need(bytes);
+            *p = this->data + this->pos;
+            this->pos += bytes;
+            return bytes;
+        }
+        // Copies the next array into dst, which must be exactly bytes long
+        void get_array(void* dst, size_t bytes){
+            const void* p;
+            if (this->get_array(&p) != bytes){
+                printf("Error: Checkpoint %s doesn't match this configuration.\n", this->path);
+                exit(EXIT_FAILURE);
+            }
+            memcpy(dst, p, bytes);
+        }
+        // Replaces v with the next array, which must hold exactly v.size() elements
+        template <class T> void get_vector(vector<T>& v){
+            this->get_array(v.data(), v.size() * sizeof(T));
+        }
+
+        // Reads the next section header; *end is where its body ends
+        checkpoint_section_t begin_section(size_t* end){
+            checkpoint_section_t tag = (checkpoint_section_t) this->get<uint32_t>();
+            uint64_t length = this->get<uint64_t>();
+            this->need(length);
+            *end = this->pos + length;
+            return tag;
+        }
+        // Like begin_section(), but the section must be tag
+        void expect_section(checkpoint_section_t tag, size_t* end){
+            if (this->begin_section(end) != tag){
+                printf("Error: Checkpoint %s doesn't match this configuration.\n", this->path);
+                exit(EXIT_FAILURE);
+            }
+        }
+        // Moves past the section ending at end (whether or not its body was read)
+        void end_section(size_t end){
+            if (this->pos > end){
+                printf("Error: Checkpoint %s is corrupt.\n", this->path);
+                exit(EXIT_FAILURE);
+            }
+            this->pos = end;
+        }
+};
+
+#endif // CHECKPOINT_H
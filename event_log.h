@@ -0,0 +1,232 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include "addr.h"
+#include "trace_binary.h"
+
+/*  Event tracing: what happened to which block, at which access, at every
+    level. Each Cache holds an EventLog pointer that is NULL unless tracing
+    is on, so the default path pays one predictable branch per event site.
+
+    Events go to a fixed ring of EVENT_RING_SIZE entries, which is drained
+    into the log file whenever it fills up (and when the log is closed).
+    Log file (".cevt"), little-endian:
+
+        header (8 bytes)
+            char     magic[4]       "CEVT"
+            uint16_t version        EVENT_LOG_VERSION
+            uint16_t flags          reserved, 0
+
+        events, each
+            uint8_t  kind | flags << 3 | (level - 1) << 5
+            varint   access - the previous event's access
+            varint   zigzag(block - the previous block of that level)
+
+    Accesses count trace requests from 1; blocks are block addresses of
+    their level (sector addresses in the prefetch events of a sectored
+    level). Most events take 3-4 bytes.
+*/
+
+#define EVENT_LOG_MAGIC   "CEVT"
+#define EVENT_LOG_VERSION 1
+#define EVENT_LOG_HEADER_SIZE 8
+#define EVENT_RING_SIZE   65536
+#define EVENT_MAX_LEVELS  8
+
+typedef enum {
+    EV_HIT = 0,
+    EV_MISS,                // a read from the next level (or memory) follows (a writeback, for a bypassed write)
+    EV_EVICT,               // a valid block was chosen as victim
+    EV_WRITEBACK,           // a dirty block went down
+    EV_PREFETCH_ISSUE,
+    EV_PREFETCH_USE,        // first demand use of a prefetched block (or stream buffer hit)
+    EV_NUM_KINDS
+} event_kind_t;
+
+static const char* const event_kind_names[EV_NUM_KINDS] = {
+    "hit", "miss", "evict", "writeback", "pf-issue", "pf-use"
+};
+
+// Flags of hit and miss events
+#define EV_FLAG_WRITE    0x1    // the request was a write
+#define EV_FLAG_PREFETCH 0x2    // the request came from the level above's prefetcher
+
+typedef struct {
+    uint64_t access;
+    addr_t   block;
+    uint8_t  kind;
+    uint8_t  flags;
+    uint8_t  level;
+} event_t;
+
+class EventLog {
+    private:
+        FILE* out;
+        event_t ring[EVENT_RING_SIZE];
+        uint32_t head;              // oldest event not yet written
+        uint32_t count;             // events in the ring
+
+        // Encoder state
+        uint64_t last_access;
+        addr_t   last_block[EVENT_MAX_LEVELS];
+        std::vector<uint8_t> encoded;   // room for a full ring
+
+        void drain(){
+            uint8_t* buf = this->encoded.data();
+            size_t n = 0;
+            for (; this->count > 0; this->count--){
+                const event_t& e = this->ring[this->head];
+                buf[n++] = (uint8_t) (e.kind | e.flags << 3 | (e.level - 1) << 5);
+                n += varint_encode(e.access - this->last_access, buf + n);
+                n += varint_encode(zigzag_encode((int64_t) (e.block - this->last_block[e.level - 1])), buf + n);
+                this->last_access = e.access;
+                this->last_block[e.level - 1] = e.block;
+                this->head = (this->head + 1) % EVENT_RING_SIZE;
+            }
+            fwrite(buf, 1, n, this->out);
+            this->bytes_written += n;
+        }
+
+    public:
+        uint64_t now;               // the access being simulated (Hierarchy counts them)
+        uint64_t events;            // recorded so far
+        uint64_t bytes_written;
+
+        EventLog(){
+            this->out   = NULL;
+            this->head  = 0;
+            this->count = 0;
+            this->last_access = 0;
+            memset(this->last_block, 0, sizeof(this->last_block));
+            this->encoded.resize((size_t) EVENT_RING_SIZE * (1 + 2 * TRACE_BIN_MAX_RECORD));
+            this->now    = 0;
+            this->events = 0;
+            this->bytes_written = 0;
+        }
+        ~EventLog(){ this->close(); }
+
+        // Returns false if path couldn't be created
+        bool open(const char* path){
+            this->out = fopen(path, "wb");
+            if (this->out == NULL){
+                return false;
+            }
+            uint8_t header[EVENT_LOG_HEADER_SIZE] = { 0 };
+            memcpy(header, EVENT_LOG_MAGIC, 4);
+            header[4] = EVENT_LOG_VERSION & 0xff;
+            header[5] = EVENT_LOG_VERSION >> 8;
+            fwrite(header, 1, sizeof(header), this->out);
+            this->bytes_written = sizeof(header);
+            return true;
+        }
+        void close(){
+            if (this->out != NULL){
+                this->drain();
+                fclose(this->out);
+                this->out = NULL;
+            }
+        }
+
+        void record(event_kind_t kind, uint32_t level, addr_t block, uint8_t flags = 0){
+            if (this->count == EVENT_RING_SIZE){
+                this->drain();
+            }
+            event_t& e = this->ring[(this->head + this->count) % EVENT_RING_SIZE];
+            e.access = this->now;
+            e.block  = block;
+            e.kind   = (uint8_t) kind;
+            e.flags  = flags;
+            e.level  = (uint8_t) level;
+            this->count++;
+            this->events++;
+        }
+};
+
+// Decodes a log written by EventLog
+class EventLogReader {
+    private:
+        const uint8_t* data;
+        size_t len;
+        size_t pos;
+        uint64_t last_access;
+        addr_t   last_block[EVENT_MAX_LEVELS];
+
+    public:
+        const char* path;
+
+        EventLogReader(){
+            this->data = NULL;
+            this->len  = 0;
+            this->pos  = 0;
+            this->last_access = 0;
+            memset(this->last_block, 0, sizeof(this->last_block));
+            this->path = NULL;
+        }
+        ~EventLogReader(){
+            if (this->data != NULL){
+                munmap((void*) this->data, this->len);
+            }
+        }
+
+        // Returns false if path couldn't be opened
+        bool open(const char* path){
+            this->path = path;
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0){
+                return false;
+            }
+            struct stat st;
+            void* m = MAP_FAILED;
+            if (fstat(fd, &st) == 0 && st.st_size > 0){
+                m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            }
+            ::close(fd);
+            if (m == MAP_FAILED || st.st_size < EVENT_LOG_HEADER_SIZE || memcmp(m, EVENT_LOG_MAGIC, 4) != 0){
+                printf("Error: %s is not an event log.\n", path);
+                exit(EXIT_FAILURE);
+            }
+            this->data = (const uint8_t*) m;
+            this->len  = st.st_size;
+            uint32_t version = this->data[4] | this->data[5] << 8;
+            if (version != EVENT_LOG_VERSION){
+                printf("Error: %s is event log version %u; this simulator reads version %u.\n", path, version, EVENT_LOG_VERSION);
+                exit(EXIT_FAILURE);
+            }
+            this->pos = EVENT_LOG_HEADER_SIZE;
+            return true;
+        }
+
+        // Returns false at the end of the log
+        bool next(event_t* e){
+            if (this->pos == this->len){
+                return false;
+            }
+            const uint8_t* end = this->data + this->len;
+            uint8_t b = this->data[this->pos++];
+            uint64_t access_delta, block_delta;
+            uint32_t n1 = varint_decode(this->data + this->pos, end, &access_delta);
+            uint32_t n2 = (n1 > 0) ? varint_decode(this->data + this->pos + n1, end, &block_delta) : 0;
+            if (n2 == 0 || (b & 0x7) >= EV_NUM_KINDS){
+                printf("Error: corrupt event at byte %llu of %s.\n", (unsigned long long) this->pos - 1, this->path);
+                exit(EXIT_FAILURE);
+            }
+            this->pos += n1 + n2;
+            e->kind   = b & 0x7;
+            e->flags  = (b >> 3) & 0x3;
+            e->level  = (b >> 5) + 1;
+            e->access = this->last_access += access_delta;
+            e->block  = this->last_block[e->level - 1] += (addr_t) zigzag_decode(block_delta);
+            return true;
+        }
+};
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,92 @@
+#ifndef FIXED_CACHE_H
+#define FIXED_CACHE_H
+
+#include "cachesim.h"
+
+// Compile-time geometry for Cache::read_impl/write_impl: the set index is a
+// mask, the tag a constant shift, the way loop has a constant trip count and
+// the prefetcher/next-level branches fold away. Exclusive and sectored
+// levels always use the generic Cache.
+template <uint32_t BLOCK, uint32_t SETS, uint32_t ASSOC, bool PREF, bool LAST>
+struct FixedGeometry {
+    static_assert((BLOCK & (BLOCK - 1)) == 0 && (SETS & (SETS - 1)) == 0, "block size and set count must be powers of 2");
+    static_assert(ASSOC <= TAG_MATCH_CHUNK, "one tag match call per set");
+
+    static constexpr uint32_t log2u(uint32_t v){ return (v <= 1) ? 0 : 1 + log2u(v >> 1); }
+    static constexpr uint32_t pow2_ceil(uint32_t v, uint32_t p = 1){ return (p >= v) ? p : pow2_ceil(v, p << 1); }
+
+    static inline addr_t block_addr(const Cache* c, addr_t addr){ return addr >> log2u(BLOCK); }
+    static inline uint32_t index(const Cache* c, addr_t block_addr){ return block_addr & (SETS - 1); }
+    static inline addr_t tag(const Cache* c, addr_t block_addr){ return block_addr >> log2u(SETS); }
+    static inline uint32_t assoc(const Cache* c){ return ASSOC; }
+    static inline size_t set_base(const Cache* c, uint32_t op_idx){ return (size_t) op_idx * pow2_ceil(ASSOC); }
+    static inline bool has_prefetcher(const Cache* c){ return PREF; }
+    static inline bool is_last(const Cache* c){ return LAST; }
+    static inline bool is_exclusive(const Cache* c){ return false; }
+    static inline bool is_sectored(const Cache* c){ return false; }
+};
+
+template <uint32_t BLOCK, uint32_t SETS, uint32_t ASSOC, bool PREF, bool LAST>
+class FixedCache : public Cache {
+    public:
+        FixedCache(uint32_t cache_lvl, uint32_t block_size, repl_policy_t repl_policy, Prefetcher* prefetcher,
+                   inclusion_t inclusion, VictimCache* victim)
+            : Cache(cache_lvl, SETS * ASSOC * BLOCK, ASSOC, block_size, repl_policy, prefetcher, inclusion, victim){
+        }
+
+        void read(addr_t addr){
+            this->read_impl<FixedGeometry<BLOCK, SETS, ASSOC, PREF, LAST> >(addr);
+        }
+        void write(addr_t addr){
+            this->write_impl<FixedGeometry<BLOCK, SETS, ASSOC, PREF, LAST> >(addr);
+        }
+};
+
+// Geometries (block size, sets, ways) specialized at compile time:
+// 8KB/4-way and 256KB/8-way with 32B blocks (the configs we run most), and
+// 32KB/8-way, 256KB/8-way, 1MB/16-way, 2MB/16-way with 64B blocks.
+#define FIXED_CACHE_GEOMETRIES(X) \
+    X(32,   64,  4) \
+    X(32, 1024,  8) \
+    X(64,   64,  8) \
+    X(64,  512,  8) \
+    X(64, 1024, 16) \
+    X(64, 2048, 16)
+
+// Builds one level of the hierarchy (owning prefetcher, which may be NULL),
+// linked to next_lvl_cache (NULL for the last level, which then talks to memory). Geometries in
+// FIXED_CACHE_GEOMETRIES get a FixedCache; any other (or a disabled level, lvl_size 0) falls back
+// to the generic Cache. victim_entries > 0 adds a victim cache; sectors > 1 makes the level sectored.
+static Cache* make_cache(uint32_t cache_lvl, uint32_t lvl_size, uint32_t lvl_assoc, uint32_t block_size,
+                         repl_policy_t repl_policy, Prefetcher* prefetcher, Cache* next_lvl_cache,
+                         MainMemory* memory, inclusion_t inclusion = INCL_NINE, uint32_t victim_entries = 0,
+                         uint32_t sectors = 1){
+    Cache* cache = NULL;
+    bool generic = (getenv("CACHESIM_GENERIC") != NULL); // forces the generic Cache, for comparisons
+    bool last    = (next_lvl_cache == NULL);
+    bool pref    = (prefetcher != NULL);
+    uint32_t sets = (lvl_size > 0 && lvl_assoc > 0) ? lvl_size / (lvl_assoc * block_size) : 0;
+    VictimCache* victim = (victim_entries > 0) ? new VictimCache(victim_entries) : NULL;
+
+#define FIXED_CACHE_CASE(B, S, A) \
+    if (cache == NULL && !generic && inclusion != INCL_EXCLUSIVE && sectors == 1 && block_size == B && sets == S && lvl_assoc == A && lvl_size == S * A * B){ \
+        if (pref && last)  cache = new FixedCache<B, S, A, true,  true >(cache_lvl, block_size, repl_policy, prefetcher, inclusion, victim); \
+        else if (pref)     cache = new FixedCache<B, S, A, true,  false>(cache_lvl, block_size, repl_policy, prefetcher, inclusion, victim); \
+        else if (last)     cache = new FixedCache<B, S, A, false, true >(cache_lvl, block_size, repl_policy, prefetcher, inclusion, victim); \
+        else               cache = new FixedCache<B, S, A, false, false>(cache_lvl, block_size, repl_policy, prefetcher, inclusion, victim); \
+    }
+    FIXED_CACHE_GEOMETRIES(FIXED_CACHE_CASE)
+#undef FIXED_CACHE_CASE
+
+    if (cache == NULL){
+        cache = new Cache(cache_lvl, lvl_size, lvl_assoc, block_size, repl_policy, prefetcher, inclusion, victim, sectors);
+    }
+    cache->next_lvl_cache = next_lvl_cache;
+    cache->memory         = memory;
+    if (next_lvl_cache != NULL && lvl_size > 0){
+        next_lvl_cache->link_upper(cache);
+    }
+    return cache;
+}
+
+#endif // FIXED_CACHE_H
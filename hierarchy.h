@@ -0,0 +1,287 @@
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cachesim.h"
+#include "fixed_cache.h"
+#include "trace_reader.h"
+#include "checkpoint.h"
+
+/*  A complete L1 -> L2 -> main memory hierarchy with its own stats. There's
+    no shared state between instances, so independent hierarchies can be
+    simulated concurrently from different threads (one thread per instance).
+
+        Hierarchy h(params);
+        h.access('r', 0x400341a0);
+        h.access_batch(records, n);
+        measurements_t m = h.stats();
+        timing_stats_t t = h.timing_stats();    // if params.timing_enabled
+
+    Its whole state can be checkpointed along with the position in the trace
+    it came from, and restored into a hierarchy of the same geometry, to
+    resume that trace from there (see checkpoint.h).
+*/
+class Hierarchy {
+    public:
+        cache_params_t params;
+        Cache* l1_cache;
+        Cache* l2_cache;        // a disabled (size 0) level if params.l2_size == 0
+        MainMemory memory;
+        TimingModel* timing;    // NULL unless params.timing_enabled
+        PageMapper* page_map;   // NULL unless params.page_map.kind != PAGE_MAP_NONE
+        EventLog* events;       // NULL unless trace_events() was called; not owned
+
+        Hierarchy(const cache_params_t& params);
+        ~Hierarchy();
+
+        Cache* last_level(){ return (this->params.l2_size > 0) ? this->l2_cache : this->l1_cache; }
+
+        // Prefetcher of level lvl (1 or 2); PREF_DEFAULT puts the stream
+        // buffers at the last level when PREF_N > 0
+        prefetcher_kind_t prefetcher_kind(uint32_t lvl){
+            prefetcher_kind_t kind = (lvl == 1) ? this->params.l1_pref : this->params.l2_pref;
+            bool last = (lvl == 2) || (this->params.l2_size == 0);
+            if (kind == PREF_DEFAULT){
+                kind = (last && this->params.pref_n > 0) ? PREF_STREAM : PREF_NONE;
+            }
+            return kind;
+        }
+
+        // rw is 'r' or 'w'
+        void access(char rw, addr_t addr){
+            if (this->page_map) addr = this->page_map->translate(addr);
+            this->access_physical(rw, addr);
+        }
+        // addr already went through the page map (if any)
+        void access_physical(char rw, addr_t addr){
+            if (this->events) this->events->now++;
+            if (this->timing) this->timing->begin();
+            if (rw == 'r'){
+                this->l1_cache->read(addr);
+            }else{
+                this->l1_cache->write(addr);
+            }
+            if (this->timing) this->timing->end();
+        }
+        // Functional warming: addr (physical) changes the cache contents
+        // and replacement state as access_physical() would, but nothing is
+        // counted, prefetched, timed or logged (see Cache::warm())
+        void warm_physical(char rw, addr_t addr){
+            this->l1_cache->warm(addr, rw == 'w');
+        }
+        void access_batch(const trace_record* records, size_t n){
+            for (size_t i = 0; i < n; i++){
+                this->access(records[i].rw, records[i].addr);
+            }
+        }
+
+        // Records every level's events in log from now on
+        void trace_events(EventLog* log){
+            this->events         = log;
+            this->l1_cache->events = log;
+            this->l2_cache->events = log;
+        }
+
+        measurements_t stats();
+        // Only meaningful if level lvl has a prefetcher
+        prefetcher_stats_t prefetcher_stats(uint32_t lvl);
+        // Only meaningful if params.timing_enabled
+        timing_stats_t timing_stats(){ return this->timing->report(); }
+        // The last level's misses and memory traffic (see reuse_predictor.h)
+        reuse_outcome_t llc_outcome();
+
+        // Writes the hierarchy's state and trace's position to path
+        void save_checkpoint(const char* path, TraceReader& trace);
+        // Loads a checkpoint saved by a hierarchy of the same geometry and
+        // page map, and moves trace to where it was taken; returns the
+        // accesses simulated up to there. cold[0] and cold[1] get the
+        // CKPT_COLD_* bits of L1 and L2 (parts unlike the saved ones, which
+        // start cold). The timing model isn't saved, so it starts idle.
+        uint64_t restore_checkpoint(const char* path, TraceReader& trace, uint32_t* cold);
+
+    private:
+        Hierarchy(const Hierarchy&);
+        Hierarchy& operator=(const Hierarchy&);
+};
+
+Hierarchy::Hierarchy(const cache_params_t& params){
+    this->params = params;
+
+    bool has_l2 = (params.l2_size > 0);
+    Prefetcher* l1_pref = make_prefetcher(this->prefetcher_kind(1), params.pref_n, params.pref_m, params.pref_degree);
+    Prefetcher* l2_pref = has_l2 ? make_prefetcher(this->prefetcher_kind(2), params.pref_n, params.pref_m, params.pref_degree) : NULL;
+
+    // Specialized for the geometry when it's a common one; see fixed_cache.h
+    this->l2_cache = make_cache(2, params.l2_size, params.l2_assoc, l2_block_size(params), params.l2_repl, l2_pref,
+                                NULL, &this->memory, INCL_NINE, 0, sectors_of(params.l2_sectors));
+    this->l1_cache = make_cache(1, params.l1_size, params.l1_assoc, params.blocksize, params.l1_repl, l1_pref,
+                                has_l2 ? this->l2_cache : NULL, &this->memory, INCL_NINE, 0, sectors_of(params.l1_sectors));
+
+    if (params.llc_reuse != REUSE_NONE){
+        Cache* llc = this->last_level();
+        llc->set_reuse_predictor(make_reuse_predictor(params.llc_reuse, params.llc_reuse_mode, llc->get_sets_num(), llc->get_assoc()));
+    }
+
+    this->timing = NULL;
+    if (params.timing_enabled){
+        // memory transfers are the last level's sectors
+        this->timing = new TimingModel(params.timing, this->last_level()->get_sector_size(), 2);
+        this->l1_cache->timing = this->timing;
+        this->l2_cache->timing = this->timing;
+        this->memory.timing    = this->timing;
+    }
+
+    this->events   = NULL;
+    this->page_map = NULL;
+    if (params.page_map.kind != PAGE_MAP_NONE){
+        this->page_map = new PageMapper(params.page_map);
+        limit_prefetcher_to_pages(this->l1_cache, this->page_map);
+        limit_prefetcher_to_pages(this->l2_cache, this->page_map);
+    }
+}
+
+Hierarchy::~Hierarchy(){
+    delete this->l1_cache;
+    delete this->l2_cache;
+    delete this->timing;
+    delete this->page_map;
+}
+
+void Hierarchy::save_checkpoint(const char* path, TraceReader& trace){
+    CheckpointWriter w;
+    trace_position_t p = trace.tell();
+
+    size_t body = w.begin_section(CKPT_TRACE);
+    w.put(p.records);
+    w.put(p.offset);
+    w.put(p.line_num);
+    w.put(p.prev_addr);
+    w.put(trace.size());
+    w.put(trace.identity());
+    w.put<uint8_t>(trace.binary);
+    w.end_section(body);
+
+    body = w.begin_section(CKPT_MEMORY);
+    w.put(this->memory.read_count);
+    w.put(this->memory.write_count);
+    w.put(this->memory.prefetch_count);
+    w.end_section(body);
+
+    this->l1_cache->save(w);
+    this->l2_cache->save(w);
+
+    body = w.begin_section(CKPT_PAGE_MAP);
+    w.put<uint8_t>(this->page_map != NULL);
+    if (this->page_map){
+        this->page_map->save(w);
+    }
+    w.end_section(body);
+
+    if (!w.write_file(path)){
+        printf("Error: Unable to write checkpoint %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+}
+
+uint64_t Hierarchy::restore_checkpoint(const char* path, TraceReader& trace, uint32_t* cold){
+    CheckpointReader r;
+    size_t end;
+    if (!r.open(path)){
+        printf("Error: Unable to open checkpoint %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    trace_position_t p;
+    r.expect_section(CKPT_TRACE, &end);
+    p.records   = r.get<uint64_t>();
+    p.offset    = r.get<uint64_t>();
+    p.line_num  = r.get<uint64_t>();
+    p.prev_addr = r.get<uint64_t>();
+    uint64_t size     = r.get<uint64_t>();
+    uint64_t identity = r.get<uint64_t>();
+    bool binary       = r.get<uint8_t>() != 0;
+    r.end_section(end);
+    // a streamed trace has no size to compare
+    if (binary != trace.binary || identity != trace.identity() || (size != 0 && trace.size() != 0 && size != trace.size())){
+        printf("Error: Checkpoint %s was taken on another trace.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    r.expect_section(CKPT_MEMORY, &end);
+    this->memory.read_count     = r.get<uint64_t>();
+    this->memory.write_count    = r.get<uint64_t>();
+    this->memory.prefetch_count = r.get<uint64_t>();
+    r.end_section(end);
+
+    cold[0] = this->l1_cache->load(r);
+    cold[1] = this->l2_cache->load(r);
+
+    r.expect_section(CKPT_PAGE_MAP, &end);
+    if ((r.get<uint8_t>() != 0) != (this->page_map != NULL)){
+        printf("Error: Checkpoint %s was taken with another page map.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (this->page_map){
+        this->page_map->load(r);
+    }
+    r.end_section(end);
+
+    if (!trace.seek(p)){
+        printf("Error: %s ends before checkpoint %s (access %llu).\n", trace.path, path, (unsigned long long) p.records);
+        exit(EXIT_FAILURE);
+    }
+    return p.records;
+}
+
+measurements_t Hierarchy::stats(){
+    Cache* l1_cache = this->l1_cache;
+    Cache* l2_cache = this->l2_cache;
+    measurements_t m;
+
+    m.l1_reads                = l1_cache->read_count;
+    m.l1_read_misses          = l1_cache->read_miss_count;
+    m.l1_writes               = l1_cache->write_count;
+    m.l1_write_misses         = l1_cache->write_miss_count;
+    m.l1_miss_rate            = ( (double)(l1_cache->read_miss_count + l1_cache->write_miss_count) / (double) (l1_cache->read_count + l1_cache->write_count) );
+    m.l1_writebacks           = l1_cache->writebacks_to_next_lvl_count;
+    m.l1_prefetches           = l1_cache->prefetches_to_next_lvl_count;
+    m.l2_reads                = l2_cache->read_count;
+    m.l2_read_misses          = l2_cache->read_miss_count;
+    m.l2_prefetch_reads       = l2_cache->read_from_prefetch_count;
+    m.l2_prefetch_read_misses = l2_cache->read_miss_from_prefetch_count;
+    m.l2_writes               = l2_cache->write_count;
+    m.l2_write_misses         = l2_cache->write_miss_count;
+    m.l2_miss_rate            = (this->params.l2_size > 0) ? ((double)(l2_cache->read_miss_count) / (double) (l2_cache->read_count)) : (double) 0;
+    m.l2_writebacks           = l2_cache->writebacks_to_next_lvl_count;
+    m.l2_prefetches           = l2_cache->prefetches_to_next_lvl_count;
+    m.mem_traffic             = this->memory.op_count();
+    return m;
+}
+
+reuse_outcome_t Hierarchy::llc_outcome(){
+    Cache* llc = this->last_level();
+    reuse_outcome_t o;
+
+    o.accesses    = (uint64_t) llc->read_count + llc->write_count;
+    o.misses      = (uint64_t) llc->read_miss_count + llc->write_miss_count;
+    o.mem_traffic = this->memory.op_count();
+    o.mem_bytes   = llc->fill_bytes + llc->prefetch_bytes + llc->writeback_bytes;
+    return o;
+}
+
+prefetcher_stats_t Hierarchy::prefetcher_stats(uint32_t lvl){
+    Cache* cache   = (lvl == 1) ? this->l1_cache : this->l2_cache;
+    Prefetcher* pf = cache->get_prefetcher();
+    prefetcher_stats_t s;
+
+    s.kind          = pf->kind();
+    s.issued        = pf->issued;
+    s.useful        = pf->useful;
+    s.late          = pf->late;
+    s.useless       = pf->useless;
+    s.demand_misses = cache->read_miss_count + cache->write_miss_count;
+    return s;
+}
+
+#endif // HIERARCHY_H
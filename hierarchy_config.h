@@ -0,0 +1,446 @@
+#ifndef HIERARCHY_CONFIG_H
+#define HIERARCHY_CONFIG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "cachesim.h"
+#include "fixed_cache.h"
+#include "trace_reader.h"
+
+using namespace std;
+
+/*  A hierarchy of any depth described by a config file:
+
+        ./sim hierarchy server.cfg traces/gcc_trace.txt [--timing ...]
+
+    Config file: a "blocksize" line, then one line per level from the top
+    down; '#' starts a comment. A level is L1 or a split L1I + L1D pair,
+    then L2, L3, ... Every field but size and assoc is optional:
+
+        blocksize 64
+        L1I size=32768 assoc=8
+        L1D size=49152 assoc=12 repl=plru pref=stride victim=8
+        L2  size=1310720 assoc=10 inclusion=exclusive
+        L3  size=4194304 assoc=16 repl=drrip pref=stream pref_n=4 pref_m=8 inclusion=inclusive latency=40 mshrs=64
+
+        repl=POLICY       replacement policy (lru)
+        pref=KIND         prefetcher (none); stream buffers take pref_n and
+                          pref_m, nextline/stride/ghb take degree (4)
+        inclusion=POLICY  with respect to the level(s) right above: nine
+                          (default), inclusive (its victims are evicted from
+                          every level above, back-invalidation) or exclusive
+                          (only holds blocks evicted from above; hits move
+                          the block up)
+        victim=N          N-entry victim cache behind the level (0)
+        block=BYTES       line size of the level (blocksize); no smaller
+                          than the lines of the levels above, and equal to
+                          them for an exclusive level
+        sectors=N         sectors per line (1): a power of 2 up to 8, each
+                          with its own valid and dirty bits, fetched,
+                          written back and prefetched on its own (not with
+                          a victim cache or exclusive)
+        latency=N         timing model overrides for the level; L1I and L1D
+        mshrs=N           share the level 1 MSHRs
+
+    Levels with their own line sizes or sectors add the bytes every level
+    moved to the output.
+
+    Trace requests go to the L1 (data) cache; with a split L1, 'i' requests
+    (instruction fetches, text traces only) go to L1I as reads.
+*/
+
+#define MAX_LEVELS 8
+
+typedef struct {
+    char name[8];               // L1, L1I, L1D, L2, ...
+    uint32_t lvl;
+    uint32_t size;
+    uint32_t assoc;
+    repl_policy_t repl;
+    prefetcher_kind_t pref;
+    uint32_t pref_n;
+    uint32_t pref_m;
+    uint32_t pref_degree;
+    inclusion_t inclusion;
+    uint32_t victim_entries;
+    uint32_t block;             // line size; 0 until the config is loaded, then blocksize unless set
+    uint32_t sectors;
+    uint32_t latency;           // 0: the timing model's default for the level
+    uint32_t mshrs;
+} level_config_t;
+
+typedef struct {
+    uint32_t blocksize;
+    vector<level_config_t> levels;  // top down, L1I before L1D
+} hierarchy_config_t;
+
+// Whether any level has its own line size or sectors
+static bool has_line_options(const hierarchy_config_t& config){
+    for (size_t i = 0; i < config.levels.size(); i++) {
+        if (config.levels[i].block != config.blocksize || config.levels[i].sectors > 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_pow2(uint32_t v){
+    return v > 0 && (v & (v - 1)) == 0;
+}
+
+// Reads a config file (format above); exits on errors
+static void load_hierarchy_config(const char* config_file, hierarchy_config_t& config){
+    FILE* fp = fopen(config_file, "r");
+    if (fp == (FILE *) NULL) {
+       printf("Error: Unable to open file %s\n", config_file);
+       exit(EXIT_FAILURE);
+    }
+
+    config.blocksize = 0;
+    char line[512];
+    uint32_t line_num = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_num++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        char* token = strtok(line, " \t\r\n");
+        if (token == NULL) {
+            continue; // blank line
+        }
+        if (strcmp(token, "blocksize") == 0) {
+            char* value = strtok(NULL, " \t\r\n");
+            config.blocksize = (value != NULL) ? (uint32_t) atoi(value) : 0;
+            if (!is_pow2(config.blocksize)) {
+                printf("Error: Block size must be a power of 2 (line %u of %s).\n", line_num, config_file);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
+
+        level_config_t l;
+        memset(&l, 0, sizeof(l));
+        l.repl        = REPL_LRU;
+        l.pref        = PREF_NONE;
+        l.pref_degree = 4;
+        l.inclusion   = INCL_NINE;
+        l.sectors     = 1;
+        if (token[0] != 'L' || strlen(token) >= sizeof(l.name)) {
+            printf("Error: Expected blocksize or a level name on line %u of %s.\n", line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        strcpy(l.name, token);
+        l.lvl = (uint32_t) atoi(token + 1);
+
+        while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+            char* eq = strchr(token, '=');
+            if (eq == NULL) {
+                printf("Error: Expected key=value but got %s (line %u of %s).\n", token, line_num, config_file);
+                exit(EXIT_FAILURE);
+            }
+            *eq = '\0';
+            const char* key   = token;
+            const char* value = eq + 1;
+            if (strcmp(key, "size") == 0)           l.size           = (uint32_t) atoi(value);
+            else if (strcmp(key, "assoc") == 0)     l.assoc          = (uint32_t) atoi(value);
+            else if (strcmp(key, "pref_n") == 0)    l.pref_n         = (uint32_t) atoi(value);
+            else if (strcmp(key, "pref_m") == 0)    l.pref_m         = (uint32_t) atoi(value);
+            else if (strcmp(key, "degree") == 0)    l.pref_degree    = (uint32_t) atoi(value);
+            else if (strcmp(key, "victim") == 0)    l.victim_entries = (uint32_t) atoi(value);
+            else if (strcmp(key, "block") == 0)     l.block          = (uint32_t) parse_bytes(value);
+            else if (strcmp(key, "sectors") == 0)   l.sectors        = (uint32_t) atoi(value);
+            else if (strcmp(key, "latency") == 0)   l.latency        = (uint32_t) atoi(value);
+            else if (strcmp(key, "mshrs") == 0)     l.mshrs          = (uint32_t) atoi(value);
+            else if (strcmp(key, "repl") == 0)      l.repl           = parse_repl_policy(value);
+            else if (strcmp(key, "pref") == 0)      l.pref           = parse_prefetcher(value);
+            else if (strcmp(key, "inclusion") == 0) l.inclusion      = parse_inclusion(value);
+            else {
+                printf("Error: Unknown level field %s (line %u of %s).\n", key, line_num, config_file);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (l.repl == REPL_NUM_POLICIES || l.pref == PREF_NUM_KINDS || l.pref == PREF_DEFAULT || l.inclusion == INCL_NUM_POLICIES) {
+            printf("Error: Unknown replacement policy, prefetcher or inclusion policy (line %u of %s).\n", line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        if (l.pref == PREF_STREAM && (l.pref_n == 0 || l.pref_m == 0)) {
+            printf("Error: Stream buffers need pref_n > 0 and pref_m > 0 (line %u of %s).\n", line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        if (!is_pow2(l.sectors) || l.sectors > MAX_SECTORS) {
+            printf("Error: Sectors per line must be a power of 2 up to %u (line %u of %s).\n", MAX_SECTORS, line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        if (l.sectors > 1 && (l.victim_entries > 0 || l.inclusion == INCL_EXCLUSIVE)) {
+            printf("Error: A sectored level can't have a victim cache or be exclusive (line %u of %s).\n", line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        config.levels.push_back(l);
+    }
+    fclose(fp);
+
+    // Level names and order: L1 or L1I L1D, then L2, L3, ...
+    vector<level_config_t>& levels = config.levels;
+    bool split = (levels.size() >= 2 && strcmp(levels[0].name, "L1I") == 0 && strcmp(levels[1].name, "L1D") == 0);
+    size_t first_shared = split ? 2 : 1;
+    bool valid = (config.blocksize > 0 && levels.size() >= first_shared && levels.size() - first_shared < MAX_LEVELS);
+    if (valid && !split) {
+        valid = (strcmp(levels[0].name, "L1") == 0);
+    }
+    for (size_t i = first_shared; valid && i < levels.size(); i++) {
+        char expected[24];
+        snprintf(expected, sizeof(expected), "L%zu", i - first_shared + 2);
+        valid = (strcmp(levels[i].name, expected) == 0);
+    }
+    if (!valid) {
+        printf("Error: %s needs a blocksize line, then L1 (or L1I and L1D), L2, L3, ... in order.\n", config_file);
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < levels.size(); i++) {
+        level_config_t& l = levels[i];
+        if (l.block == 0) {
+            l.block = config.blocksize;
+        }
+        if (!is_pow2(l.block) || l.sectors > l.block) {
+            printf("Error: %s block size must be a power of 2 (and at least its sectors).\n", l.name);
+            exit(EXIT_FAILURE);
+        }
+        if (l.assoc == 0 || l.size % (l.assoc * l.block) != 0 || !is_pow2(l.size / (l.assoc * l.block))) {
+            printf("Error: %s size must be a power of 2 number of sets of assoc blocks.\n", l.name);
+            exit(EXIT_FAILURE);
+        }
+        for (size_t j = 0; j < i; j++) {
+            const level_config_t& upper = levels[j];
+            if (upper.lvl + 1 != l.lvl) {
+                continue;
+            }
+            if (l.block < upper.block || (l.inclusion == INCL_EXCLUSIVE && (l.block != upper.block || upper.sectors > 1))) {
+                printf("Error: %s blocks must be at least as large as %s's (and the same size, unsectored, if exclusive).\n",
+                       l.name, upper.name);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (l.lvl == 1 && l.inclusion != INCL_NINE) {
+            printf("Error: %s has no level above it to be inclusive or exclusive of.\n", l.name);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+class ConfigHierarchy {
+    public:
+        hierarchy_config_t config;
+        vector<Cache*> caches;  // in config order
+        Cache* l1i;             // NULL without a split L1
+        Cache* l1d;             // the L1 (data) cache
+        MainMemory memory;
+        TimingModel* timing;    // NULL unless timing_enabled
+        PageMapper* page_map;   // NULL unless page_map.kind != PAGE_MAP_NONE
+
+        ConfigHierarchy(const hierarchy_config_t& config, bool timing_enabled, const timing_params_t& timing,
+                        const page_map_params_t& page_map);
+        ~ConfigHierarchy();
+
+        // rw is 'r', 'w' or 'i'
+        void access(char rw, addr_t addr){
+            if (this->page_map) addr = this->page_map->translate(addr);
+            if (this->timing) this->timing->begin();
+            if (rw == 'w'){
+                this->l1d->write(addr);
+            }else if (rw == 'i' && this->l1i != NULL){
+                this->l1i->read(addr);
+            }else{
+                this->l1d->read(addr);
+            }
+            if (this->timing) this->timing->end();
+        }
+
+    private:
+        ConfigHierarchy(const ConfigHierarchy&);
+        ConfigHierarchy& operator=(const ConfigHierarchy&);
+};
+
+ConfigHierarchy::ConfigHierarchy(const hierarchy_config_t& config, bool timing_enabled, const timing_params_t& timing,
+                                 const page_map_params_t& page_map){
+    this->config = config;
+    this->caches.assign(config.levels.size(), NULL);
+
+    // Bottom up, so each level can be linked to the one below
+    Cache* next = NULL;
+    for (size_t i = config.levels.size(); i-- > 0; ){
+        const level_config_t& l = config.levels[i];
+        Prefetcher* pref = make_prefetcher(l.pref, l.pref_n, l.pref_m, l.pref_degree);
+        this->caches[i] = make_cache(l.lvl, l.size, l.assoc, l.block, l.repl, pref, next, &this->memory,
+                                     l.inclusion, l.victim_entries, l.sectors);
+        if (l.lvl > 1){
+            next = this->caches[i]; // L1I and L1D share the level below
+        }
+    }
+    this->l1i = NULL;
+    this->l1d = this->caches[0];
+    if (strcmp(config.levels[0].name, "L1I") == 0){
+        this->l1i = this->caches[0];
+        this->l1d = this->caches[1];
+    }
+    for (size_t i = 0; i < this->caches.size(); i++){
+        for (size_t j = 0; j < this->caches.size(); j++){
+            if (config.levels[j].lvl + 1 == config.levels[i].lvl){
+                this->caches[i]->upper_caches.push_back(this->caches[j]);
+            }
+        }
+    }
+
+    this->timing = NULL;
+    if (timing_enabled){
+        uint32_t levels = config.levels.back().lvl;
+        // memory transfers are the last level's sectors
+        this->timing = new TimingModel(timing, this->caches.back()->get_sector_size(), levels);
+        for (size_t i = 0; i < this->caches.size(); i++){
+            const level_config_t& l = config.levels[i];
+            if (l.latency > 0 || l.mshrs > 0){
+                uint32_t latency[] = { timing.l1_latency, timing.l2_latency, timing.l3_latency };
+                uint32_t entries[] = { timing.l1_mshrs, timing.l2_mshrs, timing.l3_mshrs };
+                this->timing->configure_level(l.lvl, (l.latency > 0) ? l.latency : latency[min(l.lvl, 3u) - 1],
+                                              (l.mshrs > 0) ? l.mshrs : entries[min(l.lvl, 3u) - 1]);
+            }
+            this->caches[i]->timing = this->timing;
+        }
+        this->memory.timing = this->timing;
+    }
+
+    this->page_map = NULL;
+    if (page_map.kind != PAGE_MAP_NONE){
+        this->page_map = new PageMapper(page_map);
+        for (size_t i = 0; i < this->caches.size(); i++){
+            limit_prefetcher_to_pages(this->caches[i], this->page_map);
+        }
+    }
+}
+
+ConfigHierarchy::~ConfigHierarchy(){
+    for (size_t i = 0; i < this->caches.size(); i++){
+        delete this->caches[i];
+    }
+    delete this->timing;
+    delete this->page_map;
+}
+
+void print_config_hierarchy(ConfigHierarchy& h, const char* trace_file, bool timing_enabled, const timing_params_t& timing,
+                            const page_map_params_t& page_map){
+    const hierarchy_config_t& config = h.config;
+    bool any_pref = false;
+
+    printf("===== Hierarchy configuration =====\n");
+    printf("BLOCKSIZE:  %u\n", config.blocksize);
+    if (h.page_map) {
+        print_page_map(page_map, h.page_map);
+    }
+    printf("%-5s %10s %6s %-7s %-9s %-10s %7s\n", "level", "size", "assoc", "repl", "pref", "inclusion", "victim");
+    for (size_t i = 0; i < config.levels.size(); i++) {
+        const level_config_t& l = config.levels[i];
+        printf("%-5s %10u %6u %-7s %-9s %-10s %7u\n", l.name, l.size, l.assoc, repl_policy_names[l.repl],
+               prefetcher_names[l.pref], inclusion_names[l.inclusion], l.victim_entries);
+        any_pref |= (l.pref != PREF_NONE);
+    }
+    printf("trace_file: %s\n", trace_file);
+    printf("\n");
+
+    // Miss rate as in the a-q measurements: reads and writes at L1, demand
+    // reads below (where the writes are writebacks)
+    printf("===== Measurements =====\n");
+    printf("%-5s %10s %10s %10s %10s %9s %10s %10s %10s %10s %8s %10s\n", "level", "reads", "read_miss", "writes",
+           "write_miss", "miss_rate", "writebacks", "prefetches", "pref_reads", "pref_rmiss", "vc_hits", "back_inval");
+    for (size_t i = 0; i < config.levels.size(); i++) {
+        Cache* c = h.caches[i];
+        uint64_t accesses = c->read_count + ((config.levels[i].lvl == 1) ? c->write_count : 0);
+        uint64_t misses   = c->read_miss_count + ((config.levels[i].lvl == 1) ? c->write_miss_count : 0);
+        printf("%-5s %10llu %10llu %10llu %10llu %9.4f %10llu %10llu %10llu %10llu %8llu %10llu\n", config.levels[i].name,
+               (unsigned long long) c->read_count, (unsigned long long) c->read_miss_count,
+               (unsigned long long) c->write_count, (unsigned long long) c->write_miss_count,
+               (accesses > 0) ? (double) misses / (double) accesses : 0, (unsigned long long) c->writebacks_to_next_lvl_count,
+               (unsigned long long) c->prefetches_to_next_lvl_count, (unsigned long long) c->read_from_prefetch_count,
+               (unsigned long long) c->read_miss_from_prefetch_count,
+               (unsigned long long) (c->get_victim_cache() ? c->get_victim_cache()->hits : 0),
+               (unsigned long long) c->back_invalidations);
+    }
+    printf("%-33s %llu\n", "memory traffic: ", (unsigned long long) h.memory.op_count());
+
+    if (has_line_options(config)) {
+        vector<const char*> names;
+        for (size_t i = 0; i < config.levels.size(); i++) {
+            names.push_back(config.levels[i].name);
+        }
+        printf("\n");
+        print_traffic(names.data(), h.caches.data(), h.caches.size());
+    }
+
+    if (any_pref) {
+        printf("\n");
+        printf("===== Prefetchers =====\n");
+        printf("    %-9s %10s %10s %10s %10s %9s %9s %10s\n", "kind", "issued", "useful", "late", "useless",
+               "coverage", "accuracy", "timeliness");
+        for (size_t i = 0; i < config.levels.size(); i++) {
+            Prefetcher* pf = h.caches[i]->get_prefetcher();
+            if (pf == NULL) {
+                continue;
+            }
+            prefetcher_stats_t s;
+            s.kind          = pf->kind();
+            s.issued        = pf->issued;
+            s.useful        = pf->useful;
+            s.late          = pf->late;
+            s.useless       = pf->useless;
+            s.demand_misses = h.caches[i]->read_miss_count + h.caches[i]->write_miss_count;
+            char label[8];
+            snprintf(label, sizeof(label), "%-3s", config.levels[i].name);
+            print_prefetcher_stats(label, s, timing_enabled);
+        }
+    }
+    if (timing_enabled) {
+        printf("\n");
+        print_timing(timing, h.timing->report());
+    }
+}
+
+// Simulates trace_file on the hierarchy of config_file and prints the results
+int run_config_hierarchy(const char* config_file, const char* trace_file, bool timing_enabled, const timing_params_t& timing,
+                         const page_map_params_t& page_map){
+    hierarchy_config_t config;
+    load_hierarchy_config(config_file, config);
+    uint32_t largest_block = config.levels.back().block; // blocks only grow going down
+    if (timing_enabled && timing_params_error(timing, largest_block) != NULL) {
+        printf("Error: %s\n", timing_params_error(timing, largest_block));
+        exit(EXIT_FAILURE);
+    }
+    if (page_map.kind != PAGE_MAP_NONE && page_map_params_error(page_map, largest_block) != NULL) {
+        printf("Error: %s\n", page_map_params_error(page_map, largest_block));
+        exit(EXIT_FAILURE);
+    }
+
+    ConfigHierarchy h(config, timing_enabled, timing, page_map);
+    TraceReader trace;
+    static trace_record batch[TRACE_BATCH_SIZE];
+    if (!trace.open(trace_file)) {
+       printf("Error: Unable to open file %s\n", trace_file);
+       exit(EXIT_FAILURE);
+    }
+    uint32_t n;
+    while ((n = trace.next_batch(batch, TRACE_BATCH_SIZE)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i].rw != 'r' && batch[i].rw != 'w' && batch[i].rw != 'i'){
+                printf("Error: Unknown request type %c.\n", batch[i].rw);
+                exit(EXIT_FAILURE);
+            }
+            h.access(batch[i].rw, batch[i].addr);
+        }
+    }
+    trace.close();
+
+    print_config_hierarchy(h, trace_file, timing_enabled, timing, page_map);
+    return(0);
+}
+
+#endif // HIERARCHY_CONFIG_H
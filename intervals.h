@@ -0,0 +1,108 @@
+#ifndef INTERVALS_H
+#define INTERVALS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "cachesim.h"
+#include "hierarchy.h"
+
+using namespace std;
+
+/*  Per-interval statistics: the a-q counters are sampled every `every`
+    accesses, and each interval gets its own miss rates, misses per 1000
+    accesses (the traces carry no instruction counts, so this stands in for
+    MPKI), memory traffic and prefetch accuracy, to show phase behaviour
+    over the run. Sampling reads the counters the hierarchy keeps anyway,
+    so only the run loop's batches (cut at interval ends) change.
+*/
+
+typedef struct {
+    measurements_t m;
+    uint64_t pf_issued;     // summed over the levels with a prefetcher
+    uint64_t pf_useful;
+} interval_counts_t;
+
+typedef struct {
+    uint64_t end;           // last access of the interval
+    uint64_t accesses;
+    uint64_t l1_accesses, l1_misses;
+    uint64_t l2_reads, l2_read_misses;
+    uint64_t mem_traffic;
+    uint64_t pf_issued, pf_useful;
+} interval_row_t;
+
+class IntervalStats {
+    private:
+        interval_counts_t last;
+        uint64_t last_access;
+
+        static interval_counts_t counts(Hierarchy& h){
+            interval_counts_t c;
+            c.m         = h.stats();
+            c.pf_issued = 0;
+            c.pf_useful = 0;
+            for (uint32_t lvl = 1; lvl <= ((h.params.l2_size > 0) ? 2 : 1); lvl++){
+                if (h.prefetcher_kind(lvl) != PREF_NONE){
+                    prefetcher_stats_t s = h.prefetcher_stats(lvl);
+                    c.pf_issued += s.issued;
+                    c.pf_useful += s.useful;
+                }
+            }
+            return c;
+        }
+
+    public:
+        uint64_t every;
+        vector<interval_row_t> rows;
+
+        // Intervals start at access start (past a restored checkpoint's accesses)
+        IntervalStats(uint64_t every, Hierarchy& h, uint64_t start){
+            this->every       = every;
+            this->last        = counts(h);
+            this->last_access = start;
+        }
+
+        // Closes the interval ending with access end
+        void sample(Hierarchy& h, uint64_t end){
+            interval_counts_t c = counts(h);
+            interval_row_t r;
+            r.end            = end;
+            r.accesses       = end - this->last_access;
+            r.l1_accesses    = (c.m.l1_reads + c.m.l1_writes) - (this->last.m.l1_reads + this->last.m.l1_writes);
+            r.l1_misses      = (c.m.l1_read_misses + c.m.l1_write_misses) - (this->last.m.l1_read_misses + this->last.m.l1_write_misses);
+            r.l2_reads       = c.m.l2_reads - this->last.m.l2_reads;
+            r.l2_read_misses = c.m.l2_read_misses - this->last.m.l2_read_misses;
+            r.mem_traffic    = c.m.mem_traffic - this->last.m.mem_traffic;
+            r.pf_issued      = c.pf_issued - this->last.pf_issued;
+            r.pf_useful      = c.pf_useful - this->last.pf_useful;
+            this->rows.push_back(r);
+            this->last        = c;
+            this->last_access = end;
+        }
+
+        void print(){
+            printf("===== Intervals (every %llu accesses) =====\n", (unsigned long long) this->every);
+            printf("%12s %12s %10s %12s %10s %10s %10s %11s\n", "access", "L1_miss_rate", "L1_MPKA", "L2_miss_rate",
+                   "L2_MPKA", "mem_PKA", "pf_issued", "pf_accuracy");
+            for (size_t i = 0; i < this->rows.size(); i++){
+                const interval_row_t& r = this->rows[i];
+                double ka = r.accesses / 1000.0;
+                printf("%12llu %12.4f %10.2f ", (unsigned long long) r.end,
+                       r.l1_accesses ? (double) r.l1_misses / r.l1_accesses : 0.0, r.l1_misses / ka);
+                if (r.l2_reads > 0){
+                    printf("%12.4f ", (double) r.l2_read_misses / r.l2_reads);
+                }else{
+                    printf("%12s ", "-");
+                }
+                printf("%10.2f %10.2f %10llu ", r.l2_read_misses / ka, r.mem_traffic / ka, (unsigned long long) r.pf_issued);
+                if (r.pf_issued > 0){
+                    printf("%11.4f\n", (double) r.pf_useful / r.pf_issued);
+                }else{
+                    printf("%11s\n", "-");
+                }
+            }
+        }
+};
+
+#endif // INTERVALS_H
@@ -0,0 +1,503 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "cachesim.h"
+#include "fixed_cache.h"
+#include "trace_reader.h"
+
+using namespace std;
+
+/*  Multi-core simulation: every core runs its own trace through private L1
+    (and optionally L2) caches, and all of them share the last-level cache
+    (LLC) and main memory.
+
+        ./sim multicore 32 8192 4 1048576 16 3 10 t0.txt t1.txt t2.txt t3.txt
+              [--private-l2=SIZE,ASSOC] [--interleave=rr|timing]
+
+    The 7 numbers are those of the usual command line, with the L2 ones
+    describing the shared LLC; one core per trace. The replacement,
+    prefetcher and timing options apply as usual, the L2 ones to the LLC
+    (the private caches get the L1 replacement policy and no prefetcher:
+    their fills would bypass the coherence protocol).
+
+    Coherence: MESI by snooping the other cores' private caches. A private
+    block's MESI state is in its state bits: M is BLOCK_DIRTY, E is
+    BLOCK_EXCLUSIVE, S is neither. Before a request reaches its core's
+    private caches:
+      - a read of a block the core doesn't hold snoops the others: an M copy
+        is flushed to the LLC (a cache-to-cache transfer) and every copy
+        drops to S. The requester gets the block in E if no other core had
+        it, else in S.
+      - a write to a block the core doesn't hold in E or M invalidates every
+        other copy, flushing an M one to the LLC first (an upgrade if the
+        requester had it in S, which costs an LLC lookup with timing on).
+        The requester ends up with the block in M.
+    Flushes go to the LLC so the requester's miss then finds the block
+    there. Private evictions are silent and the LLC doesn't enforce
+    inclusion, so snoops look at the private caches themselves.
+
+    Interleaving: round-robin, one request per core in turn; with the timing
+    model, the core whose next request issues first goes next (each core
+    issues one request per cycle), so faster cores run ahead.
+*/
+
+#define MAX_CORES 64
+
+typedef struct {
+    uint64_t requests;
+    uint64_t l1_accesses;
+    uint64_t l1_misses;
+    uint64_t l2_accesses;           // private L2
+    uint64_t l2_misses;
+    uint64_t llc_reads;             // demand reads its requests made of the LLC
+    uint64_t llc_read_misses;
+    uint64_t llc_writes;            // its writebacks and coherence flushes
+    uint64_t mem_traffic;           // memory operations caused by its requests
+    uint64_t invalidated;           // its copies invalidated by other cores' writes
+    uint64_t flushed;               // its M copies other cores' requests flushed (transfers)
+    uint64_t upgrades;              // its writes to blocks it held in S
+    uint64_t total_latency;         // timing only
+    uint64_t cycles;                // timing only: until its last request completes
+} core_stats_t;
+
+typedef struct {
+    uint64_t snoops;                // requests that had to look at the other cores
+    uint64_t invalidations;         // private copies (one per core) invalidated
+    uint64_t transfers;             // M copies flushed to another core through the LLC
+    uint64_t downgrades;            // E or M copies dropped to S by another core's read
+    uint64_t upgrades;              // S to M without a data transfer
+} coherence_stats_t;
+
+class MultiCore {
+    public:
+        cache_params_t params;      // L1 private, L2 the shared LLC
+        uint32_t private_l2_size;   // 0 without private L2s
+        uint32_t private_l2_assoc;
+        uint32_t cores_num;
+        vector<Cache*> l1_caches;
+        vector<Cache*> l2_caches;   // private; empty without private L2s
+        Cache* llc;
+        MainMemory memory;
+        TimingModel* timing;        // NULL unless params.timing_enabled
+        PageMapper* page_map;       // NULL without one; the cores are threads of one address space
+        fill_owners_t owners;       // of the LLC's blocks
+        vector<core_stats_t> core_stats;
+        coherence_stats_t coherence;
+
+        MultiCore(const cache_params_t& params, uint32_t cores, uint32_t private_l2_size, uint32_t private_l2_assoc);
+        ~MultiCore();
+
+        uint32_t llc_level(){ return this->l2_caches.empty() ? 2 : 3; }
+        // PREF_DEFAULT puts the stream buffers in the LLC when PREF_N > 0
+        prefetcher_kind_t llc_prefetcher_kind(){
+            prefetcher_kind_t kind = this->params.l2_pref;
+            if (kind == PREF_DEFAULT){
+                kind = (this->params.pref_n > 0) ? PREF_STREAM : PREF_NONE;
+            }
+            return kind;
+        }
+
+        // rw is 'r' or 'w'
+        void access(uint32_t core, char rw, addr_t addr);
+
+    private:
+        // OR of the state bits of core's private copies (0 if it has none)
+        uint8_t private_state(uint32_t core, addr_t addr);
+        void set_exclusive(uint32_t core, addr_t addr);
+        // Another core reads / writes addr; return true if core had a copy
+        bool share_copies(uint32_t core, addr_t addr);
+        bool invalidate_copies(uint32_t core, addr_t addr);
+        void flush(uint32_t core, addr_t addr);
+
+        MultiCore(const MultiCore&);
+        MultiCore& operator=(const MultiCore&);
+};
+
+MultiCore::MultiCore(const cache_params_t& params, uint32_t cores, uint32_t private_l2_size, uint32_t private_l2_assoc){
+    this->params           = params;
+    this->private_l2_size  = private_l2_size;
+    this->private_l2_assoc = private_l2_assoc;
+    this->cores_num        = cores;
+
+    uint32_t llc_lvl = (private_l2_size > 0) ? 3 : 2;
+    Prefetcher* llc_pref = make_prefetcher(this->llc_prefetcher_kind(), params.pref_n, params.pref_m, params.pref_degree);
+    this->llc = make_cache(llc_lvl, params.l2_size, params.l2_assoc, params.blocksize, params.l2_repl, llc_pref,
+                           NULL, &this->memory);
+    for (uint32_t c = 0; c < cores; c++){
+        Cache* next = this->llc;
+        if (private_l2_size > 0){
+            next = make_cache(2, private_l2_size, private_l2_assoc, params.blocksize, params.l1_repl, NULL, this->llc, &this->memory);
+            this->l2_caches.push_back(next);
+        }
+        this->l1_caches.push_back(make_cache(1, params.l1_size, params.l1_assoc, params.blocksize, params.l1_repl, NULL,
+                                             next, &this->memory));
+    }
+
+    size_t llc_sets = params.l2_size / (params.l2_assoc * params.blocksize);
+    size_t stride   = 1;
+    while (stride < params.l2_assoc){
+        stride <<= 1;
+    }
+    this->owners.core.assign(llc_sets * stride, 0);
+    this->owners.current = 0;
+    this->owners.lost_to_others.assign(cores, 0);
+    this->owners.evicted_others.assign(cores, 0);
+    this->llc->owners = &this->owners;
+
+    this->timing = NULL;
+    if (params.timing_enabled){
+        this->timing = new TimingModel(params.timing, params.blocksize, llc_lvl, cores, llc_lvl - 1);
+        for (uint32_t c = 0; c < cores; c++){
+            this->l1_caches[c]->timing = this->timing;
+            if (private_l2_size > 0){
+                this->l2_caches[c]->timing = this->timing;
+            }
+        }
+        this->llc->timing    = this->timing;
+        this->memory.timing  = this->timing;
+    }
+
+    this->page_map = NULL;
+    if (params.page_map.kind != PAGE_MAP_NONE){
+        this->page_map = new PageMapper(params.page_map);
+        limit_prefetcher_to_pages(this->llc, this->page_map);
+    }
+
+    core_stats_t zero;
+    memset(&zero, 0, sizeof(zero));
+    this->core_stats.assign(cores, zero);
+    memset(&this->coherence, 0, sizeof(this->coherence));
+}
+
+MultiCore::~MultiCore(){
+    for (uint32_t c = 0; c < this->cores_num; c++){
+        delete this->l1_caches[c];
+        if (!this->l2_caches.empty()){
+            delete this->l2_caches[c];
+        }
+    }
+    delete this->llc;
+    delete this->timing;
+    delete this->page_map;
+}
+
+uint8_t MultiCore::private_state(uint32_t core, addr_t addr){
+    uint8_t* l1 = this->l1_caches[core]->block_state(addr);
+    uint8_t* l2 = this->l2_caches.empty() ? NULL : this->l2_caches[core]->block_state(addr);
+    return (l1 ? *l1 : 0) | (l2 ? *l2 : 0);
+}
+
+void MultiCore::set_exclusive(uint32_t core, addr_t addr){
+    uint8_t* l1 = this->l1_caches[core]->block_state(addr);
+    uint8_t* l2 = this->l2_caches.empty() ? NULL : this->l2_caches[core]->block_state(addr);
+    if (l1) *l1 |= BLOCK_EXCLUSIVE;
+    if (l2) *l2 |= BLOCK_EXCLUSIVE;
+}
+
+// The LLC takes the dirty block; off the requester's critical path, which
+// then finds it in the LLC
+void MultiCore::flush(uint32_t core, addr_t addr){
+    this->coherence.transfers++;
+    this->core_stats[core].flushed++;
+    if (this->timing) this->timing->background++;
+    this->llc->write(addr);
+    if (this->timing) this->timing->background--;
+}
+
+bool MultiCore::share_copies(uint32_t core, addr_t addr){
+    uint8_t* copies[2] = { this->l1_caches[core]->block_state(addr),
+                           this->l2_caches.empty() ? NULL : this->l2_caches[core]->block_state(addr) };
+    uint8_t was = 0;
+    for (uint32_t i = 0; i < 2; i++){
+        if (copies[i]){
+            was |= *copies[i];
+            *copies[i] &= ~(BLOCK_DIRTY | BLOCK_EXCLUSIVE);
+        }
+    }
+    if (was & (BLOCK_DIRTY | BLOCK_EXCLUSIVE)){
+        this->coherence.downgrades++;
+    }
+    if (was & BLOCK_DIRTY){
+        this->flush(core, addr);
+    }
+    return was != 0;
+}
+
+bool MultiCore::invalidate_copies(uint32_t core, addr_t addr){
+    uint8_t was = this->l1_caches[core]->invalidate(addr);
+    if (!this->l2_caches.empty()){
+        was |= this->l2_caches[core]->invalidate(addr);
+    }
+    if (was == 0){
+        return false;
+    }
+    this->coherence.invalidations++;
+    this->core_stats[core].invalidated++;
+    if (was & BLOCK_DIRTY){
+        this->flush(core, addr);
+    }
+    return true;
+}
+
+void MultiCore::access(uint32_t core, char rw, addr_t addr){
+    if (this->page_map) addr = this->page_map->translate(addr);
+    core_stats_t& s  = this->core_stats[core];
+    Cache* l1        = this->l1_caches[core];
+    Cache* l2        = this->l2_caches.empty() ? NULL : this->l2_caches[core];
+    bool write       = (rw == 'w');
+    uint64_t l1_ops  = l1->read_count + l1->write_count;
+    uint64_t l1_miss = l1->read_miss_count + l1->write_miss_count;
+    uint64_t l2_ops  = l2 ? l2->read_count + l2->write_count : 0;
+    uint64_t l2_miss = l2 ? l2->read_miss_count + l2->write_miss_count : 0;
+    uint64_t llc_reads       = this->llc->read_count;
+    uint64_t llc_read_misses = this->llc->read_miss_count;
+    uint64_t llc_writes      = this->llc->write_count;
+    uint64_t mem_ops         = this->memory.op_count();
+
+    this->owners.current = core;
+    if (this->timing){
+        this->timing->set_core(core);
+        this->timing->begin();
+    }
+
+    uint8_t own = this->private_state(core, addr);
+    bool snoop  = (own == 0) || (write && !(own & (BLOCK_DIRTY | BLOCK_EXCLUSIVE)));
+    bool shared = false;
+    if (snoop){
+        this->coherence.snoops++;
+        if (own != 0){
+            // S -> M: the other copies go, the data stays
+            this->coherence.upgrades++;
+            s.upgrades++;
+            if (this->timing) this->timing->lookup(this->llc_level());
+        }
+        for (uint32_t c = 0; c < this->cores_num; c++){
+            if (c != core){
+                shared |= write ? this->invalidate_copies(c, addr) : this->share_copies(c, addr);
+            }
+        }
+    }
+
+    if (write){
+        l1->write(addr);
+    }else{
+        l1->read(addr);
+    }
+    if (snoop && (write || !shared)){
+        this->set_exclusive(core, addr);
+    }
+
+    if (this->timing){
+        this->timing->end();
+        s.total_latency += this->timing->latency;
+        s.cycles = max(s.cycles, this->timing->now + this->timing->latency);
+    }
+    s.requests++;
+    s.l1_accesses     += l1->read_count + l1->write_count - l1_ops;
+    s.l1_misses       += l1->read_miss_count + l1->write_miss_count - l1_miss;
+    if (l2){
+        s.l2_accesses += l2->read_count + l2->write_count - l2_ops;
+        s.l2_misses   += l2->read_miss_count + l2->write_miss_count - l2_miss;
+    }
+    s.llc_reads       += this->llc->read_count - llc_reads;
+    s.llc_read_misses += this->llc->read_miss_count - llc_read_misses;
+    s.llc_writes      += this->llc->write_count - llc_writes;
+    s.mem_traffic     += this->memory.op_count() - mem_ops;
+}
+
+static double share_of(uint64_t num, uint64_t den){
+    return (den > 0) ? (double) num / (double) den : 0;
+}
+
+void print_multicore(MultiCore& mc, const vector<char*>& trace_files, bool by_timing){
+    const cache_params_t& p = mc.params;
+    bool has_l2 = !mc.l2_caches.empty();
+    uint32_t llc_lvl = mc.llc_level();
+
+    printf("===== Multi-core configuration =====\n");
+    printf("CORES:      %u\n", mc.cores_num);
+    printf("BLOCKSIZE:  %u\n", p.blocksize);
+    printf("L1_SIZE:    %u (private)\n", p.l1_size);
+    printf("L1_ASSOC:   %u\n", p.l1_assoc);
+    if (has_l2) {
+        printf("L2_SIZE:    %u (private)\n", mc.private_l2_size);
+        printf("L2_ASSOC:   %u\n", mc.private_l2_assoc);
+    }
+    printf("LLC_SIZE:   %u (L%u, shared)\n", p.l2_size, llc_lvl);
+    printf("LLC_ASSOC:  %u\n", p.l2_assoc);
+    printf("PREF_N:     %u\n", p.pref_n);
+    printf("PREF_M:     %u\n", p.pref_m);
+    if (p.l1_repl != REPL_LRU || p.l2_repl != REPL_LRU) {
+        printf("L1_REPL:    %s\n", repl_policy_names[p.l1_repl]);
+        printf("LLC_REPL:   %s\n", repl_policy_names[p.l2_repl]);
+    }
+    printf("LLC_PREF:   %s\n", prefetcher_names[mc.llc_prefetcher_kind()]);
+    printf("INTERLEAVE: %s\n", by_timing ? "timing" : "round-robin");
+    if (mc.page_map) {
+        print_page_map(p.page_map, mc.page_map);
+    }
+    for (uint32_t c = 0; c < mc.cores_num; c++) {
+        printf("trace_file[%u]: %s\n", c, trace_files[c]);
+    }
+    printf("\n");
+
+    printf("===== Per-core measurements =====\n");
+    printf("%4s %10s %9s", "core", "requests", "L1_miss");
+    if (has_l2) printf(" %9s", "L2_miss");
+    printf(" %10s %10s %9s %10s %10s %11s %9s %8s %9s %11s", "LLC_reads", "LLC_rmiss", "LLC_rmr", "LLC_writes", "mem_ops",
+           "invalidated", "flushed", "upgrades", "LLC_lost", "LLC_evicted");
+    if (mc.timing) printf(" %12s %9s", "cycles", "AMAT");
+    printf("\n");
+    for (uint32_t c = 0; c < mc.cores_num; c++) {
+        const core_stats_t& s = mc.core_stats[c];
+        printf("%4u %10llu %9.4f", c, (unsigned long long) s.requests, share_of(s.l1_misses, s.l1_accesses));
+        if (has_l2) printf(" %9.4f", share_of(s.l2_misses, s.l2_accesses));
+        printf(" %10llu %10llu %9.4f %10llu %10llu %11llu %9llu %8llu %9llu %11llu",
+               (unsigned long long) s.llc_reads, (unsigned long long) s.llc_read_misses, share_of(s.llc_read_misses, s.llc_reads),
+               (unsigned long long) s.llc_writes, (unsigned long long) s.mem_traffic, (unsigned long long) s.invalidated,
+               (unsigned long long) s.flushed, (unsigned long long) s.upgrades,
+               (unsigned long long) mc.owners.lost_to_others[c], (unsigned long long) mc.owners.evicted_others[c]);
+        if (mc.timing) printf(" %12llu %9.4f", (unsigned long long) s.cycles, share_of(s.total_latency, s.requests));
+        printf("\n");
+    }
+    printf("\n");
+
+    Cache* llc = mc.llc;
+    uint64_t lost = 0;
+    for (uint32_t c = 0; c < mc.cores_num; c++) {
+        lost += mc.owners.lost_to_others[c];
+    }
+    printf("===== Shared LLC =====\n");
+    printf("%-33s %llu\n", "reads (demand): ", (unsigned long long) llc->read_count);
+    printf("%-33s %llu\n", "read misses (demand): ", (unsigned long long) llc->read_miss_count);
+    printf("%-33s %llu\n", "reads (prefetch): ", (unsigned long long) llc->read_from_prefetch_count);
+    printf("%-33s %llu\n", "read misses (prefetch): ", (unsigned long long) llc->read_miss_from_prefetch_count);
+    printf("%-33s %llu\n", "writes: ", (unsigned long long) llc->write_count);
+    printf("%-33s %llu\n", "write misses: ", (unsigned long long) llc->write_miss_count);
+    printf("%-33s %.4f\n", "miss rate: ", share_of(llc->read_miss_count, llc->read_count));
+    printf("%-33s %llu\n", "writebacks: ", (unsigned long long) llc->writebacks_to_next_lvl_count);
+    printf("%-33s %llu\n", "prefetches: ", (unsigned long long) llc->prefetches_to_next_lvl_count);
+    printf("%-33s %llu\n", "blocks evicted by another core: ", (unsigned long long) lost);
+    printf("%-33s %llu\n", "memory traffic: ", (unsigned long long) mc.memory.op_count());
+    printf("\n");
+
+    printf("===== Coherence (MESI) =====\n");
+    printf("%-33s %llu\n", "snoops: ", (unsigned long long) mc.coherence.snoops);
+    printf("%-33s %llu\n", "invalidations: ", (unsigned long long) mc.coherence.invalidations);
+    printf("%-33s %llu\n", "cache-to-cache transfers: ", (unsigned long long) mc.coherence.transfers);
+    printf("%-33s %llu\n", "downgrades to S: ", (unsigned long long) mc.coherence.downgrades);
+    printf("%-33s %llu\n", "upgrades S to M: ", (unsigned long long) mc.coherence.upgrades);
+
+    if (mc.llc_prefetcher_kind() != PREF_NONE) {
+        Prefetcher* pf = llc->get_prefetcher();
+        prefetcher_stats_t s;
+        s.kind          = pf->kind();
+        s.issued        = pf->issued;
+        s.useful        = pf->useful;
+        s.late          = pf->late;
+        s.useless       = pf->useless;
+        s.demand_misses = llc->read_miss_count + llc->write_miss_count;
+        printf("\n");
+        printf("===== Prefetchers =====\n");
+        printf("   %-9s %10s %10s %10s %10s %9s %9s %10s\n", "kind", "issued", "useful", "late", "useless",
+               "coverage", "accuracy", "timeliness");
+        print_prefetcher_stats((llc_lvl == 2) ? "L2" : "L3", s, mc.timing != NULL);
+    }
+    if (mc.timing) {
+        printf("\n");
+        print_timing(p.timing, mc.timing->report());
+    }
+}
+
+// One core per trace file; exits on errors
+int run_multicore(const cache_params_t& params, const vector<char*>& trace_files, uint32_t private_l2_size,
+                  uint32_t private_l2_assoc, bool by_timing){
+    uint32_t cores = trace_files.size();
+    if (cores == 0 || cores > MAX_CORES) {
+        printf("Error: Expected 1 to %u trace files (one per core).\n", MAX_CORES);
+        exit(EXIT_FAILURE);
+    }
+    if (params.l2_size == 0) {
+        printf("Error: Multi-core runs need a shared LLC (L2_SIZE > 0).\n");
+        exit(EXIT_FAILURE);
+    }
+    if (params.l1_pref != PREF_DEFAULT && params.l1_pref != PREF_NONE) {
+        printf("Error: Private caches can't have prefetchers in multi-core runs.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (by_timing && !params.timing_enabled) {
+        printf("Error: --interleave=timing needs --timing.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    MultiCore mc(params, cores, private_l2_size, private_l2_assoc);
+    vector<TraceReader*> traces(cores);
+    vector<vector<trace_record> > batches(cores, vector<trace_record>(TRACE_BATCH_SIZE));
+    vector<uint32_t> batch_n(cores, 0), batch_pos(cores, 0);
+    uint32_t active = cores;
+    for (uint32_t c = 0; c < cores; c++) {
+        traces[c] = new TraceReader();
+        if (!traces[c]->open(trace_files[c])) {
+            printf("Error: Unable to open file %s\n", trace_files[c]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Next request of core c; false once its trace is done
+    auto next = [&](uint32_t c, trace_record& rec) -> bool {
+        if (batch_pos[c] == batch_n[c]) {
+            batch_n[c]   = (traces[c] != NULL) ? traces[c]->next_batch(batches[c].data(), TRACE_BATCH_SIZE) : 0;
+            batch_pos[c] = 0;
+            if (batch_n[c] == 0) {
+                delete traces[c];
+                traces[c] = NULL;
+                return false;
+            }
+        }
+        rec = batches[c][batch_pos[c]++];
+        if (rec.rw != 'r' && rec.rw != 'w') {
+            printf("Error: Unknown request type %c.\n", rec.rw);
+            exit(EXIT_FAILURE);
+        }
+        return true;
+    };
+
+    vector<bool> done(cores, false);
+    trace_record rec;
+    while (active > 0) {
+        if (by_timing) {
+            uint32_t first = cores;
+            for (uint32_t c = 0; c < cores; c++) {
+                if (!done[c] && (first == cores || mc.timing->issue_cycle(c) < mc.timing->issue_cycle(first))) {
+                    first = c;
+                }
+            }
+            if (next(first, rec)) {
+                mc.access(first, rec.rw, rec.addr);
+            }else {
+                done[first] = true;
+                active--;
+            }
+            continue;
+        }
+        for (uint32_t c = 0; c < cores; c++) {
+            if (done[c]) {
+                continue;
+            }
+            if (next(c, rec)) {
+                mc.access(c, rec.rw, rec.addr);
+            }else {
+                done[c] = true;
+                active--;
+            }
+        }
+    }
+
+    print_multicore(mc, trace_files, by_timing);
+    return(0);
+}
+
+#endif // MULTICORE_H
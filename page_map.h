@@ -0,0 +1,200 @@
+#ifndef PAGE_MAP_H
+#define PAGE_MAP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <unordered_map>
+#include <unordered_set>
+#include "addr.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+/*  Optional virtual to physical translation in front of the hierarchy.
+    Traces hold virtual addresses, but real caches past the L1 (and L1s
+    bigger than a page per way) index with physical ones. With a page map
+    each trace address is translated before L1 sees it, so set conflicts
+    and the page boundaries prefetchers stop at are those of physical
+    memory.
+
+    Frames come from a pool of phys_mem bytes:
+        first-touch  frames in the order pages are first touched (a freshly
+                     booted machine: contiguous, little set aliasing)
+        random       uniformly random free frames (a long-running machine
+                     with fragmented memory)
+    page_size 4096 gives base pages; 2097152 or 1073741824 model huge pages.
+*/
+
+typedef enum {
+    PAGE_MAP_NONE = 0,      // the trace's addresses go to the caches as is
+    PAGE_MAP_FIRST_TOUCH,
+    PAGE_MAP_RANDOM,
+    PAGE_MAP_NUM_KINDS
+} page_map_kind_t;
+
+static const char* const page_map_names[PAGE_MAP_NUM_KINDS] = {
+    "none", "first-touch", "random"
+};
+
+// Returns PAGE_MAP_NUM_KINDS if name isn't a known page allocation
+static inline page_map_kind_t parse_page_map(const char* name){
+    for (int k = 0; k < PAGE_MAP_NUM_KINDS; k++){
+        if (strcmp(name, page_map_names[k]) == 0){
+            return (page_map_kind_t) k;
+        }
+    }
+    return PAGE_MAP_NUM_KINDS;
+}
+
+typedef struct {
+    page_map_kind_t kind;
+    uint64_t page_size;     // bytes, a power of 2
+    uint64_t phys_mem;      // bytes of physical memory frames are taken from
+    uint64_t seed;          // of the random allocation
+} page_map_params_t;
+
+static inline page_map_params_t default_page_map_params(){
+    page_map_params_t p;
+    p.kind      = PAGE_MAP_NONE;
+    p.page_size = 4096;
+    p.phys_mem  = 16ULL << 30;
+    p.seed      = 1;
+    return p;
+}
+
+// Returns NULL if p is usable with block_size byte blocks, else why not
+static inline const char* page_map_params_error(const page_map_params_t& p, uint32_t block_size){
+    if (p.page_size == 0 || (p.page_size & (p.page_size - 1)) || p.page_size < block_size){
+        return "Page size must be a power of 2, at least one block.";
+    }
+    if (p.phys_mem < p.page_size || p.phys_mem % p.page_size != 0){
+        return "Physical memory must be a whole number of pages.";
+    }
+    return NULL;
+}
+
+class PageMapper {
+    private:
+        page_map_params_t params;
+        uint32_t page_bits;
+        uint64_t frames;                            // in the pool
+        uint64_t next_frame;                        // first-touch: next free one
+        uint64_t rng;                               // random: xorshift64* state
+        unordered_set<uint64_t> used;               // random: frames handed out
+        unordered_map<addr_t, uint64_t> table;      // virtual page -> frame
+
+        // Last translation, so runs of accesses to one page skip the table
+        addr_t   last_page;
+        uint64_t last_frame;
+        bool     last_valid;
+
+        uint64_t random_u64(){
+            this->rng ^= this->rng >> 12;
+            this->rng ^= this->rng << 25;
+            this->rng ^= this->rng >> 27;
+            return this->rng * 0x2545f4914f6cdd1dULL;
+        }
+
+        uint64_t allocate_frame(){
+            if (this->table.size() >= this->frames){
+                printf("Error: The trace touches more than %llu pages of %llu bytes; raise --phys-mem.\n",
+                       (unsigned long long) this->frames, (unsigned long long) this->params.page_size);
+                exit(EXIT_FAILURE);
+            }
+            if (this->params.kind == PAGE_MAP_FIRST_TOUCH){
+                return this->next_frame++;
+            }
+            uint64_t frame;
+            do {
+                frame = this->random_u64() % this->frames;
+            } while (!this->used.insert(frame).second);
+            return frame;
+        }
+
+    public:
+        PageMapper(const page_map_params_t& params){
+            this->params     = params;
+            this->page_bits  = __builtin_ctzll(params.page_size);
+            this->frames     = params.phys_mem / params.page_size;
+            this->next_frame = 0;
+            this->rng        = params.seed ? params.seed : 1;
+            this->last_page  = 0;
+            this->last_frame = 0;
+            this->last_valid = false;
+        }
+
+        uint32_t get_page_bits(){ return this->page_bits; }
+        // Distinct pages the trace touched so far
+        uint64_t pages(){ return this->table.size(); }
+
+        addr_t translate(addr_t vaddr){
+            addr_t page = vaddr >> this->page_bits;
+            if (!this->last_valid || page != this->last_page){
+                unordered_map<addr_t, uint64_t>::iterator it = this->table.find(page);
+                if (it == this->table.end()){
+                    it = this->table.insert(make_pair(page, this->allocate_frame())).first;
+                }
+                this->last_page  = page;
+                this->last_frame = it->second;
+                this->last_valid = true;
+            }
+            return ((addr_t) this->last_frame << this->page_bits) | (vaddr & (this->params.page_size - 1));
+        }
+
+        // Checkpoints (checkpoint.h): the page table and where allocation
+        // stands. load() needs the same parameters save() ran with.
+        void save(CheckpointWriter& w){
+            vector<addr_t> pages;
+            vector<uint64_t> frames;
+            for (unordered_map<addr_t, uint64_t>::iterator it = this->table.begin(); it != this->table.end(); ++it){
+                pages.push_back(it->first);
+                frames.push_back(it->second);
+            }
+            w.put<uint32_t>(this->params.kind);
+            w.put(this->params.page_size);
+            w.put(this->params.phys_mem);
+            w.put(this->params.seed);
+            w.put(this->next_frame);
+            w.put(this->rng);
+            w.put<uint64_t>(pages.size());
+            w.put_vector(pages);
+            w.put_vector(frames);
+        }
+        void load(CheckpointReader& r){
+            uint32_t kind      = r.get<uint32_t>();
+            uint64_t page_size = r.get<uint64_t>();
+            uint64_t phys_mem  = r.get<uint64_t>();
+            uint64_t seed      = r.get<uint64_t>();
+            if (kind != (uint32_t) this->params.kind || page_size != this->params.page_size ||
+                phys_mem != this->params.phys_mem || seed != this->params.seed){
+                printf("Error: Checkpoint %s was taken with another page map.\n", r.path);
+                exit(EXIT_FAILURE);
+            }
+            this->next_frame = r.get<uint64_t>();
+            this->rng        = r.get<uint64_t>();
+            vector<addr_t> pages(r.get<uint64_t>());
+            vector<uint64_t> frames(pages.size());
+            r.get_vector(pages);
+            r.get_vector(frames);
+            this->table.clear();
+            this->used.clear();
+            for (size_t i = 0; i < pages.size(); i++){
+                this->table[pages[i]] = frames[i];
+                if (this->params.kind == PAGE_MAP_RANDOM){
+                    this->used.insert(frames[i]);
+                }
+            }
+            this->last_valid = false;
+        }
+};
+
+// Configuration lines of a run that translates its addresses
+void print_page_map(const page_map_params_t& p, PageMapper* page_map){
+    printf("PAGE_MAP:   %s\n", page_map_names[p.kind]);
+    printf("PAGE_SIZE:  %llu\n", (unsigned long long) p.page_size);
+    printf("PAGES:      %llu\n", (unsigned long long) page_map->pages());
+}
+
+#endif // PAGE_MAP_H
@@ -0,0 +1,219 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "cachesim.h"
+#include "hierarchy.h"
+#include "trace_reader.h"
+#include "profile.h"
+
+using namespace std;
+
+/*  Set-partitioned simulation (--parallel=N): one trace, simulated by N
+    workers at once. Every block address maps to a group,
+    block % gcd(L1 sets, L2 sets), and every group to one worker. The
+    group fixes the block's L1 set and its L2 set, so a worker's
+    requests, and the writebacks and fills they cause between L1 and L2,
+    only ever touch sets no other worker touches. Each worker runs its own
+    copy of the hierarchy on its share of the trace. At the end its sets
+    are copied into the main hierarchy, and its counters added to it.
+    The result is exactly what the serial run gives.
+
+    The reader thread parses the trace, applies the page map (its frame
+    allocation depends on the global order of first touches) and deals
+    the requests out in chunks, through one single-producer
+    single-consumer ring per worker.
+
+    Anything that couples sets makes the run serial instead:
+    prefetchers (stream buffers are shared by all sets, and the others
+    fetch blocks of other sets), DRRIP's set dueling, the BRRIP and
+    random policies' random number generators, the timing model (one
+    clock for all requests), event logs, intervals and checkpoints, L1
+    and L2 lines of different sizes, and the reuse predictor (trained by
+    a sample of the sets, for all of them).
+    partition_coupling() says which applies.
+*/
+
+#define PARTITION_CHUNK  1024   // requests handed over at a time
+#define PARTITION_RING   64     // chunks in flight per worker
+
+typedef struct {
+    uint32_t n;
+    trace_record records[PARTITION_CHUNK];
+} partition_chunk_t;
+
+// Lock-free ring of chunks between the reader (producer) and one worker
+// (consumer). The producer fills the chunk at tail and publishes it by
+// moving tail; the consumer releases the chunk at head by moving head.
+class SpscRing {
+    private:
+        partition_chunk_t slots[PARTITION_RING];
+        alignas(64) atomic<uint32_t> head;
+        alignas(64) atomic<uint32_t> tail;
+        atomic<bool> closed;
+
+    public:
+        SpscRing() : head(0), tail(0), closed(false) {}
+
+        // Producer: the chunk to fill next, once there is room
+        partition_chunk_t* claim(){
+            uint32_t t = this->tail.load(memory_order_relaxed);
+            while (t - this->head.load(memory_order_acquire) == PARTITION_RING){
+                this_thread::yield();
+            }
+            return &this->slots[t % PARTITION_RING];
+        }
+        void publish(){ this->tail.fetch_add(1, memory_order_release); }
+        void close(){ this->closed.store(true, memory_order_release); }
+
+        // Consumer: the next full chunk, or NULL once the ring is closed and drained
+        partition_chunk_t* next(){
+            uint32_t h = this->head.load(memory_order_relaxed);
+            while (this->tail.load(memory_order_acquire) == h){
+                if (this->closed.load(memory_order_acquire) && this->tail.load(memory_order_acquire) == h){
+                    return NULL;
+                }
+                this_thread::yield();
+            }
+            return &this->slots[h % PARTITION_RING];
+        }
+        void release(){ this->head.fetch_add(1, memory_order_release); }
+};
+
+static uint32_t gcd32(uint32_t a, uint32_t b){
+    while (b != 0){
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Returns why a run of h can't be split by sets, or NULL if it can
+static const char* partition_coupling(Hierarchy& h){
+    for (uint32_t lvl = 1; lvl <= 2; lvl++){
+        if (h.prefetcher_kind(lvl) != PREF_NONE){
+            return "prefetchers couple sets";
+        }
+        repl_policy_t repl = (lvl == 1) ? h.params.l1_repl : h.params.l2_repl;
+        if (repl == REPL_DRRIP || repl == REPL_BRRIP || repl == REPL_RANDOM){
+            return "the replacement policy has state shared by all sets";
+        }
+    }
+    if (h.params.l2_size > 0 && l2_block_size(h.params) != h.params.blocksize){
+        return "L1 and L2 lines of different sizes map a block to sets of other groups";
+    }
+    if (h.params.llc_reuse != REUSE_NONE){
+        return "the reuse predictor learns from all sets";
+    }
+    if (h.timing){
+        return "the timing model orders all requests";
+    }
+    if (h.events){
+        return "event logs are in global order";
+    }
+    return NULL;
+}
+
+// Runs the rest of trace (up to access stop_at, if not 0) through h with
+// threads workers; returns the number of accesses. h must not be coupled
+// (see partition_coupling()).
+static uint64_t simulate_partitioned(Hierarchy& h, TraceReader& trace, uint32_t threads, uint64_t stop_at, RunProfile* profile){
+    static trace_record batch[TRACE_BATCH_SIZE];
+
+    uint32_t groups = h.l1_cache->get_sets_num();
+    if (h.params.l2_size > 0){
+        groups = gcd32(groups, h.l2_cache->get_sets_num());
+    }
+    uint32_t workers = min(threads, groups);
+
+    // The workers' hierarchies see physical addresses already
+    cache_params_t params = h.params;
+    params.page_map.kind  = PAGE_MAP_NONE;
+    vector<Hierarchy*> parts(workers);
+    vector<SpscRing*> rings(workers);
+    vector<thread> pool;
+    for (uint32_t w = 0; w < workers; w++){
+        parts[w] = new Hierarchy(params);
+        rings[w] = new SpscRing();
+        pool.push_back(thread([&parts, &rings, w](){
+            partition_chunk_t* c;
+            while ((c = rings[w]->next()) != NULL){
+                for (uint32_t i = 0; i < c->n; i++){
+                    parts[w]->access_physical(c->records[i].rw, c->records[i].addr);
+                }
+                rings[w]->release();
+            }
+        }));
+    }
+
+    vector<partition_chunk_t*> filling(workers);
+    for (uint32_t w = 0; w < workers; w++){
+        filling[w] = rings[w]->claim();
+        filling[w]->n = 0;
+    }
+    uint32_t block_bits = (uint32_t) log2(h.params.blocksize);
+    uint64_t accesses = 0;
+    while (stop_at == 0 || accesses < stop_at){
+        uint64_t batch_max = (stop_at > 0) ? min((uint64_t) TRACE_BATCH_SIZE, stop_at - accesses) : TRACE_BATCH_SIZE;
+        uint32_t n = trace.next_batch(batch, (uint32_t) batch_max);
+        if (profile) profile->mark(PHASE_PARSE);
+        if (n == 0){
+            break;
+        }
+        for (uint32_t i = 0; i < n; i++){
+            if (batch[i].rw != 'r' && batch[i].rw != 'w'){
+                printf("Error: Unknown request type %c.\n", batch[i].rw);
+                exit(EXIT_FAILURE);
+            }
+            addr_t addr = h.page_map ? h.page_map->translate(batch[i].addr) : batch[i].addr;
+            uint32_t w  = (uint32_t) ((addr >> block_bits) % groups) % workers;
+            partition_chunk_t* c = filling[w];
+            c->records[c->n].rw   = batch[i].rw;
+            c->records[c->n].addr = addr;
+            if (++c->n == PARTITION_CHUNK){
+                rings[w]->publish();
+                filling[w] = rings[w]->claim();
+                filling[w]->n = 0;
+            }
+        }
+        accesses += n;
+        if (profile) profile->mark(PHASE_SIMULATE);
+    }
+    for (uint32_t w = 0; w < workers; w++){
+        if (filling[w]->n > 0){
+            rings[w]->publish();
+        }
+        rings[w]->close();
+    }
+    for (uint32_t w = 0; w < workers; w++){
+        pool[w].join();
+    }
+
+    // Each set comes from the worker its group belongs to
+    Cache* levels[2] = { h.l1_cache, h.l2_cache };
+    for (uint32_t lvl = 0; lvl < ((h.params.l2_size > 0) ? 2 : 1); lvl++){
+        for (uint32_t s = 0; s < levels[lvl]->get_sets_num(); s++){
+            Hierarchy* part = parts[(s % groups) % workers];
+            levels[lvl]->copy_set((lvl == 0) ? part->l1_cache : part->l2_cache, s);
+        }
+    }
+    for (uint32_t w = 0; w < workers; w++){
+        h.l1_cache->add_counters(parts[w]->l1_cache);
+        h.l2_cache->add_counters(parts[w]->l2_cache);
+        h.memory.read_count     += parts[w]->memory.read_count;
+        h.memory.write_count    += parts[w]->memory.write_count;
+        h.memory.prefetch_count += parts[w]->memory.prefetch_count;
+        delete parts[w];
+        delete rings[w];
+    }
+    if (profile) profile->mark(PHASE_SIMULATE);
+    return accesses;
+}
+
+#endif // PARTITION_H
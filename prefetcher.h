@@ -0,0 +1,689 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <vector>
+#include "addr.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+typedef enum {
+    PREF_DEFAULT = 0,   // stream buffers at the last level if PREF_N > 0, else none
+    PREF_NONE,
+    PREF_STREAM,        // PREF_N stream buffers of PREF_M blocks (the original design)
+    PREF_NEXT_LINE,     // next-N-line, tagged
+    PREF_STRIDE,        // reference prediction table keyed by region instead of PC
+    PREF_GHB,           // global history buffer, global delta correlation (G/DC)
+    PREF_BOP,           // Best-Offset
+    PREF_NUM_KINDS
+} prefetcher_kind_t;
+
+static const char* const prefetcher_names[PREF_NUM_KINDS] = {
+    "default", "none", "stream", "nextline", "stride", "ghb", "bop"
+};
+
+// Returns PREF_NUM_KINDS if name isn't a known prefetcher
+static inline prefetcher_kind_t parse_prefetcher(const char* name){
+    for (int k = PREF_NONE; k < PREF_NUM_KINDS; k++){
+        if (strcmp(name, prefetcher_names[k]) == 0){
+            return (prefetcher_kind_t) k;
+        }
+    }
+    return PREF_NUM_KINDS;
+}
+
+// Prefetcher of one cache level, working on block addresses. The Cache shows
+// it every demand access (after the lookup) and issues the blocks it asks
+// for: into the cache itself, or for prefetchers with their own buffer
+// (fills_cache() false), into that buffer.
+class Prefetcher {
+    public:
+        uint64_t issued;    // blocks fetched for it
+        uint64_t useful;    // demand accesses it served (first use of a block)
+        uint64_t late;      // ... while the block was still in flight (timing only)
+        uint64_t useless;   // blocks evicted or dropped before any use
+
+        // log2 of the blocks per page when the hierarchy sees physical
+        // addresses (page_map.h), else 0. Prefetches then stay in the page
+        // of the access that triggers them, as in hardware: the next
+        // physical page belongs to some other virtual page.
+        uint32_t page_block_bits;
+
+        Prefetcher(){
+            this->issued  = 0;
+            this->useful  = 0;
+            this->late    = 0;
+            this->useless = 0;
+            this->page_block_bits = 0;
+        }
+        virtual ~Prefetcher(){}
+
+        virtual prefetcher_kind_t kind() = 0;
+        const char* name(){ return prefetcher_names[this->kind()]; }
+        virtual bool fills_cache(){ return true; }
+
+        // Demand access to block_addr; prefetched is true on the first hit to
+        // a block this prefetcher brought into the cache. Appends the blocks
+        // to prefetch to out. Returns true if block_addr was in the
+        // prefetcher's own buffer (which then supplies it on a miss).
+        virtual bool on_access(addr_t block_addr, bool hit, bool prefetched, vector<addr_t>& out) = 0;
+
+        virtual void print(){}
+
+        // Checkpoints (checkpoint.h): the counters, then whatever state the
+        // kind keeps. load() reads what save() wrote for the same kind and
+        // returns false, leaving the prefetcher untouched, if it was
+        // configured differently (another degree, PREF_N or PREF_M).
+        void save(CheckpointWriter& w){
+            w.put(this->issued);
+            w.put(this->useful);
+            w.put(this->late);
+            w.put(this->useless);
+            this->save_state(w);
+        }
+        bool load(CheckpointReader& r){
+            uint64_t counts[4];
+            r.get(counts, sizeof(counts));
+            if (!this->load_state(r)){
+                return false;
+            }
+            this->issued  = counts[0];
+            this->useful  = counts[1];
+            this->late    = counts[2];
+            this->useless = counts[3];
+            return true;
+        }
+        // Configuration first, so that load_state() can back out before changing anything
+        virtual void save_state(CheckpointWriter& w){}
+        virtual bool load_state(CheckpointReader& r){ return true; }
+
+        // First block past the page of block_addr
+        addr_t page_end(addr_t block_addr){
+            if (this->page_block_bits == 0){
+                return ~(addr_t) 0;
+            }
+            return ((block_addr >> this->page_block_bits) + 1) << this->page_block_bits;
+        }
+        // Drops the blocks of out outside the page of block_addr
+        void clip_to_page(addr_t block_addr, vector<addr_t>& out){
+            if (this->page_block_bits == 0){
+                return;
+            }
+            uint32_t kept = 0;
+            for (uint32_t i = 0; i < out.size(); i++){
+                if ((out[i] >> this->page_block_bits) == (block_addr >> this->page_block_bits)){
+                    out[kept++] = out[i];
+                }
+            }
+            out.resize(kept);
+        }
+};
+
+// PREF_N stream buffers of PREF_M consecutive blocks each, LRU over the
+// buffers. A miss that no buffer covers (re)starts the LRU buffer right
+// after the missing block; a buffer holding the accessed block supplies it,
+// drops the blocks up to it and refills past its tail.
+//
+// The buffers sit in fixed slots on an intrusive MRU -> LRU list, so
+// promoting one and finding the LRU are O(1). Lookups go through an index
+// of the covered ranges: a buffer's blocks [head, head + pref_m) fall in one
+// or two pref_m-aligned chunks, and the buffer is listed under each of them
+// in a small chained hash table. Finding the buffer holding a block then
+// only looks at the buffers listed under that block's chunk, whatever
+// pref_n and pref_m are. Where buffers overlap, the most recently used one
+// wins (as in a scan from MRU to LRU), which stamps tell apart.
+//
+// With page_block_bits set, a stream stops at the end of the page it
+// started in: its blocks from limits[s] on are never fetched, so they
+// don't count as held.
+class StreamBufferPrefetcher : public Prefetcher {
+    private:
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        struct index_node {
+            addr_t   chunk;
+            uint32_t next;          // next node of the bucket
+        };
+
+        uint32_t pref_n;
+        uint32_t pref_m;
+
+        vector<addr_t>   heads;     // first block of each slot's buffer; 0 (invalid) initially
+        vector<addr_t>   limits;    // first block past the page the slot's stream started in
+        vector<uint64_t> stamps;    // last use of each slot, higher is more recent
+        vector<uint32_t> prev;      // MRU -> LRU list of slots
+        vector<uint32_t> next;
+        uint32_t mru;
+        uint32_t lru;
+        uint64_t clock;
+
+        // Slot s owns nodes 2s and 2s+1 (the second one only when its range
+        // straddles two chunks)
+        vector<index_node> nodes;
+        vector<uint32_t> buckets;   // first node of each bucket
+        uint32_t bucket_mask;
+
+        uint32_t bucket(addr_t chunk){ return ((uint32_t) chunk * 0x9e3779b1u >> 7) & this->bucket_mask; }
+
+        void index_insert(uint32_t node, addr_t chunk){
+            uint32_t b = this->bucket(chunk);
+            this->nodes[node].chunk = chunk;
+            this->nodes[node].next  = this->buckets[b];
+            this->buckets[b] = node;
+        }
+        void index_remove(uint32_t node){
+            uint32_t* link = &this->buckets[this->bucket(this->nodes[node].chunk)];
+            while (*link != node){
+                link = &this->nodes[*link].next;
+            }
+            *link = this->nodes[node].next;
+        }
+
+        // Points slot s at a buffer starting at head
+        void set_head(uint32_t s, addr_t head, bool indexed){
+            if (indexed){
+                this->index_remove(2 * s);
+                if (this->heads[s] / this->pref_m != (this->heads[s] + this->pref_m - 1) / this->pref_m){
+                    this->index_remove(2 * s + 1);
+                }
+            }
+            this->heads[s] = head;
+            this->index_insert(2 * s, head / this->pref_m);
+            if (head / this->pref_m != (head + this->pref_m - 1) / this->pref_m){
+                this->index_insert(2 * s + 1, (head + this->pref_m - 1) / this->pref_m);
+            }
+        }
+
+        void make_mru(uint32_t s){
+            this->stamps[s] = ++this->clock;
+            if (this->mru == s){
+                return;
+            }
+            // unlink (s isn't the MRU, so it has a prev)
+            this->next[this->prev[s]] = this->next[s];
+            if (this->lru == s){
+                this->lru = this->prev[s];
+            }else{
+                this->prev[this->next[s]] = this->prev[s];
+            }
+            this->prev[s] = NONE;
+            this->next[s] = this->mru;
+            this->prev[this->mru] = s;
+            this->mru = s;
+        }
+
+        // Most recently used slot whose buffer holds block_addr, or NONE
+        uint32_t find(addr_t block_addr){
+            addr_t chunk   = block_addr / this->pref_m;
+            uint32_t found = NONE;
+            for (uint32_t n = this->buckets[this->bucket(chunk)]; n != NONE; n = this->nodes[n].next){
+                uint32_t s = n / 2;
+                if (this->nodes[n].chunk == chunk && this->heads[s] <= block_addr && block_addr < this->heads[s] + this->pref_m &&
+                    block_addr < this->limits[s] &&
+                    (found == NONE || this->stamps[s] > this->stamps[found])){
+                    found = s;
+                }
+            }
+            return found;
+        }
+
+    public:
+        StreamBufferPrefetcher(uint32_t pref_n, uint32_t pref_m){
+            this->pref_n = pref_n;
+            this->pref_m = pref_m;
+
+            uint32_t buckets_num = 1;
+            while (buckets_num < 4 * pref_n){
+                buckets_num <<= 1;
+            }
+            this->buckets.assign(buckets_num, NONE);
+            this->bucket_mask = buckets_num - 1;
+            this->nodes.resize(2 * pref_n);
+
+            // Slot i starts at position i from the MRU
+            this->heads.assign(pref_n, 0);
+            this->limits.assign(pref_n, ~(addr_t) 0);
+            this->stamps.resize(pref_n);
+            this->prev.resize(pref_n);
+            this->next.resize(pref_n);
+            for (uint32_t i = 0; i < pref_n; i++){
+                this->stamps[i] = pref_n - i;
+                this->prev[i]   = (i == 0) ? NONE : i - 1;
+                this->next[i]   = (i == pref_n - 1) ? NONE : i + 1;
+                this->set_head(i, 0, false);
+            }
+            this->mru   = 0;
+            this->lru   = pref_n - 1;
+            this->clock = pref_n;
+        }
+
+        prefetcher_kind_t kind(){ return PREF_STREAM; }
+        bool fills_cache(){ return false; }
+
+        bool on_access(addr_t block_addr, bool hit, bool prefetched, vector<addr_t>& out){
+            uint32_t s = this->find(block_addr);
+
+            if (s != NONE){ // prefetch hit
+                //scenario 4 and 2
+                // the stream moves on; the blocks it consumed are refilled past its tail
+                addr_t head = this->heads[s];
+                this->useless += block_addr - head + (hit ? 1 : 0);
+                for (addr_t b = head + this->pref_m; b <= block_addr + this->pref_m && b < this->limits[s]; b++){
+                    out.push_back(b);
+                }
+                this->set_head(s, block_addr + 1, true);
+                this->make_mru(s);
+                return 1;
+            }
+
+            // If here, the block_addr is not in any of the stream buffers
+            if (hit){ // scenario 3
+                // do nothing
+
+            }else{ // scenario 1
+                // The Cache reads the missing block from the next level; the LRU buffer
+                // restarts right after it.
+                s = this->lru;
+                if (this->heads[s] != 0 && this->heads[s] < this->limits[s]){
+                    this->useless += min((addr_t) this->pref_m, this->limits[s] - this->heads[s]);
+                }
+                this->limits[s] = this->page_end(block_addr);
+                for (addr_t b = block_addr + 1; b <= block_addr + this->pref_m && b < this->limits[s]; b++){
+                    out.push_back(b);
+                }
+                this->set_head(s, block_addr + 1, true);
+                this->make_mru(s);
+            }
+            return 0;
+        }
+
+        void save_state(CheckpointWriter& w){
+            w.put(this->pref_n);
+            w.put(this->pref_m);
+            w.put(this->mru);
+            w.put(this->lru);
+            w.put(this->clock);
+            w.put_vector(this->heads);
+            w.put_vector(this->limits);
+            w.put_vector(this->stamps);
+            w.put_vector(this->prev);
+            w.put_vector(this->next);
+        }
+        bool load_state(CheckpointReader& r){
+            if (r.get<uint32_t>() != this->pref_n || r.get<uint32_t>() != this->pref_m){
+                return false;
+            }
+            this->mru   = r.get<uint32_t>();
+            this->lru   = r.get<uint32_t>();
+            this->clock = r.get<uint64_t>();
+            r.get_vector(this->heads);
+            r.get_vector(this->limits);
+            r.get_vector(this->stamps);
+            r.get_vector(this->prev);
+            r.get_vector(this->next);
+            // the index only depends on the heads
+            this->buckets.assign(this->buckets.size(), NONE);
+            for (uint32_t s = 0; s < this->pref_n; s++){
+                this->set_head(s, this->heads[s], false);
+            }
+            return true;
+        }
+
+        void print(){
+            for (uint32_t s = this->mru; s != NONE; s = this->next[s]){
+                if (this->heads[s]){
+                    for (uint32_t j = 0; j < this->pref_m; j++){
+                        printf("%9llx", (unsigned long long) (this->heads[s] + j));
+                    }
+                    printf("\n");
+                }
+            }
+        }
+};
+
+// Next-N-line: a miss, or the first hit to a block it prefetched, fetches
+// the degree blocks that follow
+class NextLinePrefetcher : public Prefetcher {
+    private:
+        uint32_t degree;
+
+    public:
+        NextLinePrefetcher(uint32_t degree){
+            this->degree = degree;
+        }
+
+        prefetcher_kind_t kind(){ return PREF_NEXT_LINE; }
+
+        void save_state(CheckpointWriter& w){ w.put(this->degree); }
+        bool load_state(CheckpointReader& r){ return r.get<uint32_t>() == this->degree; }
+
+        bool on_access(addr_t block_addr, bool hit, bool prefetched, vector<addr_t>& out){
+            if (!hit || prefetched){
+                for (uint32_t i = 1; i <= this->degree; i++){
+                    out.push_back(block_addr + i);
+                }
+            }
+            return false;
+        }
+};
+
+// Stride prefetcher without PCs: a direct-mapped reference prediction table
+// (Chen and Baer) indexed by memory region instead of load PC. Each entry
+// tracks the last block and stride seen in its region with a 2-bit
+// confidence; once the stride repeated twice, degree blocks are fetched
+// along it.
+class StridePrefetcher : public Prefetcher {
+    private:
+        static const uint32_t TABLE_SIZE   = 256;
+        static const uint32_t REGION_BITS  = 6;     // 64-block regions
+        static const uint32_t CONF_MAX     = 3;
+        static const uint32_t CONF_PREDICT = 2;
+
+        struct rpt_entry {
+            addr_t   region;
+            addr_t   last_block;
+            int32_t  stride;
+            uint32_t conf;
+            bool     valid;
+        };
+
+        uint32_t degree;
+        vector<rpt_entry> table;
+
+    public:
+        StridePrefetcher(uint32_t degree){
+            rpt_entry empty = { 0, 0, 0, 0, false };
+            this->degree = degree;
+            this->table.assign(TABLE_SIZE, empty);
+        }
+
+        prefetcher_kind_t kind(){ return PREF_STRIDE; }
+
+        void save_state(CheckpointWriter& w){
+            w.put(this->degree);
+            for (uint32_t i = 0; i < TABLE_SIZE; i++){
+                const rpt_entry& e = this->table[i];
+                w.put(e.region);
+                w.put(e.last_block);
+                w.put(e.stride);
+                w.put(e.conf);
+                w.put<uint8_t>(e.valid);
+            }
+        }
+        bool load_state(CheckpointReader& r){
+            if (r.get<uint32_t>() != this->degree){
+                return false;
+            }
+            for (uint32_t i = 0; i < TABLE_SIZE; i++){
+                rpt_entry& e = this->table[i];
+                e.region     = r.get<addr_t>();
+                e.last_block = r.get<addr_t>();
+                e.stride     = r.get<int32_t>();
+                e.conf       = r.get<uint32_t>();
+                e.valid      = r.get<uint8_t>() != 0;
+            }
+            return true;
+        }
+
+        bool on_access(addr_t block_addr, bool hit, bool prefetched, vector<addr_t>& out){
+            addr_t region   = block_addr >> REGION_BITS;
+            rpt_entry& e    = this->table[region % TABLE_SIZE];
+
+            if (!e.valid || e.region != region){
+                e.region     = region;
+                e.last_block = block_addr;
+                e.stride     = 0;
+                e.conf       = 0;
+                e.valid      = true;
+                return false;
+            }
+            int32_t stride = (int32_t) (block_addr - e.last_block);
+            if (stride == 0){
+                return false; // same block again; nothing learned
+            }
+            if (stride == e.stride){
+                if (e.conf < CONF_MAX) e.conf++;
+            }else if (e.conf > 0){
+                e.conf--;
+            }else{
+                e.stride = stride;
+            }
+            e.last_block = block_addr;
+
+            if (e.conf >= CONF_PREDICT){
+                for (uint32_t i = 1; i <= this->degree; i++){
+                    out.push_back(block_addr + (addr_t) (int64_t) (e.stride * (int32_t) i));
+                }
+            }
+            return false;
+        }
+};
+
+// Global history buffer with global delta correlation (Nesbit and Smith,
+// G/DC). The miss stream (misses and first hits to prefetched blocks) is
+// kept in a circular buffer; an index table maps the last two deltas to the
+// most recent point in the history where the same pair occurred, and the
+// deltas that followed it there are replayed from the current block.
+class GhbPrefetcher : public Prefetcher {
+    private:
+        static const uint32_t GHB_SIZE   = 256;
+        static const uint32_t INDEX_SIZE = 256;
+
+        uint32_t degree;
+        vector<addr_t>   ghb;       // block of history entry seq at ghb[seq % GHB_SIZE]
+        vector<uint64_t> index;     // delta pair hash -> seq + 1 of where it last ended (0: never)
+        uint64_t seq;               // entries pushed so far
+
+        addr_t at(uint64_t s){ return this->ghb[s % GHB_SIZE]; }
+
+        static uint32_t pair_hash(int64_t d1, int64_t d2){
+            return ((uint32_t) d1 * 0x9e3779b1u ^ (uint32_t) d2 * 0x85ebca6bu) >> 24;
+        }
+
+    public:
+        GhbPrefetcher(uint32_t degree){
+            this->degree = degree;
+            this->ghb.assign(GHB_SIZE, 0);
+            this->index.assign(INDEX_SIZE, 0);
+            this->seq = 0;
+        }
+
+        prefetcher_kind_t kind(){ return PREF_GHB; }
+
+        void save_state(CheckpointWriter& w){
+            w.put(this->degree);
+            w.put(this->seq);
+            w.put_vector(this->ghb);
+            w.put_vector(this->index);
+        }
+        bool load_state(CheckpointReader& r){
+            if (r.get<uint32_t>() != this->degree){
+                return false;
+            }
+            this->seq = r.get<uint64_t>();
+            r.get_vector(this->ghb);
+            r.get_vector(this->index);
+            return true;
+        }
+
+        bool on_access(addr_t block_addr, bool hit, bool prefetched, vector<addr_t>& out){
+            if (hit && !prefetched){
+                return false;
+            }
+            this->ghb[this->seq % GHB_SIZE] = block_addr;
+            uint64_t cur = this->seq++;
+            if (cur < 2){
+                return false;
+            }
+
+            int64_t d1 = (int64_t) (this->at(cur - 1) - this->at(cur - 2));
+            int64_t d2 = (int64_t) (block_addr - this->at(cur - 1));
+            uint32_t h = pair_hash(d1, d2) % INDEX_SIZE;
+            uint64_t prev = this->index[h];     // seq + 1 of the last entry that ended the pair
+            this->index[h] = cur + 1;
+
+            uint64_t p = prev - 1;
+            if (prev == 0 || cur - p + 2 >= GHB_SIZE){
+                return false; // never seen, or already overwritten
+            }
+            if (p < 2 || (int64_t) (this->at(p) - this->at(p - 1)) != d2 || (int64_t) (this->at(p - 1) - this->at(p - 2)) != d1){
+                return false; // hash collision
+            }
+            addr_t addr = block_addr;
+            for (uint32_t i = 1; i <= this->degree && p + i < cur; i++){
+                addr += this->at(p + i) - this->at(p + i - 1);
+                out.push_back(addr);
+            }
+            return false;
+        }
+};
+
+// Best-Offset (Michaud, HPCA 2016). Learns the offset D for which "X - D
+// was requested recently" holds most often over the miss stream, then
+// prefetches X + D on every miss and first hit to a prefetched block.
+// Offsets are scored round-robin against a table of recent base addresses;
+// a learning phase ends once one scores SCORE_MAX or after ROUND_MAX
+// rounds, and prefetching is off while the best score is BAD_SCORE or less.
+// Always one block ahead, whatever the degree.
+class BestOffsetPrefetcher : public Prefetcher {
+    private:
+        static const uint32_t RR_SIZE   = 256;
+        static const uint32_t SCORE_MAX = 31;
+        static const uint32_t ROUND_MAX = 100;
+        static const uint32_t BAD_SCORE = 1;
+
+        vector<int32_t>  offsets;
+        vector<uint32_t> scores;
+        vector<addr_t>   rr;        // recent requests, direct-mapped, 0 is empty
+        uint32_t next_offset;       // offset tested by the next access
+        uint32_t round;
+        int32_t  best_offset;       // 0 while prefetching is off
+
+        static uint32_t rr_index(addr_t block_addr){
+            return (block_addr ^ (block_addr >> 8)) % RR_SIZE;
+        }
+        bool rr_hit(addr_t block_addr){ return this->rr[rr_index(block_addr)] == block_addr + 1; }
+        void rr_insert(addr_t block_addr){ this->rr[rr_index(block_addr)] = block_addr + 1; }
+
+        void end_phase(){
+            uint32_t best = 0;
+            for (uint32_t i = 1; i < this->offsets.size(); i++){
+                if (this->scores[i] > this->scores[best]){
+                    best = i;
+                }
+            }
+            this->best_offset = (this->scores[best] > BAD_SCORE) ? this->offsets[best] : 0;
+            this->scores.assign(this->offsets.size(), 0);
+            this->round = 0;
+        }
+
+    public:
+        BestOffsetPrefetcher(){
+            // 1..64 with no prime factor above 5, as in the paper
+            for (int32_t d = 1; d <= 64; d++){
+                int32_t r = d;
+                while (r % 2 == 0) r /= 2;
+                while (r % 3 == 0) r /= 3;
+                while (r % 5 == 0) r /= 5;
+                if (r == 1){
+                    this->offsets.push_back(d);
+                }
+            }
+            this->scores.assign(this->offsets.size(), 0);
+            this->rr.assign(RR_SIZE, 0);
+            this->next_offset = 0;
+            this->round       = 0;
+            this->best_offset = 1;
+        }
+
+        prefetcher_kind_t kind(){ return PREF_BOP; }
+
+        void save_state(CheckpointWriter& w){
+            w.put(this->next_offset);
+            w.put(this->round);
+            w.put(this->best_offset);
+            w.put_vector(this->scores);
+            w.put_vector(this->rr);
+        }
+        bool load_state(CheckpointReader& r){
+            this->next_offset = r.get<uint32_t>();
+            this->round       = r.get<uint32_t>();
+            this->best_offset = r.get<int32_t>();
+            r.get_vector(this->scores);
+            r.get_vector(this->rr);
+            return true;
+        }
+
+        bool on_access(addr_t block_addr, bool hit, bool prefetched, vector<addr_t>& out){
+            if (hit && !prefetched){
+                return false;
+            }
+
+            // Learning: one offset tested per access
+            uint32_t i = this->next_offset;
+            if (this->rr_hit(block_addr - this->offsets[i])){
+                if (++this->scores[i] >= SCORE_MAX){
+                    this->end_phase();
+                }
+            }
+            if (++this->next_offset == this->offsets.size()){
+                this->next_offset = 0;
+                if (++this->round >= ROUND_MAX){
+                    this->end_phase();
+                }
+            }
+            this->rr_insert(block_addr);
+
+            if (this->best_offset != 0){
+                out.push_back(block_addr + this->best_offset);
+            }
+            return false;
+        }
+};
+
+// degree is ignored by the stream buffers (pref_n x pref_m) and Best-Offset
+static Prefetcher* make_prefetcher(prefetcher_kind_t kind, uint32_t pref_n, uint32_t pref_m, uint32_t degree){
+    switch (kind){
+        case PREF_NONE:      return NULL;
+        case PREF_STREAM:    return new StreamBufferPrefetcher(pref_n, pref_m);
+        case PREF_NEXT_LINE: return new NextLinePrefetcher(degree);
+        case PREF_STRIDE:    return new StridePrefetcher(degree);
+        case PREF_GHB:       return new GhbPrefetcher(degree);
+        case PREF_BOP:       return new BestOffsetPrefetcher();
+        default:
+            printf("Error: unknown prefetcher %d.\n", (int) kind);
+            exit(EXIT_FAILURE);
+    }
+}
+
+// Prefetcher effectiveness at one level
+typedef struct {
+    prefetcher_kind_t kind;
+    uint64_t issued;
+    uint64_t useful;
+    uint64_t late;
+    uint64_t useless;
+    uint64_t demand_misses;     // misses left at that level
+} prefetcher_stats_t;
+
+void print_prefetcher_stats(const char* level, const prefetcher_stats_t& s, bool timed){
+    double coverage   = (s.useful + s.demand_misses > 0) ? (double) s.useful / (double) (s.useful + s.demand_misses) : 0;
+    double accuracy   = (s.issued > 0) ? (double) s.useful / (double) s.issued : 0;
+    double timeliness = (s.useful > 0) ? (double) (s.useful - s.late) / (double) s.useful : 0;
+
+    printf("%s %-9s %10llu %10llu %10llu %10llu %9.4f %9.4f", level, prefetcher_names[s.kind],
+           (unsigned long long) s.issued, (unsigned long long) s.useful, (unsigned long long) s.late,
+           (unsigned long long) s.useless, coverage, accuracy);
+    if (timed){
+        printf(" %10.4f\n", timeliness);
+    }else{
+        printf(" %10s\n", "n/a");
+    }
+}
+
+#endif // PREFETCHER_H
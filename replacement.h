@@ -0,0 +1,440 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <vector>
+#include <algorithm> //stable_sort
+#include "checkpoint.h"
+
+using namespace std;
+
+// Way number within a set; bounds the associativity
+typedef uint16_t way_t;
+#define MAX_ASSOC 65535
+
+typedef enum {
+    REPL_LRU = 0,
+    REPL_PLRU,      // tree pseudo-LRU
+    REPL_SRRIP,     // static RRIP, 2-bit RRPVs
+    REPL_BRRIP,     // bimodal RRIP
+    REPL_DRRIP,     // set-dueling SRRIP/BRRIP
+    REPL_RANDOM,
+    REPL_FIFO,
+    REPL_NUM_POLICIES
+} repl_policy_t;
+
+static const char* const repl_policy_names[REPL_NUM_POLICIES] = {
+    "lru", "plru", "srrip", "brrip", "drrip", "random", "fifo"
+};
+
+// Returns REPL_NUM_POLICIES if name isn't a known policy
+static inline repl_policy_t parse_repl_policy(const char* name){
+    for (int p = 0; p < REPL_NUM_POLICIES; p++){
+        if (strcmp(name, repl_policy_names[p]) == 0){
+            return (repl_policy_t) p;
+        }
+    }
+    return REPL_NUM_POLICIES;
+}
+
+// Small deterministic PRNG (xorshift32) so runs are reproducible
+static inline uint32_t xorshift32(uint32_t* s){
+    uint32_t x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+// Replacement state of one cache level. The Cache fills invalid ways on its
+// own and only asks the policy for a victim once a set is full.
+class ReplacementPolicy {
+    protected:
+        uint32_t sets_num;
+        uint32_t assoc;
+
+    public:
+        ReplacementPolicy(uint32_t sets_num, uint32_t assoc){
+            this->sets_num = sets_num;
+            this->assoc    = assoc;
+        }
+        virtual ~ReplacementPolicy(){}
+
+        virtual repl_policy_t kind() = 0;
+        const char* name(){ return repl_policy_names[this->kind()]; }
+
+        virtual void on_hit(uint32_t set, uint32_t way) = 0;
+        virtual void on_fill(uint32_t set, uint32_t way) = 0;
+        // A block left the set; its way should be the next to go
+        virtual void on_invalidate(uint32_t set, uint32_t way) = 0;
+        // A fill the level expects no reuse of (reuse_predictor.h): it goes
+        // in where the next victim would be taken from
+        virtual void on_fill_low(uint32_t set, uint32_t way){
+            this->on_fill(set, way);
+            this->on_invalidate(set, way);
+        }
+        virtual uint32_t victim(uint32_t set) = 0;
+
+        // Fills ways[0..assoc) from most to least protected (MRU -> LRU for LRU)
+        virtual void order(uint32_t set, uint32_t* ways) = 0;
+        // The Cache moved old way ways[j] to way j (after order()); remap the state
+        virtual void permute(uint32_t set, const uint32_t* ways) = 0;
+
+        // Checkpoints (checkpoint.h); load() reads what save() wrote for a
+        // policy of the same kind and geometry
+        virtual void save(CheckpointWriter& w) = 0;
+        virtual void load(CheckpointReader& r) = 0;
+        // Takes over the state of set from src, a policy of the same kind and
+        // geometry (set-partitioned runs, partition.h)
+        virtual void copy_set(const ReplacementPolicy* src, uint32_t set) = 0;
+};
+
+// True LRU (and FIFO, which only promotes on fill): a doubly linked list of
+// the ways of each set, MRU at head[set] and LRU at tail[set], so promoting
+// a way and picking the victim are both O(1).
+class RecencyStackPolicy : public ReplacementPolicy {
+    private:
+        bool promote_on_hit;
+        vector<way_t> prev;
+        vector<way_t> next;
+        vector<way_t> head;
+        vector<way_t> tail;
+
+        void reset_set(uint32_t set){
+            size_t base = (size_t) set * this->assoc;
+            for (uint32_t j = 0; j < this->assoc; j++){
+                this->prev[base + j] = (way_t) (j - 1); // unused for the MRU
+                this->next[base + j] = (way_t) (j + 1); // unused for the LRU
+            }
+            this->head[set] = 0;
+            this->tail[set] = (way_t) (this->assoc - 1);
+        }
+
+        void unlink(uint32_t set, uint32_t way){
+            size_t base = (size_t) set * this->assoc;
+            way_t p = this->prev[base + way];
+            way_t n = this->next[base + way];
+
+            if (this->head[set] == way){
+                this->head[set] = n;
+            }else{
+                this->next[base + p] = n;
+            }
+            if (this->tail[set] == way){
+                this->tail[set] = p;
+            }else{
+                this->prev[base + n] = p;
+            }
+        }
+
+        void make_mru(uint32_t set, uint32_t way){
+            if (this->head[set] == way){
+                return;
+            }
+            size_t base = (size_t) set * this->assoc;
+            this->unlink(set, way);
+            this->next[base + way] = this->head[set];
+            this->prev[base + this->head[set]] = (way_t) way;
+            this->head[set] = (way_t) way;
+        }
+
+        void make_lru(uint32_t set, uint32_t way){
+            if (this->tail[set] == way){
+                return;
+            }
+            size_t base = (size_t) set * this->assoc;
+            this->unlink(set, way);
+            this->prev[base + way] = this->tail[set];
+            this->next[base + this->tail[set]] = (way_t) way;
+            this->tail[set] = (way_t) way;
+        }
+
+    public:
+        RecencyStackPolicy(uint32_t sets_num, uint32_t assoc, bool promote_on_hit) : ReplacementPolicy(sets_num, assoc){
+            this->promote_on_hit = promote_on_hit;
+            this->prev.resize((size_t) sets_num * assoc);
+            this->next.resize((size_t) sets_num * assoc);
+            this->head.resize(sets_num);
+            this->tail.resize(sets_num);
+            for (uint32_t i = 0; i < sets_num; i++){
+                this->reset_set(i);
+            }
+        }
+
+        repl_policy_t kind(){ return this->promote_on_hit ? REPL_LRU : REPL_FIFO; }
+
+        void on_hit(uint32_t set, uint32_t way){
+            if (this->promote_on_hit){
+                this->make_mru(set, way);
+            }
+        }
+        void on_fill(uint32_t set, uint32_t way){ this->make_mru(set, way); }
+        void on_invalidate(uint32_t set, uint32_t way){ this->make_lru(set, way); }
+        uint32_t victim(uint32_t set){ return this->tail[set]; }
+
+        void order(uint32_t set, uint32_t* ways){
+            size_t base = (size_t) set * this->assoc;
+            uint32_t way = this->head[set];
+            for (uint32_t j = 0; j < this->assoc; j++){
+                ways[j] = way;
+                way = this->next[base + way];
+            }
+        }
+        void permute(uint32_t set, const uint32_t* ways){ this->reset_set(set); }
+
+        void save(CheckpointWriter& w){
+            w.put_vector(this->prev);
+            w.put_vector(this->next);
+            w.put_vector(this->head);
+            w.put_vector(this->tail);
+        }
+        void load(CheckpointReader& r){
+            r.get_vector(this->prev);
+            r.get_vector(this->next);
+            r.get_vector(this->head);
+            r.get_vector(this->tail);
+        }
+        void copy_set(const ReplacementPolicy* src, uint32_t set){
+            const RecencyStackPolicy* s = static_cast<const RecencyStackPolicy*>(src);
+            size_t base = (size_t) set * this->assoc;
+            copy(s->prev.begin() + base, s->prev.begin() + base + this->assoc, this->prev.begin() + base);
+            copy(s->next.begin() + base, s->next.begin() + base + this->assoc, this->next.begin() + base);
+            this->head[set] = s->head[set];
+            this->tail[set] = s->tail[set];
+        }
+};
+
+// Tree pseudo-LRU: assoc-1 bits per set, packed in 64-bit words. Each bit
+// points towards the less recently used half of its subtree.
+class TreePlruPolicy : public ReplacementPolicy {
+    private:
+        uint32_t words_per_set;
+        vector<uint64_t> bits;
+
+        bool get(uint32_t set, uint32_t node){
+            return (this->bits[(size_t) set * this->words_per_set + node / 64] >> (node % 64)) & 1;
+        }
+        void put(uint32_t set, uint32_t node, bool v){
+            uint64_t& w = this->bits[(size_t) set * this->words_per_set + node / 64];
+            w = (w & ~(1ULL << (node % 64))) | ((uint64_t) v << (node % 64));
+        }
+
+    public:
+        TreePlruPolicy(uint32_t sets_num, uint32_t assoc) : ReplacementPolicy(sets_num, assoc){
+            if (assoc & (assoc - 1)){
+                printf("Error: plru replacement needs a power-of-2 associativity (got %u).\n", assoc);
+                exit(EXIT_FAILURE);
+            }
+            this->words_per_set = (assoc + 63) / 64;
+            this->bits.assign((size_t) sets_num * this->words_per_set, 0);
+        }
+
+        repl_policy_t kind(){ return REPL_PLRU; }
+
+        // Points every node on way's path away from it
+        void on_hit(uint32_t set, uint32_t way){
+            uint32_t node = 0;
+            for (uint32_t span = this->assoc / 2; span >= 1; span /= 2){
+                bool right = (way & span) != 0;
+                this->put(set, node, !right);
+                node = 2 * node + 1 + right;
+            }
+        }
+        void on_fill(uint32_t set, uint32_t way){ this->on_hit(set, way); }
+
+        // Points every node on way's path towards it
+        void on_invalidate(uint32_t set, uint32_t way){
+            uint32_t node = 0;
+            for (uint32_t span = this->assoc / 2; span >= 1; span /= 2){
+                bool right = (way & span) != 0;
+                this->put(set, node, right);
+                node = 2 * node + 1 + right;
+            }
+        }
+
+        uint32_t victim(uint32_t set){
+            uint32_t node = 0, way = 0;
+            for (uint32_t span = this->assoc / 2; span >= 1; span /= 2){
+                bool right = this->get(set, node);
+                way |= right ? span : 0;
+                node = 2 * node + 1 + right;
+            }
+            return way;
+        }
+
+        // Replays victim selection: the first victim is the least protected
+        void order(uint32_t set, uint32_t* ways){
+            size_t base = (size_t) set * this->words_per_set;
+            vector<uint64_t> saved(this->bits.begin() + base, this->bits.begin() + base + this->words_per_set);
+            for (uint32_t j = this->assoc; j > 0; j--){
+                ways[j - 1] = this->victim(set);
+                this->on_hit(set, ways[j - 1]);
+            }
+            copy(saved.begin(), saved.end(), this->bits.begin() + base);
+        }
+        // Touching the ways from least to most protected rebuilds the same order
+        void permute(uint32_t set, const uint32_t* ways){
+            for (uint32_t j = this->assoc; j > 0; j--){
+                this->on_hit(set, j - 1);
+            }
+        }
+
+        void save(CheckpointWriter& w){ w.put_vector(this->bits); }
+        void copy_set(const ReplacementPolicy* src, uint32_t set){
+            const TreePlruPolicy* s = static_cast<const TreePlruPolicy*>(src);
+            size_t base = (size_t) set * this->words_per_set;
+            copy(s->bits.begin() + base, s->bits.begin() + base + this->words_per_set, this->bits.begin() + base);
+        }
+        void load(CheckpointReader& r){ r.get_vector(this->bits); }
+};
+
+// Re-reference interval prediction (Jaleel et al., ISCA 2010) with 2-bit
+// RRPVs. SRRIP inserts at "long" re-reference, BRRIP mostly at "distant",
+// DRRIP picks between them by set dueling.
+#define RRPV_MAX          3
+#define BRRIP_LONG_ODDS   32   // BRRIP inserts at RRPV_MAX-1 once every ~32 fills
+#define DRRIP_LEADERS     32   // leader sets per competing policy
+#define DRRIP_PSEL_BITS   10
+
+class RripPolicy : public ReplacementPolicy {
+    private:
+        repl_policy_t variant;
+        vector<uint8_t> rrpv;
+        uint32_t rng;
+        uint32_t psel;
+        uint32_t leader_stride;
+
+        bool brrip_insert(uint32_t set){
+            if (this->variant != REPL_DRRIP){
+                return this->variant == REPL_BRRIP;
+            }
+            uint32_t off = set % this->leader_stride;
+            if (off == 0) return false;                          // SRRIP leader
+            if (off == this->leader_stride - 1) return true;     // BRRIP leader
+            return this->psel >= (1u << (DRRIP_PSEL_BITS - 1));  // follower
+        }
+
+    public:
+        RripPolicy(uint32_t sets_num, uint32_t assoc, repl_policy_t variant) : ReplacementPolicy(sets_num, assoc){
+            this->variant = variant;
+            this->rrpv.assign((size_t) sets_num * assoc, RRPV_MAX);
+            this->rng  = 0x9e3779b9;
+            this->psel = 1u << (DRRIP_PSEL_BITS - 1);
+            this->leader_stride = max(2u, sets_num / DRRIP_LEADERS);
+        }
+
+        repl_policy_t kind(){ return this->variant; }
+
+        void on_hit(uint32_t set, uint32_t way){ this->rrpv[(size_t) set * this->assoc + way] = 0; }
+
+        void on_fill(uint32_t set, uint32_t way){
+            // A fill means the set missed; leader set misses steer PSEL
+            if (this->variant == REPL_DRRIP){
+                uint32_t off = set % this->leader_stride;
+                if (off == 0 && this->psel < (1u << DRRIP_PSEL_BITS) - 1){
+                    this->psel++;
+                }else if (off == this->leader_stride - 1 && this->psel > 0){
+                    this->psel--;
+                }
+            }
+            bool distant = this->brrip_insert(set) && (xorshift32(&this->rng) % BRRIP_LONG_ODDS) != 0;
+            this->rrpv[(size_t) set * this->assoc + way] = distant ? RRPV_MAX : RRPV_MAX - 1;
+        }
+
+        void on_invalidate(uint32_t set, uint32_t way){ this->rrpv[(size_t) set * this->assoc + way] = RRPV_MAX; }
+
+        uint32_t victim(uint32_t set){
+            uint8_t* r = &this->rrpv[(size_t) set * this->assoc];
+            while (true){
+                for (uint32_t j = 0; j < this->assoc; j++){
+                    if (r[j] == RRPV_MAX){
+                        return j;
+                    }
+                }
+                for (uint32_t j = 0; j < this->assoc; j++){
+                    r[j]++;
+                }
+            }
+        }
+
+        void order(uint32_t set, uint32_t* ways){
+            const uint8_t* r = &this->rrpv[(size_t) set * this->assoc];
+            for (uint32_t j = 0; j < this->assoc; j++){
+                ways[j] = j;
+            }
+            stable_sort(ways, ways + this->assoc, [r](uint32_t a, uint32_t b){ return r[a] < r[b]; });
+        }
+        void permute(uint32_t set, const uint32_t* ways){
+            uint8_t* r = &this->rrpv[(size_t) set * this->assoc];
+            vector<uint8_t> old(r, r + this->assoc);
+            for (uint32_t j = 0; j < this->assoc; j++){
+                r[j] = old[ways[j]];
+            }
+        }
+
+        void save(CheckpointWriter& w){
+            w.put(this->rng);
+            w.put(this->psel);
+            w.put_vector(this->rrpv);
+        }
+        void load(CheckpointReader& r){
+            this->rng  = r.get<uint32_t>();
+            this->psel = r.get<uint32_t>();
+            r.get_vector(this->rrpv);
+        }
+        // Only the set's RRPVs; PSEL and the BRRIP odds are shared by all sets
+        void copy_set(const ReplacementPolicy* src, uint32_t set){
+            const RripPolicy* s = static_cast<const RripPolicy*>(src);
+            size_t base = (size_t) set * this->assoc;
+            copy(s->rrpv.begin() + base, s->rrpv.begin() + base + this->assoc, this->rrpv.begin() + base);
+        }
+};
+
+// Uniformly random victim; no per-set state at all
+class RandomPolicy : public ReplacementPolicy {
+    private:
+        uint32_t rng;
+
+    public:
+        RandomPolicy(uint32_t sets_num, uint32_t assoc) : ReplacementPolicy(sets_num, assoc){
+            this->rng = 0x2545f491;
+        }
+
+        repl_policy_t kind(){ return REPL_RANDOM; }
+
+        void on_hit(uint32_t set, uint32_t way){}
+        void on_fill(uint32_t set, uint32_t way){}
+        void on_invalidate(uint32_t set, uint32_t way){}
+        uint32_t victim(uint32_t set){ return xorshift32(&this->rng) % this->assoc; }
+
+        void order(uint32_t set, uint32_t* ways){
+            for (uint32_t j = 0; j < this->assoc; j++){
+                ways[j] = j;
+            }
+        }
+        void permute(uint32_t set, const uint32_t* ways){}
+
+        void save(CheckpointWriter& w){ w.put(this->rng); }
+        void load(CheckpointReader& r){ this->rng = r.get<uint32_t>(); }
+        void copy_set(const ReplacementPolicy* src, uint32_t set){}
+};
+
+static ReplacementPolicy* make_replacement_policy(repl_policy_t policy, uint32_t sets_num, uint32_t assoc){
+    switch (policy){
+        case REPL_LRU:    return new RecencyStackPolicy(sets_num, assoc, true);
+        case REPL_FIFO:   return new RecencyStackPolicy(sets_num, assoc, false);
+        case REPL_PLRU:   return new TreePlruPolicy(sets_num, assoc);
+        case REPL_SRRIP:
+        case REPL_BRRIP:
+        case REPL_DRRIP:  return new RripPolicy(sets_num, assoc, policy);
+        case REPL_RANDOM: return new RandomPolicy(sets_num, assoc);
+        default:
+            printf("Error: unknown replacement policy %d.\n", (int) policy);
+            exit(EXIT_FAILURE);
+    }
+}
+
+#endif // REPLACEMENT_H
@@ -0,0 +1,412 @@
+#ifndef REUSE_PREDICTOR_H
+#define REUSE_PREDICTOR_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <vector>
+#include "addr.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+/*  Reuse predictors for the last level (--llc-reuse): guess, on a demand
+    miss, whether the block will be touched again before it's evicted. A
+    block predicted dead either goes in at the lowest priority, where the
+    next miss in the set evicts it unless it's hit first, or bypasses the
+    level (reads go up without a copy staying here, writes go on down
+    unfetched). Streaming data then stops pushing out blocks that are
+    reused.
+
+    The traces carry no PCs, so both predictors key on the block's address
+    region (REUSE_REGION_BITS blocks) where the published designs use the
+    PC of the load:
+
+    ship    signature-based hit prediction (Wu et al., SHiP): a table of
+            saturating counters per region signature, incremented when a
+            block of the region hits and decremented when one is evicted
+            without having hit. A zero counter predicts dead. Only the
+            sampled sets train it, and they always insert, so regions it
+            stopped caching keep being learned.
+    sdbp    sampling dead-block prediction (Khan et al., SDBP): a small LRU
+            tag array shadows the sampled sets and trains three skewed
+            tables of counters: up when a sampler entry is evicted after
+            its last touch, down when it's touched again. Their sum at or
+            over a threshold predicts dead.
+
+    Demand accesses of the level (reads and writes) train the predictor;
+    prefetches neither train it nor ask it.
+*/
+
+#define REUSE_REGION_BITS   6   // 64-block regions (a 4K page of 64 byte blocks)
+#define REUSE_SAMPLED_SETS  32  // about: 1 in sets / 32 sets is sampled, and at most every other one
+#define REUSE_BYPASS_ODDS   32  // bypass mode still inserts 1 in 32 dead blocks (at low priority)
+
+typedef enum {
+    REUSE_NONE = 0,
+    REUSE_SHIP,
+    REUSE_SDBP,
+    REUSE_NUM_KINDS
+} reuse_kind_t;
+
+static const char* const reuse_kind_names[REUSE_NUM_KINDS] = { "none", "ship", "sdbp" };
+
+// What happens to a block predicted dead
+typedef enum {
+    REUSE_INSERT_LOW = 0,   // inserted at the lowest priority
+    REUSE_BYPASS,           // not cached at this level
+    REUSE_NUM_MODES
+} reuse_mode_t;
+
+static const char* const reuse_mode_names[REUSE_NUM_MODES] = { "low", "bypass" };
+
+// What the Cache does with a missing block
+typedef enum {
+    REUSE_FILL = 0,         // as usual
+    REUSE_FILL_LOW,         // at the lowest priority
+    REUSE_SKIP              // bypass the level
+} reuse_decision_t;
+
+// Returns REUSE_NUM_KINDS if name isn't a known predictor
+static inline reuse_kind_t parse_reuse_kind(const char* name){
+    for (int k = REUSE_NONE; k < REUSE_NUM_KINDS; k++){
+        if (strcmp(name, reuse_kind_names[k]) == 0){
+            return (reuse_kind_t) k;
+        }
+    }
+    return REUSE_NUM_KINDS;
+}
+
+// Returns REUSE_NUM_MODES if name isn't a known mode
+static inline reuse_mode_t parse_reuse_mode(const char* name){
+    for (int m = 0; m < REUSE_NUM_MODES; m++){
+        if (strcmp(name, reuse_mode_names[m]) == 0){
+            return (reuse_mode_t) m;
+        }
+    }
+    return REUSE_NUM_MODES;
+}
+
+// Reuse predictor of one cache level. The Cache shows it the level's
+// demand hits and misses, and every fill and eviction of a way.
+class ReusePredictor {
+    protected:
+        uint32_t sets_num;
+        uint32_t assoc;
+        uint32_t sample_stride;
+
+        bool sampled(uint32_t set){ return set % this->sample_stride == 0; }
+        uint32_t sampled_sets(){ return (this->sets_num + this->sample_stride - 1) / this->sample_stride; }
+        // Hash of block_addr's region, bits wide
+        static uint32_t signature(addr_t block_addr, uint32_t bits){
+            uint64_t h = (uint64_t) (block_addr >> REUSE_REGION_BITS) * 0x9e3779b97f4a7c15ull;
+            return (uint32_t) (h >> (64 - bits));
+        }
+
+        // Demand miss of block_addr in set: train, and return the prediction
+        virtual bool predict_dead(addr_t block_addr, uint32_t set) = 0;
+        virtual void save_state(CheckpointWriter& w) = 0;
+        virtual void load_state(CheckpointReader& r) = 0;
+
+    public:
+        reuse_mode_t mode;
+        uint64_t predictions;   // demand misses it was asked about
+        uint64_t dead;          // ... predicted dead
+        uint64_t bypassed;      // ... of those, not cached (bypass mode)
+
+        ReusePredictor(uint32_t sets_num, uint32_t assoc, reuse_mode_t mode){
+            this->sets_num    = sets_num;
+            this->assoc       = assoc;
+            this->sample_stride = max(2u, sets_num / REUSE_SAMPLED_SETS);
+            this->mode        = mode;
+            this->predictions = 0;
+            this->dead        = 0;
+            this->bypassed    = 0;
+        }
+        virtual ~ReusePredictor(){}
+
+        virtual reuse_kind_t kind() = 0;
+        const char* name(){ return reuse_kind_names[this->kind()]; }
+
+        // Demand miss of block_addr in set. A block predicted dead goes in
+        // at the lowest priority, or in bypass mode skips the level, except
+        // one in REUSE_BYPASS_ODDS: a region wrongly taken for dead still
+        // gets its hot blocks cached that way.
+        reuse_decision_t on_miss(addr_t block_addr, uint32_t set){
+            this->predictions++;
+            if (!this->predict_dead(block_addr, set)){
+                return REUSE_FILL;
+            }
+            this->dead++;
+            if (this->mode == REUSE_BYPASS && this->dead % REUSE_BYPASS_ODDS != 0){
+                this->bypassed++;
+                return REUSE_SKIP;
+            }
+            return REUSE_FILL_LOW;
+        }
+        virtual void on_hit(addr_t block_addr, uint32_t set, uint32_t way) = 0;
+        // block_addr went into way of set (any fill, prefetches too)
+        virtual void on_fill(addr_t block_addr, uint32_t set, uint32_t way){}
+        // The block in way of set left the level
+        virtual void on_evict(uint32_t set, uint32_t way){}
+
+        // Checkpoints (checkpoint.h): the counters, then the kind's state,
+        // which is only loaded into a predictor of the same kind and geometry
+        void save(CheckpointWriter& w){
+            w.put(this->predictions);
+            w.put(this->dead);
+            w.put(this->bypassed);
+            this->save_state(w);
+        }
+        void load(CheckpointReader& r){
+            this->predictions = r.get<uint64_t>();
+            this->dead        = r.get<uint64_t>();
+            this->bypassed    = r.get<uint64_t>();
+            this->load_state(r);
+        }
+};
+
+// SHiP with region signatures, trained by the sampled sets only (which
+// always insert, so what it learns doesn't depend on what it bypassed): per
+// block of those, the signature it was filled with and whether it hit
+// since. Counters start at zero, so a region nothing has hit in yet (a
+// stream's next one) is predicted dead.
+class ShipPredictor : public ReusePredictor {
+    private:
+        static const uint32_t SHCT_BITS   = 14;
+        static const uint8_t  COUNTER_MAX = 7;
+
+        vector<uint8_t>  shct;      // signature history counter table
+        vector<uint16_t> sig;       // per way of the sampled sets
+        vector<uint8_t>  reused;
+
+        size_t entry(uint32_t set, uint32_t way){ return (size_t) (set / this->sample_stride) * this->assoc + way; }
+
+    protected:
+        bool predict_dead(addr_t block_addr, uint32_t set){
+            return !sampled(set) && this->shct[signature(block_addr, SHCT_BITS)] == 0;
+        }
+        void save_state(CheckpointWriter& w){
+            w.put_vector(this->shct);
+            w.put_vector(this->sig);
+            w.put_vector(this->reused);
+        }
+        void load_state(CheckpointReader& r){
+            r.get_vector(this->shct);
+            r.get_vector(this->sig);
+            r.get_vector(this->reused);
+        }
+
+    public:
+        ShipPredictor(uint32_t sets_num, uint32_t assoc, reuse_mode_t mode) : ReusePredictor(sets_num, assoc, mode){
+            this->shct.assign(1u << SHCT_BITS, 0);
+            this->sig.assign((size_t) this->sampled_sets() * assoc, 0);
+            this->reused.assign((size_t) this->sampled_sets() * assoc, 0);
+        }
+
+        reuse_kind_t kind(){ return REUSE_SHIP; }
+
+        void on_hit(addr_t block_addr, uint32_t set, uint32_t way){
+            if (!sampled(set)){
+                return;
+            }
+            size_t e = this->entry(set, way);
+            this->reused[e] = 1;
+            if (this->shct[this->sig[e]] < COUNTER_MAX){
+                this->shct[this->sig[e]]++;
+            }
+        }
+        void on_fill(addr_t block_addr, uint32_t set, uint32_t way){
+            if (!sampled(set)){
+                return;
+            }
+            size_t e = this->entry(set, way);
+            this->sig[e]    = (uint16_t) signature(block_addr, SHCT_BITS);
+            this->reused[e] = 0;
+        }
+        void on_evict(uint32_t set, uint32_t way){
+            if (!sampled(set)){
+                return;
+            }
+            size_t e = this->entry(set, way);
+            if (!this->reused[e] && this->shct[this->sig[e]] > 0){
+                this->shct[this->sig[e]]--;
+            }
+        }
+};
+
+// SDBP with region signatures. The sampler has up to SAMPLER_WAYS ways
+// (no more than the level) per sampled set, with partial tags and true
+// LRU; it sees the sampled sets' demand accesses whether the level keeps
+// their blocks or not.
+class SdbpPredictor : public ReusePredictor {
+    private:
+        static const uint32_t SAMPLER_WAYS = 12;
+        static const uint32_t TABLES       = 3;
+        static const uint32_t TABLE_BITS   = 12;
+        static const uint8_t  COUNTER_MAX  = 3;
+        static const uint32_t THRESHOLD    = 8;    // of TABLES * COUNTER_MAX
+
+        struct sampler_entry {
+            uint16_t tag;       // partial tag
+            uint16_t sig;       // signature of the last touch
+            uint8_t  lru;       // 0 is MRU
+            uint8_t  valid;
+        };
+
+        uint32_t ways;
+        vector<sampler_entry> sampler;
+        vector<uint8_t> tables;     // TABLES tables of 1 << TABLE_BITS counters
+
+        // Counter of signature s in table t; each table hashes it differently
+        uint8_t& counter(uint32_t t, uint16_t s){
+            uint32_t i = ((uint32_t) s * (2 * t + 1) ^ (s >> (4 * t + 1))) & ((1u << TABLE_BITS) - 1);
+            return this->tables[(t << TABLE_BITS) | i];
+        }
+        uint32_t confidence(uint16_t s){
+            uint32_t sum = 0;
+            for (uint32_t t = 0; t < TABLES; t++){
+                sum += this->counter(t, s);
+            }
+            return sum;
+        }
+        void train(uint16_t s, bool died){
+            for (uint32_t t = 0; t < TABLES; t++){
+                uint8_t& c = this->counter(t, s);
+                if (died && c < COUNTER_MAX) c++;
+                if (!died && c > 0) c--;
+            }
+        }
+
+        // Demand access of block_addr to set
+        void sample(addr_t block_addr, uint32_t set){
+            if (!sampled(set)){
+                return;
+            }
+            sampler_entry* ways = &this->sampler[(size_t) (set / this->sample_stride) * this->ways];
+            uint16_t tag = (uint16_t) ((block_addr / this->sets_num) * 0x9e3779b1u >> 16);
+            uint16_t sig = (uint16_t) signature(block_addr, 16);
+
+            uint32_t w;
+            for (w = 0; w < this->ways && !(ways[w].valid && ways[w].tag == tag); w++){
+            }
+            if (w < this->ways){
+                this->train(ways[w].sig, false); // touched again: the last touch wasn't
+            }else{
+                w = 0;
+                for (uint32_t j = 0; j < this->ways; j++){
+                    if (!ways[j].valid){
+                        w = j;
+                        break;
+                    }
+                    if (ways[j].lru > ways[w].lru){
+                        w = j;
+                    }
+                }
+                if (ways[w].valid){
+                    this->train(ways[w].sig, true); // evicted after its last touch
+                }else{
+                    ways[w].lru = this->ways - 1;
+                }
+                ways[w].tag   = tag;
+                ways[w].valid = 1;
+            }
+            ways[w].sig = sig;
+            for (uint32_t j = 0; j < this->ways; j++){
+                if (ways[j].lru < ways[w].lru){
+                    ways[j].lru++;
+                }
+            }
+            ways[w].lru = 0;
+        }
+
+    protected:
+        bool predict_dead(addr_t block_addr, uint32_t set){
+            this->sample(block_addr, set);
+            return this->confidence((uint16_t) signature(block_addr, 16)) >= THRESHOLD;
+        }
+        void save_state(CheckpointWriter& w){
+            w.put_vector(this->sampler);
+            w.put_vector(this->tables);
+        }
+        void load_state(CheckpointReader& r){
+            r.get_vector(this->sampler);
+            r.get_vector(this->tables);
+        }
+
+    public:
+        SdbpPredictor(uint32_t sets_num, uint32_t assoc, reuse_mode_t mode) : ReusePredictor(sets_num, assoc, mode){
+            sampler_entry empty = { 0, 0, 0, 0 };
+            this->ways = (assoc < SAMPLER_WAYS) ? assoc : SAMPLER_WAYS;
+            this->sampler.assign((size_t) this->sampled_sets() * this->ways, empty);
+            this->tables.assign(TABLES << TABLE_BITS, 0);
+        }
+
+        reuse_kind_t kind(){ return REUSE_SDBP; }
+
+        void on_hit(addr_t block_addr, uint32_t set, uint32_t way){ this->sample(block_addr, set); }
+};
+
+// Returns NULL for REUSE_NONE
+static ReusePredictor* make_reuse_predictor(reuse_kind_t kind, reuse_mode_t mode, uint32_t sets_num, uint32_t assoc){
+    switch (kind){
+        case REUSE_NONE: return NULL;
+        case REUSE_SHIP: return new ShipPredictor(sets_num, assoc, mode);
+        case REUSE_SDBP: return new SdbpPredictor(sets_num, assoc, mode);
+        default:
+            printf("Error: unknown reuse predictor %d.\n", (int) kind);
+            exit(EXIT_FAILURE);
+    }
+}
+
+// A run's last level and memory traffic, for comparing a run with a reuse
+// predictor to one without
+typedef struct {
+    uint64_t accesses;      // demand reads and writes of the last level
+    uint64_t misses;
+    uint64_t mem_traffic;   // q
+    uint64_t mem_bytes;     // bytes the last level moved to and from memory
+} reuse_outcome_t;
+
+void print_reuse_delta(const char* name, double base, double with, bool rate){
+    if (rate){
+        printf("%-24s %14.4f %14.4f %+14.4f", name, base, with, with - base);
+    }else{
+        printf("%-24s %14.0f %14.0f %+14.0f", name, base, with, with - base);
+    }
+    if (base > 0){
+        printf(" %+8.2f%%\n", 100 * (with - base) / base);
+    }else{
+        printf(" %9s\n", "-");
+    }
+}
+
+// level names the predictor's level and with is its outcome; base, if not
+// NULL, is that of the same run without it
+void print_reuse_stats(const char* level, ReusePredictor* p, const reuse_outcome_t& with, const reuse_outcome_t* base){
+    printf("===== Reuse predictor =====\n");
+    printf("%-32s %s at %s, %s\n", "predictor:", p->name(), level,
+           (p->mode == REUSE_BYPASS) ? "dead blocks bypass" : "dead blocks inserted at low priority");
+    printf("%-32s %llu\n", "demand misses predicted:", (unsigned long long) p->predictions);
+    printf("%-32s %llu (%.2f%%)\n", "predicted dead:", (unsigned long long) p->dead,
+           p->predictions ? 100.0 * p->dead / p->predictions : 0.0);
+    if (p->mode == REUSE_BYPASS){
+        printf("%-32s %llu\n", "bypassed:", (unsigned long long) p->bypassed);
+    }
+    if (base == NULL){
+        printf("%-32s %llu\n", "LLC misses:", (unsigned long long) with.misses);
+        printf("%-32s %.4f\n", "LLC miss rate:", with.accesses ? (double) with.misses / with.accesses : 0.0);
+        printf("%-32s %llu\n", "memory traffic:", (unsigned long long) with.mem_traffic);
+        printf("%-32s %llu\n", "memory traffic (bytes):", (unsigned long long) with.mem_bytes);
+        return;
+    }
+    printf("%-24s %14s %14s %14s %9s\n", "", "baseline", "predictor", "delta", "");
+    print_reuse_delta("LLC misses", (double) base->misses, (double) with.misses, false);
+    print_reuse_delta("LLC miss rate", base->accesses ? (double) base->misses / base->accesses : 0.0,
+                      with.accesses ? (double) with.misses / with.accesses : 0.0, true);
+    print_reuse_delta("memory traffic", (double) base->mem_traffic, (double) with.mem_traffic, false);
+    print_reuse_delta("memory traffic (bytes)", (double) base->mem_bytes, (double) with.mem_bytes, false);
+}
+
+#endif // REUSE_PREDICTOR_H
@@ -0,0 +1,395 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include "cachesim.h"
+#include "hierarchy.h"
+#include "trace_reader.h"
+#include "profile.h"
+
+using namespace std;
+
+/*  Sampled simulation, after SMARTS (Wunderlich et al., ISCA 2003) and set
+    sampling (Kessler, Hill and Wood, 1994). The trace is cut into periods
+    of `period` accesses, and each period
+
+        fast-forwards  its first period - warmup - unit accesses: either
+                       still updating the cache contents and replacement
+                       state (functional warming, which keeps them exact
+                       at a fraction of the cost of a simulated access,
+                       but counts nothing and leaves the prefetchers
+                       alone) or skipping them outright
+        warms up       the next warmup accesses, simulated but not measured,
+                       to rebuild the state skipping lost
+        measures       its last unit accesses
+
+    With set sampling only 1 in `sets` of the cache sets is simulated: the
+    accesses to the others are dropped before L1. The sampled sets are
+    picked with the same block address bits at every level (the top bits
+    of the smallest index), so a kept block is in a sampled set everywhere,
+    and runs of consecutive blocks stay together for the prefetchers.
+
+    Each measured unit yields the a-q counts of its accesses. A count is
+    extrapolated as trace accesses x sets x (its sum over the units / the
+    units' accesses), a ratio estimator, with a 95% confidence interval from
+    the spread of the units around that ratio (Student's t). Without
+    periods every access is measured, in consecutive units of `unit`
+    accesses (batch means). The interval covers the variation over time;
+    with set sampling it does not cover how far the sampled sets are from
+    the average set, so a sets-only run may be off by more than it claims.
+*/
+
+typedef enum {
+    FAST_FORWARD_WARM = 0,  // functional warming
+    FAST_FORWARD_SKIP
+} fast_forward_t;
+
+typedef struct {
+    uint64_t period;        // accesses per period; 0 measures every access
+    uint64_t unit;          // accesses measured per period (per batch without periods)
+    uint64_t warmup;        // accesses simulated unmeasured right before each unit
+    uint32_t sets;          // 1 in sets of the cache sets is simulated (a power of 2)
+    fast_forward_t fast_forward;
+    bool validate;          // also run the full simulation and compare
+} sample_params_t;
+
+static inline sample_params_t default_sample_params(){
+    sample_params_t sp;
+    sp.period       = 0;
+    sp.unit         = 1000;
+    sp.warmup       = 2000;
+    sp.sets         = 1;
+    sp.fast_forward = FAST_FORWARD_WARM;
+    sp.validate     = false;
+    return sp;
+}
+
+// log2 of the smallest set count of the hierarchy of params
+static inline uint32_t min_index_bits(const cache_params_t& params){
+    uint32_t bits = log2(params.l1_size / (params.l1_assoc * params.blocksize));
+    if (params.l2_size > 0){
+        bits = min(bits, (uint32_t) log2(params.l2_size / (params.l2_assoc * params.blocksize)));
+    }
+    return bits;
+}
+
+// Returns NULL if sp can sample the hierarchy of params, else why not
+static inline const char* sample_params_error(const sample_params_t& sp, const cache_params_t& params){
+    if (sp.unit == 0){
+        return "Sampling units need at least one access.";
+    }
+    if (sp.period != 0 && sp.period < sp.unit + sp.warmup){
+        return "The sampling period must hold the warmup and the unit.";
+    }
+    if (sp.sets == 0 || (sp.sets & (sp.sets - 1))){
+        return "The set sampling ratio must be a power of 2.";
+    }
+    if ((uint32_t) log2(sp.sets) > min_index_bits(params)){
+        return "The set sampling ratio exceeds the set count of a level.";
+    }
+    if (sp.period == 0 && sp.sets == 1){
+        return "Nothing to sample; set --period or --sets.";
+    }
+    if (params.timing_enabled){
+        return "The timing model doesn't run in sampled simulations.";
+    }
+    return NULL;
+}
+
+// The a-q counts (all but the rates e and n), in order
+#define SAMPLE_COUNTS 15
+
+static const char* const sample_count_names[SAMPLE_COUNTS] = {
+    "a. L1 reads: ", "b. L1 read misses: ", "c. L1 writes: ", "d. L1 write misses: ", "f. L1 writebacks: ",
+    "g. L1 prefetches: ", "h. L2 reads (demand): ", "i. L2 read misses (demand): ", "j. L2 reads (prefetch): ",
+    "k. L2 read misses (prefetch): ", "l. L2 writes: ", "m. L2 write misses: ", "o. L2 writebacks: ",
+    "p. L2 prefetches: ", "q. memory traffic: "
+};
+
+static void measurement_counts(const measurements_t& m, double* v){
+    uint64_t c[SAMPLE_COUNTS] = { m.l1_reads, m.l1_read_misses, m.l1_writes, m.l1_write_misses, m.l1_writebacks,
+                                  m.l1_prefetches, m.l2_reads, m.l2_read_misses, m.l2_prefetch_reads,
+                                  m.l2_prefetch_read_misses, m.l2_writes, m.l2_write_misses, m.l2_writebacks,
+                                  m.l2_prefetches, m.mem_traffic };
+    for (uint32_t i = 0; i < SAMPLE_COUNTS; i++){
+        v[i] = c[i];
+    }
+}
+
+// One measured unit
+typedef struct {
+    double accesses;            // trace accesses it spans (sampled sets or not)
+    double counts[SAMPLE_COUNTS];
+} sample_unit_t;
+
+typedef struct {
+    uint64_t accesses;          // in the trace
+    uint64_t measured;          // simulated and measured
+    uint64_t warmed;            // simulated, unmeasured (warmup)
+    uint64_t functional;        // fast-forwarded with functional warming
+    uint64_t skipped;           // fast-forwarded without simulation or outside the sampled sets
+    double seconds;
+} sample_totals_t;
+
+typedef struct {
+    double value;
+    double half;                // of the 95% confidence interval; NAN with fewer than 2 units
+} sample_estimate_t;
+
+// Two-sided 95% quantile of Student's t with df degrees of freedom
+static double student_t95(uint64_t df){
+    static const double table[30] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                      2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                      2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if (df <= 30) return table[df - 1];
+    if (df <= 40) return 2.021;
+    if (df <= 60) return 2.000;
+    if (df <= 120) return 1.980;
+    return 1.960;
+}
+
+// sum(y) / sum(x) over the units, scaled by scale
+static sample_estimate_t ratio_estimate(const vector<double>& y, const vector<double>& x, double scale){
+    sample_estimate_t e;
+    double sy = 0, sx = 0;
+    for (size_t i = 0; i < y.size(); i++){
+        sy += y[i];
+        sx += x[i];
+    }
+    double r = (sx > 0) ? sy / sx : 0;
+    e.value  = r * scale;
+    e.half   = NAN;
+    size_t n = y.size();
+    if (n >= 2 && sx > 0){
+        double ss = 0;
+        for (size_t i = 0; i < n; i++){
+            ss += (y[i] - r * x[i]) * (y[i] - r * x[i]);
+        }
+        double se = sqrt(ss / (double) (n * (n - 1))) / (sx / n);
+        e.half = student_t95(n - 1) * se * scale;
+    }
+    return e;
+}
+
+static void open_trace(TraceReader& trace, const char* trace_file){
+    if (!trace.open(trace_file)) {
+       printf("Error: Unable to open file %s\n", trace_file);
+       exit(EXIT_FAILURE);
+    }
+}
+
+// Closes the unit measured since the counts were start
+static void close_unit(Hierarchy& h, const double* start, sample_unit_t& unit, vector<sample_unit_t>& units){
+    measurement_counts(h.stats(), unit.counts);
+    for (uint32_t c = 0; c < SAMPLE_COUNTS; c++){
+        unit.counts[c] -= start[c];
+    }
+    units.push_back(unit);
+}
+
+// Runs the sampled simulation of trace_file, appending the measured units
+static sample_totals_t simulate_sampled(const cache_params_t& params, const sample_params_t& sp, const char* trace_file,
+                                        vector<sample_unit_t>& units){
+    static trace_record batch[TRACE_BATCH_SIZE];
+    TraceReader trace;
+    Hierarchy h(params);
+    sample_totals_t t;
+    memset(&t, 0, sizeof(t));
+
+    uint32_t shift    = log2(params.blocksize) + min_index_bits(params) - log2(sp.sets);
+    addr_t   set_mask = sp.sets - 1;
+    uint64_t period   = sp.period ? sp.period : sp.unit;
+    uint64_t ff_end   = sp.period ? sp.period - sp.warmup - sp.unit : 0;    // first warmup access of a period
+    uint64_t unit_at  = sp.period ? sp.period - sp.unit : 0;                // first measured access
+    bool measuring    = false;
+    double start[SAMPLE_COUNTS];
+    sample_unit_t unit;
+
+    double began = now_seconds();
+    open_trace(trace, trace_file);
+    uint32_t n;
+    while ((n = trace.next_batch(batch, TRACE_BATCH_SIZE)) > 0) {
+        for (uint32_t i = 0; i < n; i++, t.accesses++) {
+            if (batch[i].rw != 'r' && batch[i].rw != 'w'){
+                printf("Error: Unknown request type %c.\n", batch[i].rw);
+                exit(EXIT_FAILURE);
+            }
+            uint64_t pos = t.accesses % period;
+            if (pos == unit_at){
+                measurement_counts(h.stats(), start);
+                unit.accesses = 0;
+                measuring = true;
+            }
+            // translated even when skipped, so pages get the frames of a full run
+            addr_t addr = h.page_map ? h.page_map->translate(batch[i].addr) : batch[i].addr;
+            bool sampled_set = ((addr >> shift) & set_mask) == 0;
+            bool simulate    = sampled_set && pos >= ff_end;
+            bool warm        = sampled_set && pos < ff_end && sp.fast_forward == FAST_FORWARD_WARM;
+
+            if (simulate){
+                h.access_physical(batch[i].rw, addr);
+            }else if (warm){
+                h.warm_physical(batch[i].rw, addr);
+            }
+            if (warm)           t.functional++;
+            else if (!simulate) t.skipped++;
+            else if (measuring) t.measured++;
+            else                t.warmed++;
+
+            if (measuring){
+                unit.accesses++;
+                if (pos == period - 1){
+                    close_unit(h, start, unit, units);
+                    measuring = false;
+                }
+            }
+        }
+    }
+    trace.close();
+    if (measuring){ // the trace ended inside a unit
+        close_unit(h, start, unit, units);
+    }
+    t.seconds = now_seconds() - began;
+    return t;
+}
+
+// Runs the full simulation of trace_file (for --validate)
+static measurements_t simulate_full(const cache_params_t& params, const char* trace_file, double* seconds){
+    static trace_record batch[TRACE_BATCH_SIZE];
+    TraceReader trace;
+    Hierarchy h(params);
+
+    double began = now_seconds();
+    open_trace(trace, trace_file);
+    uint32_t n;
+    while ((n = trace.next_batch(batch, TRACE_BATCH_SIZE)) > 0) {
+        h.access_batch(batch, n);
+    }
+    trace.close();
+    *seconds = now_seconds() - began;
+    return h.stats();
+}
+
+static void print_estimate(const char* name, const sample_estimate_t& e, bool rate, bool validate, double full,
+                           uint32_t* within, double* max_error){
+    if (rate){
+        printf("%-32s %14.4f", name, e.value);
+        if (isnan(e.half)) printf(" %12s", "n/a"); else printf(" %12.4f", e.half);
+    }else{
+        printf("%-32s %14.0f", name, e.value);
+        if (isnan(e.half)) printf(" %12s", "n/a"); else printf(" %12.0f", e.half);
+    }
+    if (validate){
+        double error = (full != 0) ? (e.value - full) / full : ((e.value != 0) ? INFINITY : 0);
+        bool inside  = !isnan(e.half) && fabs(e.value - full) <= e.half;
+        *within     += inside;
+        *max_error   = max(*max_error, fabs(error));
+        if (rate) printf(" %14.4f", full); else printf(" %14.0f", full);
+        printf(" %+9.2f%% %s", 100 * error, inside ? "yes" : "no");
+    }
+    printf("\n");
+}
+
+// Simulates trace_file on the hierarchy of params as sp says and prints the
+// extrapolated a-q measurements; exits on errors
+int run_sampled(const cache_params_t& params, const sample_params_t& sp, const char* trace_file){
+    if (sample_params_error(sp, params) != NULL) {
+        printf("Error: %s\n", sample_params_error(sp, params));
+        exit(EXIT_FAILURE);
+    }
+    vector<sample_unit_t> units;
+    sample_totals_t t = simulate_sampled(params, sp, trace_file, units);
+    if (units.empty()) {
+        printf("Error: %s ended before the first unit; lower --period.\n", trace_file);
+        exit(EXIT_FAILURE);
+    }
+
+    measurements_t full;
+    double full_seconds = 0;
+    double full_counts[SAMPLE_COUNTS];
+    if (sp.validate) {
+        full = simulate_full(params, trace_file, &full_seconds);
+        measurement_counts(full, full_counts);
+    }
+
+    printf("===== Simulator configuration =====\n");
+    printf("BLOCKSIZE:  %u\n", params.blocksize);
+    printf("L1_SIZE:    %u\n", params.l1_size);
+    printf("L1_ASSOC:   %u\n", params.l1_assoc);
+    printf("L2_SIZE:    %u\n", params.l2_size);
+    printf("L2_ASSOC:   %u\n", params.l2_assoc);
+    printf("PREF_N:     %u\n", params.pref_n);
+    printf("PREF_M:     %u\n", params.pref_m);
+    printf("trace_file: %s\n", trace_file);
+    printf("\n");
+
+    printf("===== Sampling =====\n");
+    if (sp.period) {
+        printf("%-32s %llu of %llu accesses every %llu, after %llu warmup\n", "units:", (unsigned long long) units.size(),
+               (unsigned long long) sp.unit, (unsigned long long) sp.period, (unsigned long long) sp.warmup);
+        printf("%-32s %s\n", "fast-forward:", (sp.fast_forward == FAST_FORWARD_WARM) ? "functional warming" : "skip");
+    }else {
+        printf("%-32s %llu of %llu accesses, back to back\n", "units:", (unsigned long long) units.size(),
+               (unsigned long long) sp.unit);
+    }
+    printf("%-32s 1 in %u\n", "sampled sets:", sp.sets);
+    printf("%-32s %llu\n", "trace accesses:", (unsigned long long) t.accesses);
+    printf("%-32s %llu (%.2f%%)\n", "measured:", (unsigned long long) t.measured, 100.0 * t.measured / max(t.accesses, (uint64_t) 1));
+    printf("%-32s %llu (%.2f%%)\n", "simulated unmeasured:", (unsigned long long) t.warmed, 100.0 * t.warmed / max(t.accesses, (uint64_t) 1));
+    printf("%-32s %llu (%.2f%%)\n", "functionally warmed:", (unsigned long long) t.functional, 100.0 * t.functional / max(t.accesses, (uint64_t) 1));
+    printf("%-32s %llu (%.2f%%)\n", "not simulated:", (unsigned long long) t.skipped, 100.0 * t.skipped / max(t.accesses, (uint64_t) 1));
+    printf("\n");
+
+    printf("===== Sampled measurements =====\n");
+    printf("%-32s %14s %12s", "", "estimate", "95% CI +/-");
+    if (sp.validate) {
+        printf(" %14s %10s %s", "full run", "error", "in CI");
+    }
+    printf("\n");
+
+    vector<double> x(units.size()), y(units.size());
+    for (size_t u = 0; u < units.size(); u++) {
+        x[u] = units[u].accesses;
+    }
+    double scale = (double) t.accesses * sp.sets;
+    uint32_t within = 0;
+    double max_error = 0;
+    sample_estimate_t e;
+    for (uint32_t c = 0; c < SAMPLE_COUNTS; c++) {
+        for (size_t u = 0; u < units.size(); u++) {
+            y[u] = units[u].counts[c];
+        }
+        e = ratio_estimate(y, x, scale);
+        print_estimate(sample_count_names[c], e, false, sp.validate, sp.validate ? full_counts[c] : 0, &within, &max_error);
+
+        // the miss rates follow their misses: e after d, n after m
+        if (c == 3 || c == 11) {
+            vector<double> misses(units.size()), accesses(units.size());
+            for (size_t u = 0; u < units.size(); u++) {
+                const double* k = units[u].counts;
+                misses[u]   = (c == 3) ? k[1] + k[3] : k[7];
+                accesses[u] = (c == 3) ? k[0] + k[2] : k[6];
+            }
+            e = ratio_estimate(misses, accesses, 1);
+            print_estimate((c == 3) ? "e. L1 miss rate: " : "n. L2 miss rate: ", e, true, sp.validate,
+                           sp.validate ? ((c == 3) ? full.l1_miss_rate : full.l2_miss_rate) : 0, &within, &max_error);
+        }
+    }
+    if (sp.validate) {
+        printf("\n");
+        printf("%-32s %u of %u\n", "full run inside the 95% CI:", within, SAMPLE_COUNTS + 2);
+        printf("%-32s %.2f%%\n", "largest error:", 100 * max_error);
+        fprintf(stderr, "%s: sampled %.3f s, full %.3f s (%.1fx)\n", trace_file, t.seconds, full_seconds,
+                (t.seconds > 0) ? full_seconds / t.seconds : 0.0);
+    }else {
+        fprintf(stderr, "%s: sampled %.3f s\n", trace_file, t.seconds);
+    }
+    return(0);
+}
+
+#endif // SAMPLING_H
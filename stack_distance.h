@@ -0,0 +1,184 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm> //max
+#include <math.h>  // log2
+#include "addr.h"
+#include "tag_match.h"
+
+using namespace std;
+
+/*  Single-pass LRU miss counts for a whole grid of (size, assoc) L1 configs
+    (Mattson et al., "Evaluation techniques for storage hierarchies", 1970).
+
+    LRU has the inclusion property: a block at stack distance d in its set
+    (d distinct blocks of that set touched since its last use) hits in every
+    cache of that set count with more than d ways. So one LRU stack per set
+    and per distinct set count yields the misses of every associativity.
+
+    Stacks are only kept max_assoc deep for their set count: anything deeper
+    misses in every requested config anyway. That keeps each access at one
+    SIMD tag match over at most max_assoc entries per set count. As in the
+    Cache tag store, the match runs on the low 32 bits of the block
+    addresses and the upper bits are checked on the entries that match.
+
+    L2 is out of scope: its request stream is the L1's misses and
+    writebacks, so its stack distances change with every L1 config of the
+    grid. sweep.h covers L2 grids.
+*/
+
+// Misses per (size, assoc) point of the grid
+typedef struct {
+    uint32_t size;
+    uint32_t assoc;
+    uint32_t sets;
+    uint64_t read_misses;
+    uint64_t write_misses;
+} stack_distance_point;
+
+class StackDistanceSim {
+    private:
+        // One LRU stack per set for one set count; stacks[s * depth + d]
+        // holds the block address at distance d of set s (MRU first),
+        // split in its low and high 32 bits.
+        struct set_count_stacks {
+            uint32_t sets;
+            uint32_t depth;
+            vector<uint32_t> stacks;
+            vector<uint32_t> stacks_hi;
+            vector<uint32_t> fill;          // valid entries per set
+            vector<uint64_t> read_hist;     // read_hist[d]: reads at distance d
+            vector<uint64_t> write_hist;
+            uint64_t read_cold;             // reads beyond depth (or never seen)
+            uint64_t write_cold;
+        };
+
+        uint32_t block_bits_num;
+        vector<set_count_stacks> levels;
+
+        // Returns the distance of block_addr in stack[0..n), or n if absent
+        uint32_t find(const uint32_t* stack, const uint32_t* stack_hi, uint32_t n, addr_t block_addr){
+            for (uint32_t c = 0; c < n; c += TAG_MATCH_CHUNK){
+                uint64_t mask = g_tag_match(stack + c, min(n - c, (uint32_t) TAG_MATCH_CHUNK), (uint32_t) block_addr);
+                while (mask){
+                    uint32_t d = c + __builtin_ctzll(mask);
+                    if (stack_hi[d] == (uint32_t) (block_addr >> 32)){
+                        return d;
+                    }
+                    mask &= mask - 1;
+                }
+            }
+            return n;
+        }
+
+    public:
+        vector<stack_distance_point> points;
+        uint64_t reads;
+        uint64_t writes;
+
+        // Returns false (and prints why) if a grid point isn't a valid cache
+        bool init(uint32_t block_size, const vector<uint32_t>& sizes, const vector<uint32_t>& assocs){
+            this->block_bits_num = log2(block_size);
+            this->reads  = 0;
+            this->writes = 0;
+
+            for (uint32_t i = 0; i < sizes.size(); i++){
+                for (uint32_t j = 0; j < assocs.size(); j++){
+                    stack_distance_point p;
+                    p.size  = sizes[i];
+                    p.assoc = assocs[j];
+                    p.sets  = (p.assoc > 0) ? p.size / (p.assoc * block_size) : 0;
+                    p.read_misses  = 0;
+                    p.write_misses = 0;
+                    if (p.sets == 0 || (p.sets & (p.sets - 1)) || p.sets * p.assoc * block_size != p.size){
+                        printf("Error: size %u with %u ways of %u bytes doesn't give a power-of-2 set count.\n",
+                               p.size, p.assoc, block_size);
+                        return false;
+                    }
+                    this->points.push_back(p);
+                }
+            }
+
+            // One stack level per distinct set count, as deep as its widest config
+            for (uint32_t i = 0; i < this->points.size(); i++){
+                set_count_stacks* l = NULL;
+                for (uint32_t k = 0; k < this->levels.size(); k++){
+                    if (this->levels[k].sets == this->points[i].sets){
+                        l = &this->levels[k];
+                    }
+                }
+                if (l == NULL){
+                    this->levels.push_back(set_count_stacks());
+                    l = &this->levels.back();
+                    l->sets  = this->points[i].sets;
+                    l->depth = 0;
+                }
+                l->depth = max(l->depth, this->points[i].assoc);
+            }
+            for (uint32_t k = 0; k < this->levels.size(); k++){
+                set_count_stacks& l = this->levels[k];
+                l.stacks.assign((size_t) l.sets * l.depth, 0);
+                l.stacks_hi.assign((size_t) l.sets * l.depth, 0);
+                l.fill.assign(l.sets, 0);
+                l.read_hist.assign(l.depth, 0);
+                l.write_hist.assign(l.depth, 0);
+                l.read_cold  = 0;
+                l.write_cold = 0;
+            }
+            return true;
+        }
+
+        void access(addr_t addr, bool is_write){
+            addr_t block_addr = addr >> this->block_bits_num;
+            if (is_write) this->writes++; else this->reads++;
+
+            for (uint32_t k = 0; k < this->levels.size(); k++){
+                set_count_stacks& l = this->levels[k];
+                uint32_t set    = block_addr & (l.sets - 1);
+                uint32_t* stack    = &l.stacks[(size_t) set * l.depth];
+                uint32_t* stack_hi = &l.stacks_hi[(size_t) set * l.depth];
+                uint32_t n         = l.fill[set];
+                uint32_t d         = this->find(stack, stack_hi, n, block_addr);
+
+                if (d < n){
+                    (is_write ? l.write_hist : l.read_hist)[d]++;
+                }else{
+                    (is_write ? l.write_cold : l.read_cold)++;
+                    if (n < l.depth){
+                        l.fill[set] = ++n;
+                    }
+                    d = n - 1; // the deepest entry falls off
+                }
+                // Move to front
+                memmove(stack + 1, stack, d * sizeof(uint32_t));
+                memmove(stack_hi + 1, stack_hi, d * sizeof(uint32_t));
+                stack[0]    = (uint32_t) block_addr;
+                stack_hi[0] = (uint32_t) (block_addr >> 32);
+            }
+        }
+
+        // Turns the distance histograms into per-point miss counts
+        void finish(){
+            for (uint32_t i = 0; i < this->points.size(); i++){
+                stack_distance_point& p = this->points[i];
+                for (uint32_t k = 0; k < this->levels.size(); k++){
+                    set_count_stacks& l = this->levels[k];
+                    if (l.sets != p.sets){
+                        continue;
+                    }
+                    p.read_misses  = l.read_cold;
+                    p.write_misses = l.write_cold;
+                    for (uint32_t d = p.assoc; d < l.depth; d++){
+                        p.read_misses  += l.read_hist[d];
+                        p.write_misses += l.write_hist[d];
+                    }
+                }
+            }
+        }
+};
+
+#endif // STACK_DISTANCE_H
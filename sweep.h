@@ -0,0 +1,240 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "cachesim.h"
+#include "hierarchy.h"
+#include "trace_reader.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+/*  Parameter sweep: the trace is decoded once into memory and shared
+    read-only by every config, each simulated as an independent L1/L2
+    hierarchy on a ThreadPool worker. A synthetic trace (synthetic.h) is
+    instead generated again by every config's job, batch by batch, so
+    memory stays flat however long it is. Results come out as one row of
+    the a-q measurements per config, in config file order.
+
+    Config file: one config per line, the 7 numbers of the usual command line
+    optionally followed by the L1 and L2 replacement policies; '#' starts a
+    comment.
+        # blocksize l1_size l1_assoc l2_size l2_assoc pref_n pref_m [l1_repl l2_repl]
+        32 8192 4 262144 8 3 10
+        32 8192 4 262144 8 3 10 plru drrip
+*/
+
+typedef enum {
+    SWEEP_CSV = 0,
+    SWEEP_JSON
+} sweep_format_t;
+
+// Columns of a result row, in a-q order
+static const char* const sweep_columns[] = {
+    "l1_reads", "l1_read_misses", "l1_writes", "l1_write_misses", "l1_miss_rate", "l1_writebacks", "l1_prefetches",
+    "l2_reads", "l2_read_misses", "l2_prefetch_reads", "l2_prefetch_read_misses", "l2_writes", "l2_write_misses",
+    "l2_miss_rate", "l2_writebacks", "l2_prefetches", "mem_traffic"
+};
+
+// Extra columns of a timed sweep
+static const char* const sweep_timing_columns[] = {
+    "cycles", "amat", "mshr_stall_cycles", "mem_bytes_per_cycle", "prefetch_timely", "prefetch_late"
+};
+
+typedef struct {
+    measurements_t m;
+    timing_stats_t t;
+    uint64_t accesses;
+} sweep_result_t;
+
+// Reads the whole trace into records; exits on errors
+static void load_trace(const char* trace_file, vector<trace_record>& records){
+    TraceReader trace;
+    vector<trace_record> batch(TRACE_BATCH_SIZE);
+
+    if (!trace.open(trace_file)) {
+       printf("Error: Unable to open file %s\n", trace_file);
+       exit(EXIT_FAILURE);
+    }
+    uint32_t n;
+    while ((n = trace.next_batch(batch.data(), TRACE_BATCH_SIZE)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (batch[i].rw != 'r' && batch[i].rw != 'w'){
+                printf("Error: Unknown request type %c.\n", batch[i].rw);
+                exit(EXIT_FAILURE);
+            }
+        }
+        records.insert(records.end(), batch.begin(), batch.begin() + n);
+    }
+}
+
+// Every config gets the prefetcher and timing settings of defaults
+static void load_sweep_configs(const char* config_file, const cache_params_t& defaults, vector<cache_params_t>& configs){
+    FILE* fp = fopen(config_file, "r");
+    if (fp == (FILE *) NULL) {
+       printf("Error: Unable to open file %s\n", config_file);
+       exit(EXIT_FAILURE);
+    }
+
+    char line[512];
+    uint32_t line_num = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_num++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        cache_params_t params = defaults;
+        char l1_repl[32] = "lru", l2_repl[32] = "lru";
+        int fields = sscanf(line, "%u %u %u %u %u %u %u %31s %31s", &params.blocksize, &params.l1_size, &params.l1_assoc,
+                            &params.l2_size, &params.l2_assoc, &params.pref_n, &params.pref_m, l1_repl, l2_repl);
+        if (fields <= 0) {
+            continue; // blank line
+        }
+        params.l1_repl = parse_repl_policy(l1_repl);
+        params.l2_repl = parse_repl_policy(l2_repl);
+        if (fields < 7 || fields == 8 || params.l1_repl == REPL_NUM_POLICIES || params.l2_repl == REPL_NUM_POLICIES) {
+            printf("Error: Malformed config on line %u of %s.\n", line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        if (params.pref_n != 0 && params.pref_m == 0) {
+            printf("Error: PREF_N > 0 needs PREF_M > 0 (line %u of %s).\n", line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        if ((params.l1_pref == PREF_STREAM || params.l2_pref == PREF_STREAM) && params.pref_n == 0) {
+            printf("Error: Stream buffers need PREF_N > 0 and PREF_M > 0 (line %u of %s).\n", line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        if (params.timing_enabled && timing_params_error(params.timing, params.blocksize) != NULL) {
+            printf("Error: %s (line %u of %s)\n", timing_params_error(params.timing, params.blocksize), line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        if (params.page_map.kind != PAGE_MAP_NONE && page_map_params_error(params.page_map, params.blocksize) != NULL) {
+            printf("Error: %s (line %u of %s)\n", page_map_params_error(params.page_map, params.blocksize), line_num, config_file);
+            exit(EXIT_FAILURE);
+        }
+        configs.push_back(params);
+    }
+    fclose(fp);
+}
+
+// Simulates one config over the shared trace, or over synth_spec if it
+// isn't NULL (runs on a pool worker)
+static sweep_result_t simulate_config(const cache_params_t& params, const vector<trace_record>& records, const char* synth_spec){
+    Hierarchy hierarchy(params);
+    sweep_result_t r;
+    if (synth_spec != NULL) {
+        TraceReader trace;
+        vector<trace_record> batch(TRACE_BATCH_SIZE);
+        uint32_t n;
+        trace.open(synth_spec);
+        r.accesses = 0;
+        while ((n = trace.next_batch(batch.data(), TRACE_BATCH_SIZE)) > 0) {
+            hierarchy.access_batch(batch.data(), n);
+            r.accesses += n;
+        }
+    }else {
+        hierarchy.access_batch(records.data(), records.size());
+        r.accesses = records.size();
+    }
+    r.m = hierarchy.stats();
+    if (params.timing_enabled) {
+        r.t = hierarchy.timing_stats();
+    }
+    return r;
+}
+
+static void print_sweep_row(sweep_format_t format, const cache_params_t& p, const sweep_result_t& r, bool last){
+    const measurements_t& m = r.m;
+    uint64_t v[] = { m.l1_reads, m.l1_read_misses, m.l1_writes, m.l1_write_misses, 0, m.l1_writebacks, m.l1_prefetches,
+                     m.l2_reads, m.l2_read_misses, m.l2_prefetch_reads, m.l2_prefetch_read_misses, m.l2_writes,
+                     m.l2_write_misses, 0, m.l2_writebacks, m.l2_prefetches, m.mem_traffic };
+    const uint32_t columns = sizeof(sweep_columns) / sizeof(sweep_columns[0]);
+
+    if (format == SWEEP_CSV) {
+        printf("%u,%u,%u,%u,%u,%u,%u,%s,%s", p.blocksize, p.l1_size, p.l1_assoc, p.l2_size, p.l2_assoc, p.pref_n, p.pref_m,
+               repl_policy_names[p.l1_repl], repl_policy_names[p.l2_repl]);
+        for (uint32_t c = 0; c < columns; c++) {
+            if (c == 4)       printf(",%.4f", m.l1_miss_rate);
+            else if (c == 13) printf(",%.4f", m.l2_miss_rate);
+            else              printf(",%llu", (unsigned long long) v[c]);
+        }
+        if (p.timing_enabled) {
+            printf(",%llu,%.4f,%llu,%.4f,%llu,%llu", (unsigned long long) r.t.cycles, r.t.amat,
+                   (unsigned long long) r.t.mshr_stall_cycles, r.t.bytes_per_cycle,
+                   (unsigned long long) r.t.prefetch_timely, (unsigned long long) r.t.prefetch_late);
+        }
+        printf("\n");
+    }else {
+        printf("  {\"blocksize\": %u, \"l1_size\": %u, \"l1_assoc\": %u, \"l2_size\": %u, \"l2_assoc\": %u, "
+               "\"pref_n\": %u, \"pref_m\": %u, \"l1_repl\": \"%s\", \"l2_repl\": \"%s\"",
+               p.blocksize, p.l1_size, p.l1_assoc, p.l2_size, p.l2_assoc, p.pref_n, p.pref_m,
+               repl_policy_names[p.l1_repl], repl_policy_names[p.l2_repl]);
+        for (uint32_t c = 0; c < columns; c++) {
+            if (c == 4)       printf(", \"%s\": %.4f", sweep_columns[c], m.l1_miss_rate);
+            else if (c == 13) printf(", \"%s\": %.4f", sweep_columns[c], m.l2_miss_rate);
+            else              printf(", \"%s\": %llu", sweep_columns[c], (unsigned long long) v[c]);
+        }
+        if (p.timing_enabled) {
+            printf(", \"%s\": %llu, \"%s\": %.4f, \"%s\": %llu, \"%s\": %.4f",
+                   sweep_timing_columns[0], (unsigned long long) r.t.cycles, sweep_timing_columns[1], r.t.amat,
+                   sweep_timing_columns[2], (unsigned long long) r.t.mshr_stall_cycles, sweep_timing_columns[3], r.t.bytes_per_cycle);
+            printf(", \"%s\": %llu, \"%s\": %llu", sweep_timing_columns[4], (unsigned long long) r.t.prefetch_timely,
+                   sweep_timing_columns[5], (unsigned long long) r.t.prefetch_late);
+        }
+        printf("}%s\n", last ? "" : ",");
+    }
+}
+
+// defaults carries the prefetcher and timing settings of the command line
+int run_sweep(const char* config_file, const char* trace_file, uint32_t threads, sweep_format_t format,
+              const cache_params_t& defaults){
+    vector<cache_params_t> configs;
+    vector<trace_record> records;
+
+    load_sweep_configs(config_file, defaults, configs);
+    const char* synth_spec = NULL;
+    if (is_synth_spec(trace_file)) {
+        parse_synth_spec(trace_file); // exits on errors, before any job starts
+        synth_spec = trace_file;
+    }else {
+        load_trace(trace_file, records);
+    }
+
+    vector<sweep_result_t> results(configs.size());
+    ThreadPool pool(threads);
+    for (size_t i = 0; i < configs.size(); i++) {
+        pool.submit([&configs, &records, &results, synth_spec, i](){
+            results[i] = simulate_config(configs[i], records, synth_spec);
+        });
+    }
+    pool.run();
+
+    if (format == SWEEP_CSV) {
+        printf("blocksize,l1_size,l1_assoc,l2_size,l2_assoc,pref_n,pref_m,l1_repl,l2_repl");
+        for (uint32_t c = 0; c < sizeof(sweep_columns) / sizeof(sweep_columns[0]); c++) {
+            printf(",%s", sweep_columns[c]);
+        }
+        for (uint32_t c = 0; defaults.timing_enabled && c < sizeof(sweep_timing_columns) / sizeof(sweep_timing_columns[0]); c++) {
+            printf(",%s", sweep_timing_columns[c]);
+        }
+        printf("\n");
+    }else {
+        printf("[\n");
+    }
+    for (size_t i = 0; i < configs.size(); i++) {
+        print_sweep_row(format, configs[i], results[i], i + 1 == configs.size());
+    }
+    if (format == SWEEP_JSON) {
+        printf("]\n");
+    }
+    fprintf(stderr, "%s: %zu configs x %llu requests on %u threads\n", trace_file, configs.size(),
+            (unsigned long long) (results.empty() ? records.size() : results[0].accesses), pool.size());
+    return(0);
+}
+
+#endif // SWEEP_H
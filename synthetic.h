@@ -0,0 +1,365 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <vector>
+#include "addr.h"
+
+/*  Synthetic traces: deterministic request streams of any length and
+    footprint, generated on the fly. A trace spec can be given anywhere a
+    trace file can ("synth:KIND[:key=value,...]"), and the requests then go
+    straight into the simulator without touching disk; ./sim convert writes
+    one to a binary trace. The same spec always gives the same requests, on
+    any host, so results on them can be checked against golden ones.
+
+    stream   a STREAM triad, c[i] = a[i] + s * b[i], over three arrays that
+             split the footprint: two sequential reads and a write per element
+    strided  `streams` interleaved walks, each over its own part of the
+             footprint, `stride` bytes at a time
+    chase    pointer chasing: every node of the footprint once per lap, in a
+             scrambled order (the largest power of 2 of nodes that fits)
+    zipf     a hot set: nodes picked with Zipf(alpha) popularity, the popular
+             ones scattered over the footprint
+    random   uniformly random 8-byte words of the footprint
+    mixed    phase accesses of each of the above in turn, each picking up
+             where it left off, over the same footprint
+
+    Keys (sizes take a K, M or G suffix):
+    n=N             requests (default 10M)
+    footprint=B     bytes touched (default 64M)
+    stride=B        strided: bytes between a stream's accesses (default 256)
+    streams=K       strided: number of streams (default 4)
+    node=B          chase, zipf: bytes per node (default 64)
+    alpha=F         zipf: exponent (default 0.99)
+    writes=F        fraction of requests that are writes (default 0.25, 0
+                    for chase; stream always writes one in three)
+    phase=N         mixed: requests per phase (default 1M)
+    seed=S          random number seed (default 1)
+
+    Example: synth:zipf:n=2G,footprint=1G,alpha=1.1
+*/
+
+#define SYNTH_BASE      0x10000000ULL
+#define SYNTH_PREFIX    "synth:"
+
+typedef enum {
+    SYNTH_STREAM = 0,
+    SYNTH_STRIDED,
+    SYNTH_CHASE,
+    SYNTH_ZIPF,
+    SYNTH_RANDOM,
+    SYNTH_MIXED,
+    SYNTH_NUM_KINDS
+} synth_kind_t;
+
+static const char* const synth_kind_names[SYNTH_NUM_KINDS] = { "stream", "strided", "chase", "zipf", "random", "mixed" };
+
+typedef struct {
+    synth_kind_t kind;
+    uint64_t accesses;
+    uint64_t footprint;
+    uint64_t stride;
+    uint32_t streams;
+    uint64_t node;
+    double alpha;
+    double writes;
+    uint64_t phase;
+    uint64_t seed;
+} synth_params_t;
+
+// Returns true if path names a synthetic trace rather than a file
+static inline bool is_synth_spec(const char* path){
+    return strncmp(path, SYNTH_PREFIX, strlen(SYNTH_PREFIX)) == 0;
+}
+
+// Parses "synth:KIND[:key=value,...]"; exits on errors
+static synth_params_t parse_synth_spec(const char* spec){
+    synth_params_t p;
+    p.kind      = SYNTH_NUM_KINDS;
+    p.accesses  = 10000000;
+    p.footprint = 64ULL << 20;
+    p.stride    = 256;
+    p.streams   = 4;
+    p.node      = 64;
+    p.alpha     = 0.99;
+    p.writes    = -1;
+    p.phase     = 1ULL << 20;
+    p.seed      = 1;
+
+    const char* s   = spec + strlen(SYNTH_PREFIX);
+    size_t kind_len = strcspn(s, ":");
+    for (uint32_t k = 0; k < SYNTH_NUM_KINDS; k++){
+        if (strlen(synth_kind_names[k]) == kind_len && strncmp(s, synth_kind_names[k], kind_len) == 0){
+            p.kind = (synth_kind_t) k;
+        }
+    }
+    if (p.kind == SYNTH_NUM_KINDS){
+        printf("Error: Unknown synthetic trace %.*s.\n", (int) kind_len, s);
+        exit(EXIT_FAILURE);
+    }
+    s += kind_len;
+
+    while (*s == ':' || *s == ','){
+        s++;
+        char item[64];
+        size_t len = strcspn(s, ",");
+        const char* eq = (const char*) memchr(s, '=', len);
+        if (eq == NULL || len >= sizeof(item)){
+            printf("Error: Expected key=value in %s but got %.*s.\n", spec, (int) len, s);
+            exit(EXIT_FAILURE);
+        }
+        memcpy(item, s, len);
+        item[len] = '\0';
+        item[eq - s] = '\0';
+        const char* key   = item;
+        const char* value = item + (eq - s) + 1;
+        s += len;
+
+        char* end;
+        bool ok = true;
+        if (strcmp(key, "alpha") == 0 || strcmp(key, "writes") == 0){
+            double v = strtod(value, &end);
+            ok = (end != value && *end == '\0' && v >= 0);
+            ((strcmp(key, "alpha") == 0) ? p.alpha : p.writes) = v;
+        }else if (strcmp(key, "seed") == 0){
+            p.seed = strtoull(value, &end, 10);
+            ok = (end != value && *end == '\0');
+        }else{
+            uint64_t v = parse_bytes(value);
+            ok = (v > 0);
+            if      (strcmp(key, "n") == 0)         p.accesses  = v;
+            else if (strcmp(key, "footprint") == 0) p.footprint = v;
+            else if (strcmp(key, "stride") == 0)    p.stride    = v;
+            else if (strcmp(key, "streams") == 0)   p.streams   = (uint32_t) v;
+            else if (strcmp(key, "node") == 0)      p.node      = v;
+            else if (strcmp(key, "phase") == 0)     p.phase     = v;
+            else {
+                printf("Error: Unknown synthetic trace key %s.\n", key);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if (!ok){
+            printf("Error: Bad value %s for synthetic trace key %s.\n", value, key);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (*s != '\0'){
+        printf("Error: Malformed synthetic trace %s.\n", spec);
+        exit(EXIT_FAILURE);
+    }
+
+    if (p.writes < 0){
+        p.writes = (p.kind == SYNTH_CHASE) ? 0.0 : 0.25;
+    }
+    const char* error = NULL;
+    if (p.writes > 1){
+        error = "writes must be between 0 and 1.";
+    }else if (p.alpha <= 0){
+        error = "alpha must be > 0.";
+    }else if (p.footprint < 3 * 8 || p.node < 8 || p.node > p.footprint){
+        error = "The footprint must hold three words and at least one node.";
+    }else if (p.stride % 8 != 0 || p.stride * p.streams > p.footprint){
+        error = "stride must be a multiple of 8, and the footprint must hold a stride per stream.";
+    }
+    if (error){
+        printf("Error: %s: %s\n", spec, error);
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+// Hands out a synthetic trace in batches, like TraceReader
+class SyntheticTrace {
+    private:
+        synth_params_t p;
+        uint64_t remaining;
+        uint64_t rng;                   // xorshift64* state
+        uint64_t write_threshold;       // of a random 24-bit number
+
+        // stream
+        uint64_t stream_elems;          // per array
+        uint64_t stream_elem;
+        uint32_t stream_array;          // a, b, then c
+
+        // strided
+        uint64_t strided_region;        // bytes of each stream, a multiple of the stride
+        uint32_t strided_next;          // stream of the next access
+        std::vector<uint64_t> strided_offset;
+
+        // chase
+        uint32_t chase_bits;            // log2 of the nodes
+        uint64_t chase_step;
+
+        // zipf (rejection-inversion sampling, Hörmann and Derflinger 1996)
+        uint64_t zipf_nodes;
+        uint32_t zipf_bits;             // enough to number the nodes
+        double zipf_h_x1, zipf_h_n, zipf_s;
+
+        // mixed
+        synth_kind_t phase_kind;
+        uint64_t phase_left;
+
+        uint64_t next_random(){
+            this->rng ^= this->rng >> 12;
+            this->rng ^= this->rng << 25;
+            this->rng ^= this->rng >> 27;
+            return this->rng * 0x2545f4914f6cdd1dULL;
+        }
+        char next_rw(){
+            return (this->write_threshold > 0 && (this->next_random() >> 40) < this->write_threshold) ? 'w' : 'r';
+        }
+
+        // A bijection of [0, 2^bits) that scatters consecutive numbers
+        uint64_t scramble(uint64_t x, uint32_t bits){
+            if (bits == 0){
+                return 0;
+            }
+            uint64_t mask = (bits == 64) ? ~0ULL : (1ULL << bits) - 1;
+            uint32_t shift = (bits + 1) / 2;
+            x = (x * 0x9e3779b97f4a7c15ULL) & mask;
+            x ^= (this->p.seed * 0xbf58476d1ce4e5b9ULL) & mask;
+            x ^= x >> shift;
+            x = (x * 0x94d049bb133111ebULL) & mask;
+            x ^= x >> shift;
+            return x;
+        }
+
+        static double zipf_helper1(double x){ return (fabs(x) > 1e-8) ? log1p(x) / x : 1 - x * (0.5 - x * (1 / 3.0 - 0.25 * x)); }
+        static double zipf_helper2(double x){ return (fabs(x) > 1e-8) ? expm1(x) / x : 1 + x * 0.5 * (1 + x / 3.0 * (1 + 0.25 * x)); }
+        double zipf_h(double x){ return exp(-this->p.alpha * log(x)); }
+        double zipf_h_integral(double x){
+            double log_x = log(x);
+            return zipf_helper2((1 - this->p.alpha) * log_x) * log_x;
+        }
+        double zipf_h_integral_inverse(double x){
+            double t = x * (1 - this->p.alpha);
+            return exp(zipf_helper1((t < -1) ? -1 : t) * x);
+        }
+        // Returns a rank in [1, zipf_nodes]
+        uint64_t zipf_rank(){
+            while (true){
+                double u01 = (this->next_random() >> 11) * (1.0 / 9007199254740992.0);
+                double u   = this->zipf_h_n + u01 * (this->zipf_h_x1 - this->zipf_h_n);
+                double x   = this->zipf_h_integral_inverse(u);
+                uint64_t k = (x < 1.5) ? 1 : (x + 0.5 >= (double) this->zipf_nodes) ? this->zipf_nodes : (uint64_t) (x + 0.5);
+                if (k - x <= this->zipf_s || u >= this->zipf_h_integral(k + 0.5) - this->zipf_h((double) k)){
+                    return k;
+                }
+            }
+        }
+
+        void generate(synth_kind_t kind, trace_record* out, uint32_t n){
+            switch (kind){
+                case SYNTH_STREAM:
+                    for (uint32_t i = 0; i < n; i++){
+                        out[i].rw   = (this->stream_array == 2) ? 'w' : 'r';
+                        out[i].addr = SYNTH_BASE + (this->stream_array * this->stream_elems + this->stream_elem) * 8;
+                        if (++this->stream_array == 3){
+                            this->stream_array = 0;
+                            if (++this->stream_elem == this->stream_elems){
+                                this->stream_elem = 0;
+                            }
+                        }
+                    }
+                    break;
+                case SYNTH_STRIDED:
+                    for (uint32_t i = 0; i < n; i++){
+                        uint32_t s = this->strided_next;
+                        out[i].rw   = this->next_rw();
+                        out[i].addr = SYNTH_BASE + s * this->strided_region + this->strided_offset[s];
+                        this->strided_offset[s] += this->p.stride;
+                        if (this->strided_offset[s] == this->strided_region){
+                            this->strided_offset[s] = 0;
+                        }
+                        this->strided_next = (s + 1 == this->p.streams) ? 0 : s + 1;
+                    }
+                    break;
+                case SYNTH_CHASE:
+                    for (uint32_t i = 0; i < n; i++){
+                        uint64_t node = this->scramble(this->chase_step++ & ((1ULL << this->chase_bits) - 1), this->chase_bits);
+                        out[i].rw   = this->next_rw();
+                        out[i].addr = SYNTH_BASE + node * this->p.node;
+                    }
+                    break;
+                case SYNTH_ZIPF:
+                    for (uint32_t i = 0; i < n; i++){
+                        // scatter the ranks over the nodes (cycle walking keeps it a bijection)
+                        uint64_t node = this->zipf_rank() - 1;
+                        do {
+                            node = this->scramble(node, this->zipf_bits);
+                        } while (node >= this->zipf_nodes);
+                        out[i].rw   = this->next_rw();
+                        out[i].addr = SYNTH_BASE + node * this->p.node;
+                    }
+                    break;
+                case SYNTH_RANDOM:
+                    for (uint32_t i = 0; i < n; i++){
+                        uint64_t r = this->next_random();
+                        out[i].rw   = ((r >> 40) < this->write_threshold) ? 'w' : 'r';
+                        out[i].addr = SYNTH_BASE + ((r >> 8) % (this->p.footprint / 8)) * 8;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+    public:
+        SyntheticTrace(const synth_params_t& params){
+            this->p         = params;
+            this->remaining = params.accesses;
+            this->rng       = params.seed ? params.seed : 1;
+            this->write_threshold = (uint64_t) (params.writes * (1 << 24));
+
+            this->stream_elems = params.footprint / 3 / 8;
+            this->stream_elem  = 0;
+            this->stream_array = 0;
+
+            this->strided_region = params.footprint / params.streams / params.stride * params.stride;
+            this->strided_next   = 0;
+            this->strided_offset.assign(params.streams, 0);
+
+            this->chase_bits = 0;
+            while ((2ULL << this->chase_bits) <= params.footprint / params.node){
+                this->chase_bits++;
+            }
+            this->chase_step = 0;
+
+            this->zipf_nodes = params.footprint / params.node;
+            this->zipf_bits  = 0;
+            while ((1ULL << this->zipf_bits) < this->zipf_nodes){
+                this->zipf_bits++;
+            }
+            this->zipf_h_x1 = this->zipf_h_integral(1.5) - 1;
+            this->zipf_h_n  = this->zipf_h_integral(this->zipf_nodes + 0.5);
+            this->zipf_s    = 2 - this->zipf_h_integral_inverse(this->zipf_h_integral(2.5) - this->zipf_h(2));
+
+            this->phase_kind = SYNTH_STREAM;
+            this->phase_left = params.phase;
+        }
+        uint32_t next_batch(trace_record* out, uint32_t max){
+            uint32_t n = (this->remaining < max) ? (uint32_t) this->remaining : max;
+            if (this->p.kind != SYNTH_MIXED){
+                this->generate(this->p.kind, out, n);
+            }else{
+                for (uint32_t done = 0; done < n; ){
+                    uint32_t chunk = (this->phase_left < n - done) ? (uint32_t) this->phase_left : n - done;
+                    this->generate(this->phase_kind, out + done, chunk);
+                    done += chunk;
+                    this->phase_left -= chunk;
+                    if (this->phase_left == 0){
+                        this->phase_kind = (synth_kind_t) ((this->phase_kind + 1) % SYNTH_MIXED);
+                        this->phase_left = this->p.phase;
+                    }
+                }
+            }
+            this->remaining -= n;
+            return n;
+        }
+};
+
+#endif // SYNTHETIC_H
@@ -0,0 +1,124 @@
+#ifndef TAG_MATCH_H
+#define TAG_MATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib> //getenv() exit() EXIT_FAILURE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TAG_MATCH_X86 1
+#endif
+
+// Compares tags[0..n) (n <= 64) against tag; bit i of the result is set if
+// tags[i] == tag. Validity is not checked here, the caller masks it.
+typedef uint64_t (*tag_match_fn)(const uint32_t* tags, uint32_t n, uint32_t tag);
+
+// Most ways handed to a tag_match_fn in one call
+#define TAG_MATCH_CHUNK 64
+
+static uint64_t tag_match_scalar(const uint32_t* tags, uint32_t n, uint32_t tag){
+    uint64_t mask = 0;
+    for (uint32_t i = 0; i < n; i++){
+        mask |= (uint64_t) (tags[i] == tag) << i;
+    }
+    return mask;
+}
+
+#ifdef TAG_MATCH_X86
+__attribute__((target("sse4.1")))
+static uint64_t tag_match_sse4(const uint32_t* tags, uint32_t n, uint32_t tag){
+    __m128i key = _mm_set1_epi32((int) tag);
+    uint64_t mask = 0;
+    uint32_t i = 0;
+    for (; i + 4 <= n; i += 4){
+        __m128i v = _mm_loadu_si128((const __m128i*) (tags + i));
+        uint32_t m = (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, key)));
+        mask |= (uint64_t) m << i;
+    }
+    for (; i < n; i++){
+        mask |= (uint64_t) (tags[i] == tag) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t tag_match_avx2(const uint32_t* tags, uint32_t n, uint32_t tag){
+    __m256i key = _mm256_set1_epi32((int) tag);
+    uint64_t mask = 0;
+    uint32_t i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256i v = _mm256_loadu_si256((const __m256i*) (tags + i));
+        uint32_t m = (uint32_t) _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, key)));
+        mask |= (uint64_t) m << i;
+    }
+    if (i + 4 <= n){
+        __m128i v = _mm_loadu_si128((const __m128i*) (tags + i));
+        __m128i k = _mm256_castsi256_si128(key);
+        uint32_t m = (uint32_t) _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, k)));
+        mask |= (uint64_t) m << i;
+        i += 4;
+    }
+    for (; i < n; i++){
+        mask |= (uint64_t) (tags[i] == tag) << i;
+    }
+    return mask;
+}
+#endif
+
+// Kernel picked by select_tag_match(); used by tag_match_verify()
+static tag_match_fn g_tag_match_checked = tag_match_scalar;
+
+// Runs the selected kernel and the scalar one, and aborts if they disagree
+static uint64_t tag_match_verify(const uint32_t* tags, uint32_t n, uint32_t tag){
+    uint64_t mask   = g_tag_match_checked(tags, n, tag);
+    uint64_t expect = tag_match_scalar(tags, n, tag);
+    if (mask != expect){
+        printf("Error: tag match kernel returned %llx instead of %llx (ways=%u tag=%x).\n",
+               (unsigned long long) mask, (unsigned long long) expect, n, tag);
+        exit(EXIT_FAILURE);
+    }
+    return mask;
+}
+
+// Picks the widest kernel the host CPU supports. CACHESIM_TAGMATCH can force
+// one ("scalar", "sse4", "avx2"); "verify" cross-checks the widest kernel
+// against the scalar one on every lookup.
+static tag_match_fn select_tag_match(){
+    tag_match_fn best = tag_match_scalar;
+#ifdef TAG_MATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")){
+        best = tag_match_avx2;
+    }else if (__builtin_cpu_supports("sse4.1")){
+        best = tag_match_sse4;
+    }
+#endif
+
+    const char* force = getenv("CACHESIM_TAGMATCH");
+    if (force == NULL || force[0] == '\0'){
+        return best;
+    }
+    if (strcmp(force, "scalar") == 0){
+        return tag_match_scalar;
+    }
+    if (strcmp(force, "verify") == 0){
+        g_tag_match_checked = best;
+        return tag_match_verify;
+    }
+#ifdef TAG_MATCH_X86
+    if (strcmp(force, "sse4") == 0 && __builtin_cpu_supports("sse4.1")){
+        return tag_match_sse4;
+    }
+    if (strcmp(force, "avx2") == 0 && __builtin_cpu_supports("avx2")){
+        return tag_match_avx2;
+    }
+#endif
+    printf("Error: CACHESIM_TAGMATCH=%s is not supported on this host.\n", force);
+    exit(EXIT_FAILURE);
+}
+
+static const tag_match_fn g_tag_match = select_tag_match();
+
+#endif // TAG_MATCH_H
@@ -0,0 +1,100 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <functional>
+
+using namespace std;
+
+// Fixed-size work-stealing pool for independent, coarse-grained jobs (one
+// whole simulation each). Every worker owns a deque: it pops its own jobs
+// from the back and, once empty, steals from the front of the others'.
+// Jobs are all queued before run() starts, so no job ever waits on another.
+class ThreadPool {
+    private:
+        struct worker_queue {
+            mutex lock;
+            deque<function<void()> > jobs;
+        };
+
+        vector<worker_queue*> queues;
+        uint32_t next_queue;
+
+        bool pop(uint32_t w, function<void()>& job){
+            worker_queue* q = this->queues[w];
+            lock_guard<mutex> guard(q->lock);
+            if (q->jobs.empty()){
+                return false;
+            }
+            job = q->jobs.back();
+            q->jobs.pop_back();
+            return true;
+        }
+
+        bool steal(uint32_t w, function<void()>& job){
+            for (uint32_t i = 1; i < this->queues.size(); i++){
+                worker_queue* q = this->queues[(w + i) % this->queues.size()];
+                lock_guard<mutex> guard(q->lock);
+                if (!q->jobs.empty()){
+                    job = q->jobs.front();
+                    q->jobs.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(uint32_t w){
+            function<void()> job;
+            while (this->pop(w, job) || this->steal(w, job)){
+                job();
+            }
+        }
+
+    public:
+        // threads == 0 uses every hardware thread
+        ThreadPool(uint32_t threads){
+            if (threads == 0){
+                threads = thread::hardware_concurrency();
+            }
+            if (threads == 0){
+                threads = 1;
+            }
+            for (uint32_t i = 0; i < threads; i++){
+                this->queues.push_back(new worker_queue());
+            }
+            this->next_queue = 0;
+        }
+
+        ~ThreadPool(){
+            for (uint32_t i = 0; i < this->queues.size(); i++){
+                delete this->queues[i];
+            }
+        }
+
+        uint32_t size(){ return this->queues.size(); }
+
+        // Queues are filled round-robin; stealing evens out uneven jobs
+        void submit(function<void()> job){
+            this->queues[this->next_queue]->jobs.push_back(job);
+            this->next_queue = (this->next_queue + 1) % this->queues.size();
+        }
+
+        // Runs every submitted job and returns once all are done
+        void run(){
+            vector<thread> threads;
+            for (uint32_t i = 1; i < this->queues.size(); i++){
+                threads.push_back(thread(&ThreadPool::work, this, i));
+            }
+            this->work(0);
+            for (uint32_t i = 0; i < threads.size(); i++){
+                threads[i].join();
+            }
+        }
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,446 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>  //memset
+#include <vector>
+#include <unordered_map>
+#include <algorithm> //max
+#include "addr.h"
+
+using namespace std;
+
+/*  Cycle-approximate timing, layered on top of the functional hierarchy
+    (which still decides every hit and miss; this only adds up cycles).
+
+    Core: issues one request per cycle in trace order and doesn't wait for
+    earlier ones to complete (hit under miss). A request that misses a level
+    holds one of that level's MSHRs, tagged with the block, until it
+    completes; when they're all busy the request, and every request behind
+    it, waits for the first one to free up.
+
+    Non-blocking caches: the functional model fills a block as soon as it
+    misses, so a later request to a block whose fill is still in flight
+    shows up as a hit. If one of the level's MSHRs holds that block, the
+    request is a secondary miss: it merges into the MSHR (no new one, no
+    new traffic) and completes when the fill does.
+
+    Latency: levels are looked up serially, so a request pays the hit latency
+    of every level it visits, plus the DRAM latency if it reaches memory.
+    The stream buffers are probed alongside their level. A prefetch goes
+    down the hierarchy like a miss (without taking MSHRs) from the cycle the
+    access that triggered it got there, and its block stays in flight until
+    it arrives: the first demand access to a prefetched block, in the cache
+    or in a stream buffer, is a late (partial) hit if the block is still on
+    its way and waits for it; otherwise it's a timely hit.
+
+    DRAM: open-page banks with one row buffer each. An access to the open row
+    costs tCAS, to a closed bank tRCD + tCAS and to another row of the bank
+    tRP + tRCD + tCAS. Rows are interleaved across banks and every block
+    then crosses one shared data bus of dram_bus bytes per cycle, which
+    bounds the bandwidth. Writebacks wait in a write buffer and go out after
+    the request that evicted them; they and the prefetches take banks and
+    bus time but are never on a request's critical path.
+
+    Several cores (multicore.h): each issues its own requests one per cycle
+    and has its own MSHRs at its private levels; the shared levels' MSHRs,
+    the DRAM banks and the bus are contended for by all of them.
+
+    All times are in core cycles.
+*/
+
+typedef struct {
+    uint32_t l1_latency;        // hit latency of each level
+    uint32_t l2_latency;
+    uint32_t l3_latency;        // multi-core LLC behind private L2s
+    uint32_t l1_mshrs;          // outstanding misses per level
+    uint32_t l2_mshrs;
+    uint32_t l3_mshrs;
+    uint32_t dram_banks;
+    uint32_t dram_row;          // row buffer size in bytes
+    uint32_t dram_tcas;
+    uint32_t dram_trcd;
+    uint32_t dram_trp;
+    uint32_t dram_bus;          // data bus width in bytes per cycle
+    double   cpu_ghz;           // only used to report bandwidth in GB/s
+} timing_params_t;
+
+// A 3.2 GHz core with DDR4-3200 behind it (13.75ns tCAS/tRCD/tRP, one
+// 25.6 GB/s channel of 16 banks with 8KB rows)
+static inline timing_params_t default_timing_params(){
+    timing_params_t t;
+    t.l1_latency = 4;
+    t.l2_latency = 12;
+    t.l3_latency = 36;
+    t.l1_mshrs   = 8;
+    t.l2_mshrs   = 16;
+    t.l3_mshrs   = 32;
+    t.dram_banks = 16;
+    t.dram_row   = 8192;
+    t.dram_tcas  = 44;
+    t.dram_trcd  = 44;
+    t.dram_trp   = 44;
+    t.dram_bus   = 8;
+    t.cpu_ghz    = 3.2;
+    return t;
+}
+
+// Returns why the parameters can't be simulated with blocks of block_size
+// bytes, or NULL if they can
+static inline const char* timing_params_error(const timing_params_t& t, uint32_t block_size){
+    if (t.l1_mshrs == 0 || t.l2_mshrs == 0 || t.l3_mshrs == 0 || t.dram_banks == 0 || t.dram_bus == 0 || t.cpu_ghz <= 0) {
+        return "MSHRs, DRAM banks, DRAM bus width and CPU clock must be > 0.";
+    }
+    if (t.dram_row < block_size || (t.dram_row & (t.dram_row - 1))) {
+        return "DRAM row size must be a power of 2 of at least one block.";
+    }
+    return NULL;
+}
+
+// What a timed run reports next to the a-q measurements
+typedef struct {
+    uint32_t levels;
+    uint64_t requests;
+    uint64_t cycles;                // until the last request or transfer completes
+    uint64_t total_latency;         // sum of issue to completion over all requests
+    double   amat;                  // average memory access time
+    uint64_t mshr_stall_cycles;     // issue cycles lost waiting for an MSHR
+    uint64_t l1_mshr_merges;        // secondary misses merged into an MSHR
+    uint64_t l2_mshr_merges;
+    uint64_t l3_mshr_merges;
+    uint64_t prefetch_timely;       // first uses of prefetched blocks that had arrived
+    uint64_t prefetch_late;         // ... that were still in flight (partial hits)
+    uint64_t prefetch_late_cycles;  // cycles the late ones waited
+    uint64_t dram_reads;            // blocks read by demand misses
+    uint64_t dram_writes;           // blocks written back
+    uint64_t dram_prefetches;       // blocks read by the prefetcher
+    uint64_t dram_row_hits;
+    uint64_t dram_row_misses;       // bank had no open row
+    uint64_t dram_row_conflicts;    // bank had another row open
+    uint64_t dram_bus_cycles;       // cycles the data bus was transferring
+    double   bytes_per_cycle;       // achieved memory bandwidth
+    double   gbytes_per_sec;
+} timing_stats_t;
+
+class TimingModel {
+    private:
+        struct dram_bank {
+            uint64_t ready;         // next cycle it can take a command
+            uint64_t row;
+            bool     open;
+        };
+
+        uint32_t block_size;
+        uint32_t burst_cycles;      // bus cycles per block
+        vector<uint32_t> latency_of;            // per level, [lvl - 1]
+        vector<uint32_t> looked_up_at;          // per level, latency of the request when it got there
+        struct mshr {
+            addr_t   block_addr;
+            uint64_t ready;         // cycle the fill completes (and the MSHR frees up)
+        };
+
+        vector<vector<mshr> > mshr_store;       // per core and private level, then per shared level
+        vector<vector<mshr>*> mshrs;            // per level, of the current core
+        uint32_t private_levels;
+        uint32_t core;                          // whose requests are being simulated
+        vector<uint64_t> core_next_issue;       // of the other cores
+        vector<mshr*> held;                     // MSHRs taken by the current request
+        unordered_map<addr_t, uint64_t> prefetch_ready; // prefetched block -> cycle it arrives
+        size_t prune_at;                        // prefetch_ready size that triggers a cleanup
+        uint32_t demand_latency;                // of the request, while a prefetch is simulated
+        bool prefetching;
+        vector<addr_t>   pending_writes;        // write buffer of the current request
+        vector<dram_bank> banks;
+        uint64_t bus_free;
+        uint64_t next_issue;
+
+        // Returns the cycle the block is on the bus' far side
+        uint64_t dram_access(addr_t block_addr, uint64_t arrival){
+            uint64_t row_id   = (uint64_t) block_addr * this->block_size / this->params.dram_row;
+            dram_bank& bank   = this->banks[row_id % this->banks.size()];
+            uint64_t row      = row_id / this->banks.size();
+            uint64_t start    = max(arrival, bank.ready);
+            uint32_t activate = 0;  // cycles before the column access
+
+            if (bank.open && bank.row == row){
+                this->stats.dram_row_hits++;
+            }else if (!bank.open){
+                this->stats.dram_row_misses++;
+                activate = this->params.dram_trcd;
+            }else{
+                this->stats.dram_row_conflicts++;
+                activate = this->params.dram_trp + this->params.dram_trcd;
+            }
+            bank.open = true;
+            bank.row  = row;
+            // column accesses to an open row pipeline, one per burst
+            bank.ready = start + activate + this->burst_cycles;
+
+            uint64_t done = max(start + activate + this->params.dram_tcas, this->bus_free) + this->burst_cycles;
+            this->bus_free = done;
+            this->stats.dram_bus_cycles += this->burst_cycles;
+            return done;
+        }
+
+    public:
+        timing_params_t params;
+        timing_stats_t stats;
+
+        // The request being simulated
+        uint64_t now;           // cycle it was issued at
+        uint32_t latency;       // cycles spent on its critical path so far
+        uint32_t background;    // > 0 while simulating traffic off that path (writebacks)
+
+        // Levels 1 .. private_levels are private to each of cores
+        TimingModel(const timing_params_t& params, uint32_t block_size, uint32_t levels,
+                    uint32_t cores = 1, uint32_t private_levels = 0){
+            this->params     = params;
+            this->block_size = block_size;
+            this->burst_cycles = (block_size + params.dram_bus - 1) / params.dram_bus;
+
+            uint32_t latency[] = { params.l1_latency, params.l2_latency, params.l3_latency };
+            uint32_t entries[] = { params.l1_mshrs, params.l2_mshrs, params.l3_mshrs };
+            mshr free_mshr = { 0, 0 };
+            for (uint32_t c = 0; c < cores; c++){
+                for (uint32_t lvl = 1; lvl <= private_levels; lvl++){
+                    this->mshr_store.push_back(vector<mshr>(entries[min(lvl, 3u) - 1], free_mshr));
+                }
+            }
+            for (uint32_t lvl = 1; lvl <= levels; lvl++){
+                this->latency_of.push_back(latency[min(lvl, 3u) - 1]);
+                this->looked_up_at.push_back(0);
+                if (lvl > private_levels){
+                    this->mshr_store.push_back(vector<mshr>(entries[min(lvl, 3u) - 1], free_mshr));
+                }
+            }
+            this->private_levels = private_levels;
+            this->mshrs.assign(levels, NULL);
+            for (uint32_t lvl = private_levels + 1; lvl <= levels; lvl++){
+                this->mshrs[lvl - 1] = &this->mshr_store[cores * private_levels + lvl - private_levels - 1];
+            }
+            this->core       = 0;
+            this->next_issue = 0;
+            this->core_next_issue.assign(cores, 0);
+            this->set_core(0);
+            dram_bank idle = { 0, 0, false };
+            this->banks.assign(params.dram_banks, idle);
+            this->bus_free   = 0;
+            memset(&this->stats, 0, sizeof(this->stats));
+            this->stats.levels = levels;
+            this->now        = 0;
+            this->latency    = 0;
+            this->background = 0;
+            this->prune_at    = 4096;
+            this->prefetching = false;
+        }
+
+        // Overrides the hit latency and MSHR count of shared level lvl
+        void configure_level(uint32_t lvl, uint32_t latency, uint32_t mshr_count){
+            mshr free_mshr = { 0, 0 };
+            this->latency_of[lvl - 1] = latency;
+            this->mshrs[lvl - 1]->assign(mshr_count, free_mshr);
+        }
+
+        // Switches to the requests of core c
+        void set_core(uint32_t c){
+            this->core_next_issue[this->core] = this->next_issue;
+            this->core       = c;
+            this->next_issue = this->core_next_issue[c];
+            for (uint32_t lvl = 1; lvl <= this->private_levels; lvl++){
+                this->mshrs[lvl - 1] = &this->mshr_store[c * this->private_levels + lvl - 1];
+            }
+        }
+        // Cycle core c issues its next request at
+        uint64_t issue_cycle(uint32_t c){
+            return (c == this->core) ? this->next_issue : this->core_next_issue[c];
+        }
+
+        // Brackets the simulation of one request
+        void begin(){
+            this->now     = this->next_issue;
+            this->latency = 0;
+        }
+        void end(){
+            uint64_t done = this->now + this->latency;
+            for (uint32_t i = 0; i < this->held.size(); i++){
+                this->held[i]->ready = done;
+            }
+            this->held.clear();
+
+            // Drain the write buffer behind the request
+            for (uint32_t i = 0; i < this->pending_writes.size(); i++){
+                this->stats.cycles = max(this->stats.cycles, this->dram_access(this->pending_writes[i], done));
+            }
+            this->pending_writes.clear();
+
+            this->stats.requests++;
+            this->stats.total_latency += this->latency;
+            this->stats.cycles = max(this->stats.cycles, done);
+            this->next_issue++;
+        }
+
+        // Level lvl looks the request up
+        inline void lookup(uint32_t lvl){
+            if (this->background == 0){
+                this->latency += this->latency_of[lvl - 1];
+                this->looked_up_at[lvl - 1] = this->latency;
+            }
+        }
+
+        // The request hit block_addr in level lvl; it waits if the block's
+        // fill is still in flight
+        void hit(uint32_t lvl, addr_t block_addr){
+            if (this->background > 0){
+                return;
+            }
+            vector<mshr>& level = *this->mshrs[lvl - 1];
+            uint64_t arrival = this->now + this->latency;
+            for (uint32_t i = 0; i < level.size(); i++){
+                if (level[i].block_addr == block_addr && level[i].ready > arrival && level[i].ready != UINT64_MAX){
+                    this->latency += level[i].ready - arrival;
+                    ((lvl == 1) ? this->stats.l1_mshr_merges : (lvl == 2) ? this->stats.l2_mshr_merges : this->stats.l3_mshr_merges)++;
+                    return;
+                }
+            }
+        }
+
+        // The request missed block_addr in level lvl and needs one of its MSHRs
+        void miss(uint32_t lvl, addr_t block_addr){
+            if (this->background > 0 || this->prefetching){
+                return;
+            }
+            vector<mshr>& level = *this->mshrs[lvl - 1];
+            mshr* first = &level[0];
+            for (uint32_t i = 1; i < level.size(); i++){
+                if (level[i].ready < first->ready){
+                    first = &level[i];
+                }
+            }
+            uint64_t arrival = this->now + this->latency;
+            if (first->ready > arrival){
+                // Nothing can issue until the MSHR frees up
+                uint32_t stall = first->ready - arrival;
+                this->latency += stall;
+                this->stats.mshr_stall_cycles += stall;
+                this->next_issue += stall;
+            }
+            first->block_addr = block_addr;
+            first->ready      = UINT64_MAX; // until the request completes
+            this->held.push_back(first);
+        }
+
+        // Bracket a prefetch of block_addr issued by level lvl for the
+        // current request. It starts once the request has been looked up
+        // there (not after the request's own miss or late prefetch) and
+        // doesn't delay it.
+        void begin_prefetch(uint32_t lvl){
+            this->demand_latency = this->latency;
+            this->prefetching    = true;
+            if (this->background == 0){
+                this->latency = this->looked_up_at[lvl - 1];
+            }
+        }
+        void end_prefetch(addr_t block_addr){
+            uint64_t ready = this->now + this->latency;
+            this->prefetch_ready[block_addr] = ready;
+            this->stats.cycles = max(this->stats.cycles, ready);
+            this->latency     = this->demand_latency;
+            this->prefetching = false;
+
+            // Blocks that have arrived look the same as untracked ones
+            if (this->prefetch_ready.size() >= this->prune_at){
+                for (unordered_map<addr_t, uint64_t>::iterator it = this->prefetch_ready.begin(); it != this->prefetch_ready.end(); ){
+                    if (it->second <= this->now){
+                        it = this->prefetch_ready.erase(it);
+                    }else{
+                        ++it;
+                    }
+                }
+                this->prune_at = max((size_t) 4096, 2 * this->prefetch_ready.size());
+            }
+        }
+
+        // First demand use of prefetched block_addr; returns true if it
+        // was late (and the request waited for it)
+        bool prefetch_hit(addr_t block_addr){
+            if (this->background > 0){
+                return false;
+            }
+            unordered_map<addr_t, uint64_t>::iterator it = this->prefetch_ready.find(block_addr);
+            uint64_t arrival = this->now + this->latency;
+            if (it != this->prefetch_ready.end() && it->second > arrival){
+                this->stats.prefetch_late++;
+                this->stats.prefetch_late_cycles += it->second - arrival;
+                this->latency += it->second - arrival;
+                return true;
+            }
+            this->stats.prefetch_timely++;
+            return false;
+        }
+
+        void dram_read(addr_t block_addr){
+            this->stats.dram_reads++;
+            uint64_t done = this->dram_access(block_addr, this->now + this->latency);
+            if (this->background == 0){
+                this->latency = done - this->now;
+            }
+        }
+        void dram_write(addr_t block_addr){
+            this->stats.dram_writes++;
+            this->pending_writes.push_back(block_addr);
+        }
+        void dram_prefetch(addr_t block_addr){
+            this->stats.dram_prefetches++;
+            uint64_t done = this->dram_access(block_addr, this->now + this->latency);
+            if (this->prefetching){
+                this->latency = done - this->now;
+            }
+            this->stats.cycles = max(this->stats.cycles, done);
+        }
+
+        timing_stats_t report(){
+            timing_stats_t s = this->stats;
+            uint64_t bytes = (s.dram_reads + s.dram_writes + s.dram_prefetches) * this->block_size;
+            s.amat            = (s.requests > 0) ? (double) s.total_latency / (double) s.requests : 0;
+            s.bytes_per_cycle = (s.cycles > 0) ? (double) bytes / (double) s.cycles : 0;
+            s.gbytes_per_sec  = s.bytes_per_cycle * this->params.cpu_ghz;
+            return s;
+        }
+};
+
+void print_timing(const timing_params_t& t, const timing_stats_t& s){
+    printf("===== Timing =====\n");
+    if (s.levels > 2) {
+        printf("%-33s %u/%u/%u cycles\n", "L1/L2/L3 hit latency: ", t.l1_latency, t.l2_latency, t.l3_latency);
+        printf("%-33s %u/%u/%u\n", "L1/L2/L3 MSHRs: ", t.l1_mshrs, t.l2_mshrs, t.l3_mshrs);
+    }else {
+        printf("%-33s %u/%u cycles\n", "L1/L2 hit latency: ", t.l1_latency, t.l2_latency);
+        printf("%-33s %u/%u\n", "L1/L2 MSHRs: ", t.l1_mshrs, t.l2_mshrs);
+    }
+    printf("%-33s %u banks, %uB rows, %u-%u-%u, %uB/cycle\n", "DRAM: ", t.dram_banks, t.dram_row,
+           t.dram_tcas, t.dram_trcd, t.dram_trp, t.dram_bus);
+    printf("%-33s %llu\n", "total cycles: ", (unsigned long long) s.cycles);
+    printf("%-33s %.4f cycles\n", "average memory access time: ", s.amat);
+    printf("%-33s %llu\n", "MSHR stall cycles: ", (unsigned long long) s.mshr_stall_cycles);
+    if (s.levels > 2) {
+        printf("%-33s %llu/%llu/%llu\n", "L1/L2/L3 MSHR merges: ", (unsigned long long) s.l1_mshr_merges,
+               (unsigned long long) s.l2_mshr_merges, (unsigned long long) s.l3_mshr_merges);
+    }else {
+        printf("%-33s %llu/%llu\n", "L1/L2 MSHR merges: ", (unsigned long long) s.l1_mshr_merges,
+               (unsigned long long) s.l2_mshr_merges);
+    }
+    printf("%-33s %llu/%llu\n", "prefetch hits timely/late: ", (unsigned long long) s.prefetch_timely,
+           (unsigned long long) s.prefetch_late);
+    printf("%-33s %.4f cycles\n", "average late prefetch wait: ",
+           (s.prefetch_late > 0) ? (double) s.prefetch_late_cycles / (double) s.prefetch_late : 0);
+    printf("%-33s %llu/%llu/%llu\n", "DRAM reads/writes/prefetches: ", (unsigned long long) s.dram_reads,
+           (unsigned long long) s.dram_writes, (unsigned long long) s.dram_prefetches);
+    printf("%-33s %llu/%llu/%llu\n", "DRAM row hits/misses/conflicts: ", (unsigned long long) s.dram_row_hits,
+           (unsigned long long) s.dram_row_misses, (unsigned long long) s.dram_row_conflicts);
+    printf("%-33s %.4f\n", "DRAM bus utilization: ", (s.cycles > 0) ? (double) s.dram_bus_cycles / (double) s.cycles : 0);
+    printf("%-33s %.4f bytes/cycle (%.2f GB/s at %.2f GHz)\n", "memory bandwidth: ", s.bytes_per_cycle,
+           s.gbytes_per_sec, t.cpu_ghz);
+}
+
+#endif // TIMING_H
@@ -0,0 +1,124 @@
+#include <iostream>
+#include <time.h>
+#include "hierarchy.h"
+#include "trace_reader.h"
+
+using namespace std;
+
+/*  Trace ingest throughput benchmark: the old fscanf() loop vs TraceReader.
+
+    Example:
+    ./trace_bench traces/gcc_trace.txt traces/perl_trace.txt
+    ./trace_bench -n 50 traces/gcc_trace.txt
+
+    Each trace is parsed "-n" times (default 20) by both readers; the records are
+    folded into a checksum so both paths must decode exactly the same requests.
+    The "sim" columns also run the requests through the default L1/L2 hierarchy.
+*/
+
+static double now_sec(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t fold(uint64_t sum, char rw, addr_t addr){
+    return (sum * 31) + ((uint64_t) addr << 1) + (rw == 'w');
+}
+
+static Hierarchy* make_hierarchy(){
+    cache_params_t params = { 32, 8192, 4, 262144, 8, 3, 10, REPL_LRU, REPL_LRU };
+    return new Hierarchy(params);
+}
+
+// Parses the trace with fscanf(); feeds the hierarchy if not NULL
+static uint64_t run_fscanf(const char* trace_file, Hierarchy* hierarchy, uint64_t* records){
+    FILE* fp = fopen(trace_file, "r");
+    if (fp == (FILE *) NULL) {
+       printf("Error: Unable to open file %s\n", trace_file);
+       exit(EXIT_FAILURE);
+    }
+    char rw;
+    unsigned long long addr;
+    uint64_t sum = 0;
+    while (fscanf(fp, "%c %llx\n", &rw, &addr) == 2) {
+        sum = fold(sum, rw, addr);
+        (*records)++;
+        if (hierarchy != NULL){
+            hierarchy->access(rw, addr);
+        }
+    }
+    fclose(fp);
+    return sum;
+}
+
+// Parses the trace with TraceReader; feeds the hierarchy if not NULL
+static uint64_t run_reader(const char* trace_file, Hierarchy* hierarchy, uint64_t* records){
+    static trace_record batch[TRACE_BATCH_SIZE];
+    TraceReader trace;
+    if (!trace.open(trace_file)) {
+       printf("Error: Unable to open file %s\n", trace_file);
+       exit(EXIT_FAILURE);
+    }
+    uint64_t sum = 0;
+    uint32_t n;
+    while ((n = trace.next_batch(batch, TRACE_BATCH_SIZE)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            sum = fold(sum, batch[i].rw, batch[i].addr);
+        }
+        if (hierarchy != NULL){
+            hierarchy->access_batch(batch, n);
+        }
+        *records += n;
+    }
+    return sum;
+}
+
+typedef uint64_t (*run_fn)(const char*, Hierarchy*, uint64_t*);
+
+// Returns ns per record over all repetitions
+static double time_runs(run_fn fn, const char* trace_file, uint32_t reps, bool simulate, uint64_t* sum){
+    uint64_t records = 0;
+    double elapsed = 0;
+    for (uint32_t r = 0; r < reps; r++) {
+        Hierarchy* hierarchy = simulate ? make_hierarchy() : NULL;
+        double t0 = now_sec();
+        *sum = fn(trace_file, hierarchy, &records);
+        elapsed += now_sec() - t0;
+        delete hierarchy;
+    }
+    return (records > 0) ? (elapsed * 1e9 / records) : 0;
+}
+
+int main (int argc, char *argv[]) {
+    uint32_t reps = 20;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        reps  = (uint32_t) atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || reps == 0) {
+        cout << "usage: ./trace_bench [-n reps] trace.txt [trace.txt ...]" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-28s %12s %12s %8s %12s %12s %8s\n", "trace", "fscanf ns/r", "reader ns/r", "speedup",
+           "fscanf+sim", "reader+sim", "speedup");
+    for (int f = first; f < argc; f++) {
+        uint64_t sum_fscanf, sum_reader;
+        double parse_fscanf = time_runs(run_fscanf, argv[f], reps, false, &sum_fscanf);
+        double parse_reader = time_runs(run_reader, argv[f], reps, false, &sum_reader);
+        if (sum_fscanf != sum_reader) {
+            printf("Error: %s decoded differently by fscanf and TraceReader.\n", argv[f]);
+            exit(EXIT_FAILURE);
+        }
+        double sim_fscanf = time_runs(run_fscanf, argv[f], reps, true, &sum_fscanf);
+        double sim_reader = time_runs(run_reader, argv[f], reps, true, &sum_reader);
+
+        printf("%-28s %12.1f %12.1f %7.2fx %12.1f %12.1f %7.2fx\n", argv[f],
+               parse_fscanf, parse_reader, parse_fscanf / parse_reader,
+               sim_fscanf, sim_reader, sim_fscanf / sim_reader);
+    }
+    return(0);
+}
@@ -0,0 +1,390 @@
+#ifndef TRACE_READER_H
+#define TRACE_READER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib> //exit() EXIT_FAILURE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "addr.h"
+#include "trace_binary.h"
+#include "synthetic.h"
+
+// Number of records handed out per call to TraceReader::next_batch()
+#define TRACE_BATCH_SIZE 4096
+// Size of the blocks read from stdin/pipes (or any file that can't be mapped)
+#define TRACE_STREAM_BLOCK (1 << 20)
+// Leading bytes of a trace file that its identity is a hash of
+#define TRACE_ID_BYTES (1 << 16)
+
+// Where a TraceReader stands in its trace (see TraceReader::seek())
+typedef struct {
+    uint64_t records;       // handed out so far
+    uint64_t offset;        // bytes of the file consumed
+    uint64_t line_num;      // text traces: lines consumed
+    uint64_t prev_addr;     // binary traces: the address the next delta applies to
+} trace_position_t;
+
+// Maps each byte to its hex digit value, or -1 if it isn't a hex digit.
+// Built once so the parser never branches on character ranges.
+struct hex_table {
+    int8_t val[256];
+
+    hex_table(){
+        memset(this->val, -1, sizeof(this->val));
+        for (int c = '0'; c <= '9'; c++) this->val[c] = c - '0';
+        for (int c = 'a'; c <= 'f'; c++) this->val[c] = c - 'a' + 10;
+        for (int c = 'A'; c <= 'F'; c++) this->val[c] = c - 'A' + 10;
+    }
+};
+static const hex_table g_hex_table;
+
+// 64-bit FNV-1a of n bytes
+static inline uint64_t fnv1a64(const void* p, size_t n){
+    const uint8_t* b = (const uint8_t*) p;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; i++){
+        h = (h ^ b[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Reads "r|w <hex>" text traces or binary traces (see trace_binary.h); the
+// format is detected from the magic. Regular files are mmap'ed and parsed in
+// place (zero-copy); stdin ("-"), pipes and anything that can't be mapped are
+// streamed in TRACE_STREAM_BLOCK sized reads. A synthetic trace spec
+// ("synth:...", see synthetic.h) is generated instead of read.
+class TraceReader {
+    private:
+        int fd;
+        bool mapped;
+
+        const char* data;    // mapped file, or stream_buf when streaming
+        size_t data_len;
+        size_t pos;          // parse position in data
+        uint64_t data_offset; // file offset of data[0]
+        bool eof;            // no more bytes will be read from fd
+
+        char* stream_buf;
+        uint64_t line_num;
+
+        uint64_t records_read;
+
+        // Binary traces
+        trace_bin_header bin_header;
+        uint64_t prev_addr;
+
+        SyntheticTrace* synth;
+        uint64_t id;
+
+        bool refill();
+        bool detect_format();
+        bool parse_line(const char* p, const char* end, trace_record* rec);
+        uint32_t next_batch_text(trace_record* out, uint32_t max);
+        uint32_t next_batch_binary(trace_record* out, uint32_t max);
+
+    public:
+        const char* path;
+        bool binary;
+
+        TraceReader();
+        ~TraceReader();
+
+        // Returns false if the trace couldn't be opened
+        bool open(const char* path);
+        void close();
+
+        // Fills up to max records; returns 0 once the whole trace was consumed
+        uint32_t next_batch(trace_record* out, uint32_t max);
+
+        // Size of a mapped trace file; 0 when streaming
+        uint64_t size(){ return this->mapped ? this->data_len : 0; }
+        // Tells traces apart: a hash of the spec of a synthetic trace, or of
+        // the first TRACE_ID_BYTES bytes of a file (mapped or streamed)
+        uint64_t identity(){ return this->id; }
+        trace_position_t tell();
+        // Resumes at p, which tell() returned for this same trace: a mapped
+        // trace jumps there, a streamed one reads its way up to it. Returns
+        // false if the trace ends before p.
+        bool seek(const trace_position_t& p);
+};
+
+TraceReader::TraceReader(){
+    this->fd         = -1;
+    this->mapped     = false;
+    this->data       = NULL;
+    this->data_len   = 0;
+    this->pos        = 0;
+    this->data_offset = 0;
+    this->eof        = false;
+    this->stream_buf = NULL;
+    this->line_num   = 0;
+    this->path       = NULL;
+    this->binary     = false;
+    this->prev_addr    = 0;
+    this->records_read = 0;
+    this->synth        = NULL;
+    this->id           = 0;
+}
+
+TraceReader::~TraceReader(){
+    this->close();
+}
+
+bool TraceReader::open(const char* path){
+    this->close();
+    this->path = path;
+
+    if (is_synth_spec(path)){
+        this->synth = new SyntheticTrace(parse_synth_spec(path));
+        this->id    = fnv1a64(path, strlen(path));
+        return true;
+    }
+    if (strcmp(path, "-") == 0){
+        this->fd = STDIN_FILENO;
+    }else{
+        this->fd = ::open(path, O_RDONLY);
+        if (this->fd < 0){
+            return false;
+        }
+    }
+
+    struct stat st;
+    if (fstat(this->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+        void* m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, this->fd, 0);
+        if (m != MAP_FAILED){
+            madvise(m, st.st_size, MADV_SEQUENTIAL);
+            this->mapped   = true;
+            this->data     = (const char*) m;
+            this->data_len = st.st_size;
+            this->eof      = true;
+            this->id       = fnv1a64(this->data, (this->data_len < TRACE_ID_BYTES) ? this->data_len : TRACE_ID_BYTES);
+            return this->detect_format();
+        }
+    }
+
+    // Not mappable; fall back to streaming big blocks
+    this->stream_buf = (char*) malloc(TRACE_STREAM_BLOCK);
+    this->data       = this->stream_buf;
+    this->refill();
+    this->id = fnv1a64(this->data, (this->data_len < TRACE_ID_BYTES) ? this->data_len : TRACE_ID_BYTES);
+    return this->detect_format();
+}
+
+// Checks for the binary trace magic and consumes its header
+bool TraceReader::detect_format(){
+    if (!trace_bin_is_binary(this->data, this->data_len)){
+        return true;
+    }
+    if (this->data_len < TRACE_BIN_HEADER_SIZE){
+        printf("Error: truncated binary trace header in %s.\n", this->path);
+        exit(EXIT_FAILURE);
+    }
+    trace_bin_read_header((const uint8_t*) this->data, &this->bin_header);
+    if (this->bin_header.version != TRACE_BIN_VERSION){
+        printf("Error: %s is binary trace version %u; this simulator reads version %u.\n",
+               this->path, this->bin_header.version, TRACE_BIN_VERSION);
+        exit(EXIT_FAILURE);
+    }
+    this->binary = true;
+    this->pos    = TRACE_BIN_HEADER_SIZE;
+    return true;
+}
+
+void TraceReader::close(){
+    if (this->mapped){
+        munmap((void*) this->data, this->data_len);
+    }
+    free(this->stream_buf);
+    delete this->synth;
+    if (this->fd > STDIN_FILENO){
+        ::close(this->fd);
+    }
+    this->fd         = -1;
+    this->mapped     = false;
+    this->data       = NULL;
+    this->data_len   = 0;
+    this->pos        = 0;
+    this->data_offset = 0;
+    this->eof        = false;
+    this->stream_buf = NULL;
+    this->line_num   = 0;
+    this->binary     = false;
+    this->prev_addr    = 0;
+    this->records_read = 0;
+    this->synth        = NULL;
+    this->id           = 0;
+}
+
+// Moves the unparsed tail (a partial line) to the front of the buffer and
+// reads the next block behind it. Returns false if nothing new was read.
+bool TraceReader::refill(){
+    if (this->eof){
+        return false;
+    }
+
+    size_t tail = this->data_len - this->pos;
+    if (tail == TRACE_STREAM_BLOCK){
+        printf("Error: trace line %llu in %s is too long.\n", (unsigned long long) this->line_num + 1, this->path);
+        exit(EXIT_FAILURE);
+    }
+    memmove(this->stream_buf, this->stream_buf + this->pos, tail);
+    this->data_offset += this->pos;
+    this->pos      = 0;
+    this->data_len = tail;
+
+    while (this->data_len < TRACE_STREAM_BLOCK){
+        ssize_t n = ::read(this->fd, this->stream_buf + this->data_len, TRACE_STREAM_BLOCK - this->data_len);
+        if (n <= 0){
+            this->eof = true;
+            break;
+        }
+        this->data_len += n;
+    }
+    return this->data_len > tail;
+}
+
+// Decodes one "r|w <hex>" record from [p, end), which holds a single line
+// without its '\n'. Returns false for blank lines.
+bool TraceReader::parse_line(const char* p, const char* end, trace_record* rec){
+    const int8_t* hex = g_hex_table.val;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    if (p == end){
+        return false;
+    }
+
+    rec->rw = *p++;
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    if (end - p > 1 && p[0] == '0' && (p[1] | 0x20) == 'x'){
+        p += 2;
+    }
+
+    const char* digits = p;
+    addr_t addr = 0;
+    int8_t v;
+    while (p < end && (v = hex[(uint8_t) *p]) >= 0){
+        addr = (addr << 4) | (addr_t) v;
+        p++;
+    }
+    const char* digits_end = p;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+
+    // no digits, trailing garbage, or more than 64 bits of address
+    if (digits_end == digits || p != end || digits_end - digits > 16){
+        printf("Error: malformed trace line %llu in %s.\n", (unsigned long long) this->line_num, this->path);
+        exit(EXIT_FAILURE);
+    }
+    rec->addr = addr;
+    return true;
+}
+
+uint32_t TraceReader::next_batch(trace_record* out, uint32_t max){
+    if (this->synth){
+        uint32_t n = this->synth->next_batch(out, max);
+        this->records_read += n;
+        return n;
+    }
+    return this->binary ? this->next_batch_binary(out, max) : this->next_batch_text(out, max);
+}
+
+uint32_t TraceReader::next_batch_binary(trace_record* out, uint32_t max){
+    uint32_t n = 0;
+
+    while (n < max){
+        // Keep a whole record in the buffer when streaming
+        if (this->data_len - this->pos < TRACE_BIN_MAX_RECORD && !this->mapped){
+            this->refill();
+        }
+        const uint8_t* p   = (const uint8_t*) this->data + this->pos;
+        const uint8_t* end = (const uint8_t*) this->data + this->data_len;
+        if (p == end){
+            break;
+        }
+
+        uint64_t delta;
+        bool is_write;
+        uint32_t len = trace_bin_decode_record(p, end, &delta, &is_write);
+        if (len == 0){
+            printf("Error: truncated record %llu in binary trace %s.\n", (unsigned long long) this->records_read + 1, this->path);
+            exit(EXIT_FAILURE);
+        }
+        this->pos       += len;
+        this->prev_addr += (uint64_t) zigzag_decode(delta);
+        out[n].rw   = is_write ? 'w' : 'r';
+        out[n].addr = this->prev_addr;
+        n++;
+        this->records_read++;
+    }
+
+    if (n == 0 && this->bin_header.record_count != 0 && this->records_read != this->bin_header.record_count){
+        printf("Error: binary trace %s holds %llu records but its header says %llu.\n", this->path,
+               (unsigned long long) this->records_read, (unsigned long long) this->bin_header.record_count);
+        exit(EXIT_FAILURE);
+    }
+    return n;
+}
+
+uint32_t TraceReader::next_batch_text(trace_record* out, uint32_t max){
+    uint32_t n = 0;
+
+    while (n < max){
+        const char* p   = this->data + this->pos;
+        const char* end = this->data + this->data_len;
+        const char* nl  = (const char*) memchr(p, '\n', end - p);
+
+        if (nl == NULL){
+            // Partial line; get more bytes unless this is the end of the trace
+            if (!this->mapped && this->refill()){
+                continue;
+            }
+            if (p == end){
+                break;
+            }
+            nl = end; // last line has no '\n'
+        }
+
+        this->line_num++;
+        if (this->parse_line(p, nl, &out[n])){
+            n++;
+            this->records_read++;
+        }
+        this->pos = (nl < end) ? (nl - this->data) + 1 : this->data_len;
+    }
+    return n;
+}
+
+trace_position_t TraceReader::tell(){
+    trace_position_t p;
+    p.records   = this->records_read;
+    p.offset    = this->data_offset + this->pos;
+    p.line_num  = this->line_num;
+    p.prev_addr = this->prev_addr;
+    return p;
+}
+
+bool TraceReader::seek(const trace_position_t& p){
+    if (this->mapped){
+        if (p.offset > this->data_len){
+            return false;
+        }
+        this->pos          = p.offset;
+        this->records_read = p.records;
+        this->line_num     = p.line_num;
+        this->prev_addr    = p.prev_addr;
+        return true;
+    }
+    static trace_record skipped[TRACE_BATCH_SIZE];
+    while (this->records_read < p.records){
+        uint64_t left = p.records - this->records_read;
+        if (this->next_batch(skipped, (left < TRACE_BATCH_SIZE) ? (uint32_t) left : TRACE_BATCH_SIZE) == 0){
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // TRACE_READER_H
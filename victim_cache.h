@@ -0,0 +1,111 @@
+#ifndef VICTIM_CACHE_H
+#define VICTIM_CACHE_H
+
+#include <stdint.h>
+#include <vector>
+#include "addr.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+/*  Victim cache (Jouppi): a small fully associative LRU buffer behind one
+    cache level that holds the blocks the level evicts. The level probes it
+    on a miss, alongside its stream buffers; a hit swaps the block back in
+    without going to the next level. Only blocks pushed out of the buffer
+    move on (dirty ones are written back).
+*/
+class VictimCache {
+    private:
+        vector<addr_t>   blocks;    // block addresses
+        vector<uint8_t>  state;     // BLOCK_VALID | BLOCK_DIRTY
+        vector<uint64_t> stamps;    // last insertion, for LRU
+        uint64_t clock;
+
+    public:
+        uint64_t hits;          // misses of the level it supplied
+        uint64_t insertions;    // blocks the level evicted into it
+        uint64_t writebacks;    // dirty blocks it pushed out
+
+        VictimCache(uint32_t entries){
+            this->blocks.assign(entries, 0);
+            this->state.assign(entries, 0);
+            this->stamps.assign(entries, 0);
+            this->clock      = 0;
+            this->hits       = 0;
+            this->insertions = 0;
+            this->writebacks = 0;
+        }
+
+        uint32_t entries(){ return this->blocks.size(); }
+
+        // Checkpoints (checkpoint.h); load() needs as many entries as save() had
+        void save(CheckpointWriter& w){
+            w.put(this->clock);
+            w.put(this->hits);
+            w.put(this->insertions);
+            w.put(this->writebacks);
+            w.put_vector(this->blocks);
+            w.put_vector(this->state);
+            w.put_vector(this->stamps);
+        }
+        void load(CheckpointReader& r){
+            this->clock      = r.get<uint64_t>();
+            this->hits       = r.get<uint64_t>();
+            this->insertions = r.get<uint64_t>();
+            this->writebacks = r.get<uint64_t>();
+            r.get_vector(this->blocks);
+            r.get_vector(this->state);
+            r.get_vector(this->stamps);
+        }
+
+        bool contains(addr_t block_addr){
+            for (uint32_t i = 0; i < this->blocks.size(); i++){
+                if ((this->state[i] & BLOCK_VALID) && this->blocks[i] == block_addr){
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Removes block_addr if it's here; returns true and whether it was dirty
+        bool take(addr_t block_addr, bool* dirty){
+            for (uint32_t i = 0; i < this->blocks.size(); i++){
+                if ((this->state[i] & BLOCK_VALID) && this->blocks[i] == block_addr){
+                    *dirty = (this->state[i] & BLOCK_DIRTY) != 0;
+                    this->state[i] = 0;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Inserts a block evicted by the level. Returns true if that pushed
+        // the LRU block out, which is then in *out_block / *out_dirty.
+        bool insert(addr_t block_addr, bool dirty, addr_t* out_block, bool* out_dirty){
+            uint32_t slot = 0;
+            for (uint32_t i = 0; i < this->blocks.size(); i++){
+                if (!(this->state[i] & BLOCK_VALID)){
+                    slot = i;
+                    break;
+                }
+                if (this->stamps[i] < this->stamps[slot]){
+                    slot = i;
+                }
+            }
+            bool pushed_out = (this->state[slot] & BLOCK_VALID) != 0;
+            if (pushed_out){
+                *out_block = this->blocks[slot];
+                *out_dirty = (this->state[slot] & BLOCK_DIRTY) != 0;
+                if (*out_dirty){
+                    this->writebacks++;
+                }
+            }
+            this->blocks[slot] = block_addr;
+            this->state[slot]  = BLOCK_VALID | (dirty ? BLOCK_DIRTY : 0);
+            this->stamps[slot] = ++this->clock;
+            this->insertions++;
+            return pushed_out;
+        }
+};
+
+#endif // VICTIM_CACHE_H